@@ -62,11 +62,16 @@ typedef struct {
 
 	int fd;
 	int error;
-	unsigned int activated:1;	/* PipeWire is activated? */
+	bool activated;		/* PipeWire is activated? */
+	bool active;		/* requested by start and stop, activated
+				 * follows it on the thread loop */
 	unsigned int drained:1;
 	unsigned int draining:1;
-	unsigned int xrun_detected:1;
+	unsigned int realtime:1;	/* lock-free start/stop, wakeup at avail_min */
 
+	/* written by the data thread, read by the application */
+	uint32_t xrun_detected;
+	uint32_t time_seq;
 	snd_pcm_uframes_t hw_ptr;
 	snd_pcm_uframes_t boundary;
 	snd_pcm_uframes_t min_avail;
@@ -94,6 +99,36 @@ typedef struct {
 
 static int snd_pcm_pipewire_stop(snd_pcm_ioplug_t *io);
 
+/* The data thread publishes hw_ptr and the stream time without taking the
+ * thread loop lock, the application only reads them. */
+static inline snd_pcm_uframes_t get_hw_ptr(snd_pcm_pipewire_t *pw)
+{
+	return __atomic_load_n(&pw->hw_ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void set_hw_ptr(snd_pcm_pipewire_t *pw, snd_pcm_uframes_t hw_ptr)
+{
+	__atomic_store_n(&pw->hw_ptr, hw_ptr, __ATOMIC_RELEASE);
+}
+
+static void update_time(snd_pcm_pipewire_t *pw)
+{
+	__atomic_add_fetch(&pw->time_seq, 1, __ATOMIC_SEQ_CST);
+	pw_stream_get_time(pw->stream, &pw->time);
+	__atomic_add_fetch(&pw->time_seq, 1, __ATOMIC_SEQ_CST);
+}
+
+static void get_time(snd_pcm_pipewire_t *pw, struct pw_time *time)
+{
+	uint32_t seq1, seq2;
+	do {
+		seq1 = __atomic_load_n(&pw->time_seq, __ATOMIC_ACQUIRE);
+		*time = pw->time;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&pw->time_seq, __ATOMIC_RELAXED);
+	} while (seq1 != seq2 || (seq1 & 1));
+}
+
 static int pcm_poll_block_check(snd_pcm_ioplug_t *io)
 {
 	uint64_t val;
@@ -168,34 +203,37 @@ static int snd_pcm_pipewire_poll_revents(snd_pcm_ioplug_t *io,
 static snd_pcm_sframes_t snd_pcm_pipewire_pointer(snd_pcm_ioplug_t *io)
 {
 	snd_pcm_pipewire_t *pw = io->private_data;
-	if (pw->xrun_detected)
+	if (__atomic_load_n(&pw->xrun_detected, __ATOMIC_ACQUIRE))
 		return -EPIPE;
 	if (pw->error < 0)
 		return pw->error;
 	if (io->buffer_size == 0)
 		return 0;
 #ifdef SND_PCM_IOPLUG_FLAG_BOUNDARY_WA
-	return pw->hw_ptr;
+	return get_hw_ptr(pw);
 #else
-	return pw->hw_ptr % io->buffer_size;
+	return get_hw_ptr(pw) % io->buffer_size;
 #endif
 }
 
 static int snd_pcm_pipewire_delay(snd_pcm_ioplug_t *io, snd_pcm_sframes_t *delayp)
 {
 	snd_pcm_pipewire_t *pw = io->private_data;
+	struct pw_time time;
 	int64_t elapsed = 0, filled;
 
-	if (pw->time.rate.num != 0) {
+	get_time(pw, &time);
+
+	if (time.rate.num != 0) {
 		struct timespec ts;
 		int64_t diff;
 		clock_gettime(CLOCK_MONOTONIC, &ts);
-		diff = SPA_TIMESPEC_TO_NSEC(&ts) - pw->time.now;
-	        elapsed = (pw->time.rate.denom * diff) / (pw->time.rate.num * SPA_NSEC_PER_SEC);
-		if (elapsed > pw->time.delay)
-			elapsed = pw->time.delay;
+		diff = SPA_TIMESPEC_TO_NSEC(&ts) - time.now;
+	        elapsed = (time.rate.denom * diff) / (time.rate.num * SPA_NSEC_PER_SEC);
+		if (elapsed > time.delay)
+			elapsed = time.delay;
 	}
-	filled = pw->time.delay + snd_pcm_ioplug_hw_avail(io, pw->hw_ptr, io->appl_ptr);
+	filled = time.delay + snd_pcm_ioplug_hw_avail(io, get_hw_ptr(pw), io->appl_ptr);
 
 	if (io->stream == SND_PCM_STREAM_PLAYBACK)
 		*delayp = filled - SPA_MIN(elapsed, filled);
@@ -278,7 +316,7 @@ snd_pcm_pipewire_process(snd_pcm_pipewire_t *pw, struct pw_buffer *b,
 			hw_ptr += xfer;
 			if (hw_ptr > pw->boundary)
 				hw_ptr -= pw->boundary;
-			pw->hw_ptr = hw_ptr;
+			set_hw_ptr(pw, hw_ptr);
 			*hw_avail -= xfer;
 		}
 	}
@@ -294,7 +332,7 @@ snd_pcm_pipewire_process(snd_pcm_pipewire_t *pw, struct pw_buffer *b,
 		if (io->state == SND_PCM_STATE_RUNNING ||
 			io->state == SND_PCM_STATE_DRAINING) {
 			/* report Xrun to user application */
-			pw->xrun_detected = true;
+			__atomic_store_n(&pw->xrun_detected, 1, __ATOMIC_RELEASE);
 		}
 	}
 	return 0;
@@ -351,9 +389,10 @@ static void on_stream_process(void *data)
 	struct pw_buffer *b;
 	snd_pcm_uframes_t hw_avail, want;
 
-	pw_stream_get_time(pw->stream, &pw->time);
+	update_time(pw);
 
-	hw_avail = snd_pcm_ioplug_hw_avail(io, pw->hw_ptr, io->appl_ptr);
+	hw_avail = snd_pcm_ioplug_hw_avail(io, pw->hw_ptr,
+			__atomic_load_n(&io->appl_ptr, __ATOMIC_ACQUIRE));
 
 	if (pw->drained) {
 		pcm_poll_unblock_check(io); /* unblock socket for polling if needed */
@@ -376,7 +415,14 @@ static void on_stream_process(void *data)
 		pw->draining = true;
 		pw->drained = false;
 	}
-	pcm_poll_unblock_check(io); /* unblock socket for polling if needed */
+	/* in realtime mode, only wake up the application when it can
+	 * transfer at least avail_min frames or needs to handle a state
+	 * change, pcm_poll_block_check() would block it again otherwise */
+	if (!pw->realtime ||
+	    io->buffer_size - hw_avail >= pw->min_avail ||
+	    io->state != SND_PCM_STATE_RUNNING ||
+	    __atomic_load_n(&pw->xrun_detected, __ATOMIC_RELAXED))
+		pcm_poll_unblock_check(io); /* unblock socket for polling if needed */
 }
 
 static void on_stream_drained(void *data)
@@ -404,7 +450,10 @@ static int snd_pcm_pipewire_drain(snd_pcm_ioplug_t *io)
 	pw_thread_loop_lock(pw->main_loop);
 	pw->drained = false;
 	pw->draining = false;
-	while (!pw->drained && pw->error >= 0 && pw->activated) {
+	/* in realtime mode the activation can still be queued, wait for
+	 * the requested state */
+	while (!pw->drained && pw->error >= 0 && pw->stream != NULL &&
+	    __atomic_load_n(&pw->active, __ATOMIC_ACQUIRE)) {
 		pw_thread_loop_wait(pw->main_loop);
 	}
 	res = pw->error;
@@ -492,8 +541,8 @@ static int snd_pcm_pipewire_prepare(snd_pcm_ioplug_t *io)
 				params, 1);
 
 done:
-	pw->hw_ptr = 0;
-	pw->xrun_detected = false;
+	set_hw_ptr(pw, 0);
+	__atomic_store_n(&pw->xrun_detected, 0, __ATOMIC_RELEASE);
 
 	pw_thread_loop_unlock(pw->main_loop);
 
@@ -504,17 +553,44 @@ error:
 	return -ENOMEM;
 }
 
+static int do_set_active(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	snd_pcm_pipewire_t *pw = user_data;
+	bool active = *(const bool*)data;
+
+	if (pw->activated != active && pw->stream != NULL) {
+		pw_stream_set_active(pw->stream, active);
+		pw->activated = active;
+		/* wake up a drain waiting for a stop */
+		pw_thread_loop_signal(pw->main_loop, false);
+	}
+	return 0;
+}
+
+static void set_active(snd_pcm_pipewire_t *pw, bool active)
+{
+	__atomic_store_n(&pw->active, active, __ATOMIC_RELEASE);
+
+	if (pw->realtime) {
+		/* queue the state change on the thread loop without waiting
+		 * for it, start and stop can then be called from a realtime
+		 * application thread */
+		pw_loop_invoke(pw_thread_loop_get_loop(pw->main_loop),
+				do_set_active, 0, &active, sizeof(active), false, pw);
+	} else {
+		pw_thread_loop_lock(pw->main_loop);
+		do_set_active(NULL, false, 0, &active, sizeof(active), pw);
+		pw_thread_loop_unlock(pw->main_loop);
+	}
+}
+
 static int snd_pcm_pipewire_start(snd_pcm_ioplug_t *io)
 {
 	snd_pcm_pipewire_t *pw = io->private_data;
 
-	pw_thread_loop_lock(pw->main_loop);
 	pw_log_debug(NAME" %p:", pw);
-	if (!pw->activated && pw->stream != NULL) {
-		pw_stream_set_active(pw->stream, true);
-		pw->activated = true;
-	}
-	pw_thread_loop_unlock(pw->main_loop);
+	set_active(pw, true);
 	return 0;
 }
 
@@ -525,12 +601,7 @@ static int snd_pcm_pipewire_stop(snd_pcm_ioplug_t *io)
 	pw_log_debug(NAME" %p:", pw);
 	pcm_poll_unblock_check(io);
 
-	pw_thread_loop_lock(pw->main_loop);
-	if (pw->activated && pw->stream != NULL) {
-		pw_stream_set_active(pw->stream, false);
-		pw->activated = false;
-	}
-	pw_thread_loop_unlock(pw->main_loop);
+	set_active(pw, false);
 	return 0;
 }
 
@@ -914,6 +985,7 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp, const char *name,
 				snd_pcm_stream_t stream,
 				int mode,
 				uint32_t flags,
+				bool realtime,
 				int rate,
 				snd_pcm_format_t format,
 				int channels,
@@ -936,14 +1008,15 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp, const char *name,
 
 	str = getenv("PIPEWIRE_NODE");
 
-	pw_log_debug(NAME" %p: open %s %d %d %08x %d %s %d %d '%s'", pw, name,
-			stream, mode, flags, rate,
+	pw_log_debug(NAME" %p: open %s %d %d %08x %d %d %s %d %d '%s'", pw, name,
+			stream, mode, flags, realtime, rate,
 			format != SND_PCM_FORMAT_UNKNOWN ? snd_pcm_format_name(format) : "none",
 			channels, period_bytes, str);
 
 	pw->fd = -1;
 	pw->io.poll_fd = -1;
 	pw->flags = flags;
+	pw->realtime = realtime;
 
 	if (node_name == NULL)
 		pw->node_name = spa_aprintf("ALSA %s",
@@ -1043,6 +1116,7 @@ SND_PCM_PLUGIN_DEFINE_FUNC(pipewire)
 	int channels = 0;
 	int period_bytes = 0;
 	uint32_t flags = 0;
+	bool realtime = false;
 	int err;
 
 	pw_init(NULL, NULL);
@@ -1077,6 +1151,10 @@ SND_PCM_PLUGIN_DEFINE_FUNC(pipewire)
 				flags |= PW_STREAM_FLAG_EXCLUSIVE;
 			continue;
 		}
+		if (strcmp(id, "realtime") == 0) {
+			realtime = snd_config_get_bool(n) > 0;
+			continue;
+		}
 		if (strcmp(id, "rate") == 0) {
 			long val;
 
@@ -1121,7 +1199,7 @@ SND_PCM_PLUGIN_DEFINE_FUNC(pipewire)
 	}
 
 	err = snd_pcm_pipewire_open(pcmp, name, node_name, server_name, playback_node,
-			capture_node, stream, mode, flags, rate, format,
+			capture_node, stream, mode, flags, realtime, rate, format,
 			channels, period_bytes);
 
 	return err;
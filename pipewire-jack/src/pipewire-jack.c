@@ -53,6 +53,8 @@
 #include "extensions/metadata.h"
 #include "pipewire-jack-extensions.h"
 
+#include "../../spa/plugins/audiomixer/mix-ops.h"
+
 #define JACK_DEFAULT_VIDEO_TYPE	"32 bit float RGBA video"
 
 #define JACK_CLIENT_NAME_SIZE		64
@@ -91,12 +93,19 @@ static bool mlock_warned = false;
 
 #define OBJECT_CHUNK	8
 
-typedef void (*mix2_func) (float *dst, float *src1, float *src2, int n_samples);
+#define OBJECT_HASH_SIZE	1024	/* power of 2 */
+#define HASH_NAME		0
+#define HASH_ALIAS1		1
+#define HASH_ALIAS2		2
+#define HASH_N			3
+
+#define REGEX_CACHE_SIZE	8
 
-static mix2_func mix2;
+static struct mix_ops mix_ops;
 
 struct object {
 	struct spa_list link;
+	struct spa_list hash_link[HASH_N];	/* name, alias1, alias2 */
 
 	struct client *client;
 
@@ -142,6 +151,10 @@ struct midi_buffer {
 	int32_t write_pos;
 	uint32_t event_count;
 	uint32_t lost_events;
+	/* when not NULL, the events are read directly from this sequence */
+	struct spa_pod_sequence *seq;
+	struct spa_pod_control *seq_control;
+	uint32_t seq_index;
 };
 
 #define MIDI_INLINE_MAX	4
@@ -227,6 +240,22 @@ struct context {
 	struct spa_list ports;
 	struct spa_list nodes;
 	struct spa_list links;
+
+	/* indexes on the objects in the lists above */
+	struct spa_list node_hash[OBJECT_HASH_SIZE];
+	struct spa_list port_hash[HASH_N][OBJECT_HASH_SIZE];
+	struct spa_list link_hash[OBJECT_HASH_SIZE];
+
+	/* all ports, in the order used by jack_get_ports() */
+	struct pw_array sorted_ports;
+	unsigned int sorted_dirty:1;
+
+	struct {
+		char *pattern;
+		regex_t regex;
+		uint64_t used;
+	} regex_cache[REGEX_CACHE_SIZE];
+	uint64_t regex_used;
 };
 
 #define GET_DIRECTION(f)	((f) & JackPortIsInput ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT)
@@ -335,6 +364,8 @@ struct client {
 		struct spa_io_position *position;
 		struct pw_node_activation *driver_activation;
 		struct spa_list target_links;
+		/* inputs of the port that is being mixed */
+		const void *mix_src[CONNECTION_NUM_FOR_PORT];
 	} rt;
 
 	int pending;
@@ -364,6 +395,216 @@ static void init_port_pool(struct client *c, enum spa_direction direction)
 	c->n_port_pool[direction] = 0;
 }
 
+static void init_object_hash(struct client *c)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < OBJECT_HASH_SIZE; i++) {
+		spa_list_init(&c->context.node_hash[i]);
+		for (j = 0; j < HASH_N; j++)
+			spa_list_init(&c->context.port_hash[j][i]);
+		spa_list_init(&c->context.link_hash[i]);
+	}
+}
+
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t h = 2166136261u;
+	while (*name) {
+		h ^= (uint8_t) *name++;
+		h *= 16777619u;
+	}
+	return h & (OBJECT_HASH_SIZE - 1);
+}
+
+static inline uint32_t hash_link(uint32_t src, uint32_t dst)
+{
+	return ((src * 2654435761u) ^ dst) & (OBJECT_HASH_SIZE - 1);
+}
+
+static int port_compare_func(const void *v1, const void *v2)
+{
+	const struct object *const*o1 = v1, *const*o2 = v2;
+	struct client *c = (*o1)->client;
+	int res;
+	bool is_cap1, is_cap2, is_def1 = false, is_def2 = false;
+
+	is_cap1 = ((*o1)->port.flags & JackPortIsOutput) == JackPortIsOutput &&
+		!(*o1)->port.is_monitor;
+	is_cap2 = ((*o2)->port.flags & JackPortIsOutput) == JackPortIsOutput &&
+		!(*o2)->port.is_monitor;
+
+	if (c->metadata) {
+		if (is_cap1)
+			is_def1 = (*o1)->port.node_id == c->metadata->default_audio_source;
+		else if (!is_cap1)
+			is_def1 = (*o1)->port.node_id == c->metadata->default_audio_sink;
+
+		if (is_cap2)
+			is_def2 = (*o2)->port.node_id == c->metadata->default_audio_source;
+		else if (!is_cap2)
+			is_def2 = (*o2)->port.node_id == c->metadata->default_audio_sink;
+	}
+	if ((*o1)->port.type_id != (*o2)->port.type_id)
+		res = (*o1)->port.type_id - (*o2)->port.type_id;
+	else if ((is_cap1 || is_cap2) && is_cap1 != is_cap2)
+		res = is_cap2 - is_cap1;
+	else if ((is_def1 || is_def2) && is_def1 != is_def2)
+		res = is_def2 - is_def1;
+	else if ((*o1)->port.priority != (*o2)->port.priority)
+		res = (*o2)->port.priority - (*o1)->port.priority;
+	else if ((res = strcmp((*o1)->port.alias1, (*o2)->port.alias1)) == 0)
+		res = (*o1)->id - (*o2)->id;
+
+	return res;
+}
+
+/* must be called with the context lock */
+static void sorted_port_add(struct client *c, struct object *o)
+{
+	struct pw_array *arr = &c->context.sorted_ports;
+	struct object **ports;
+	uint32_t lo = 0, hi, mid;
+
+	if ((ports = pw_array_add(arr, sizeof(struct object *))) == NULL)
+		return;
+	*ports = o;
+	if (c->context.sorted_dirty)
+		return;
+
+	ports = pw_array_first(arr);
+	hi = pw_array_get_len(arr, struct object *) - 1;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (port_compare_func(&ports[mid], &o) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	memmove(&ports[lo + 1], &ports[lo],
+			(pw_array_get_len(arr, struct object *) - lo - 1) * sizeof(struct object *));
+	ports[lo] = o;
+}
+
+/* must be called with the context lock */
+static void sorted_port_remove(struct client *c, struct object *o)
+{
+	struct object **p;
+
+	pw_array_for_each(p, &c->context.sorted_ports) {
+		if (*p == o) {
+			pw_array_remove(&c->context.sorted_ports, p);
+			break;
+		}
+	}
+}
+
+/* must be called with the context lock */
+static void sorted_port_update(struct client *c)
+{
+	struct pw_array *arr = &c->context.sorted_ports;
+
+	if (!c->context.sorted_dirty)
+		return;
+
+	qsort(pw_array_first(arr), pw_array_get_len(arr, struct object *),
+			sizeof(struct object *), port_compare_func);
+	c->context.sorted_dirty = false;
+}
+
+/* must be called with the context lock */
+static regex_t *cached_regex(struct client *c, const char *pattern)
+{
+	struct context *ctx = &c->context;
+	uint32_t i, idx = 0;
+	bool have_empty = false;
+
+	for (i = 0; i < REGEX_CACHE_SIZE; i++) {
+		/* a failed regcomp can leave an empty slot anywhere */
+		if (ctx->regex_cache[i].pattern == NULL) {
+			if (!have_empty) {
+				idx = i;
+				have_empty = true;
+			}
+			continue;
+		}
+		if (strcmp(ctx->regex_cache[i].pattern, pattern) == 0) {
+			ctx->regex_cache[i].used = ++ctx->regex_used;
+			return &ctx->regex_cache[i].regex;
+		}
+		if (!have_empty && ctx->regex_cache[i].used < ctx->regex_cache[idx].used)
+			idx = i;
+	}
+	if (ctx->regex_cache[idx].pattern != NULL) {
+		regfree(&ctx->regex_cache[idx].regex);
+		free(ctx->regex_cache[idx].pattern);
+		ctx->regex_cache[idx].pattern = NULL;
+	}
+	if (regcomp(&ctx->regex_cache[idx].regex, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
+		pw_log_warn(NAME" %p: invalid regex '%s'", c, pattern);
+		return NULL;
+	}
+	if ((ctx->regex_cache[idx].pattern = strdup(pattern)) == NULL) {
+		regfree(&ctx->regex_cache[idx].regex);
+		return NULL;
+	}
+	ctx->regex_cache[idx].used = ++ctx->regex_used;
+	return &ctx->regex_cache[idx].regex;
+}
+
+static void clear_regex_cache(struct client *c)
+{
+	uint32_t i;
+	for (i = 0; i < REGEX_CACHE_SIZE; i++) {
+		if (c->context.regex_cache[i].pattern == NULL)
+			continue;
+		regfree(&c->context.regex_cache[i].regex);
+		free(c->context.regex_cache[i].pattern);
+		c->context.regex_cache[i].pattern = NULL;
+	}
+}
+
+/* must be called with the context lock */
+static void object_hash_add(struct client *c, struct object *o)
+{
+	switch (o->type) {
+	case INTERFACE_Node:
+		spa_list_append(&c->context.node_hash[hash_name(o->node.name)],
+				&o->hash_link[HASH_NAME]);
+		break;
+	case INTERFACE_Port:
+		spa_list_append(&c->context.port_hash[HASH_NAME][hash_name(o->port.name)],
+				&o->hash_link[HASH_NAME]);
+		if (o->port.alias1[0] != '\0')
+			spa_list_append(&c->context.port_hash[HASH_ALIAS1][hash_name(o->port.alias1)],
+					&o->hash_link[HASH_ALIAS1]);
+		if (o->port.alias2[0] != '\0')
+			spa_list_append(&c->context.port_hash[HASH_ALIAS2][hash_name(o->port.alias2)],
+					&o->hash_link[HASH_ALIAS2]);
+		sorted_port_add(c, o);
+		break;
+	case INTERFACE_Link:
+		spa_list_append(&c->context.link_hash[hash_link(o->port_link.src, o->port_link.dst)],
+				&o->hash_link[HASH_NAME]);
+		break;
+	}
+}
+
+/* must be called with the context lock, it is safe to call this on
+ * objects that are not in the hash */
+static void object_hash_remove(struct client *c, struct object *o)
+{
+	uint32_t i;
+
+	if (o->type == INTERFACE_Port && !spa_list_is_empty(&o->hash_link[HASH_NAME]))
+		sorted_port_remove(c, o);
+
+	for (i = 0; i < HASH_N; i++) {
+		spa_list_remove(&o->hash_link[i]);
+		spa_list_init(&o->hash_link[i]);
+	}
+}
+
 static struct object * alloc_object(struct client *c)
 {
 	struct object *o;
@@ -380,6 +621,8 @@ static struct object * alloc_object(struct client *c)
         o = spa_list_first(&c->context.free_objects, struct object, link);
         spa_list_remove(&o->link);
 	o->client = c;
+	for (i = 0; i < HASH_N; i++)
+		spa_list_init(&o->hash_link[i]);
 
 	return o;
 }
@@ -387,6 +630,7 @@ static struct object * alloc_object(struct client *c)
 static void free_object(struct client *c, struct object *o)
 {
 	pthread_mutex_lock(&c->context.lock);
+	object_hash_remove(c, o);
         spa_list_remove(&o->link);
 	pthread_mutex_unlock(&c->context.lock);
 	spa_list_append(&c->context.free_objects, &o->link);
@@ -535,7 +779,7 @@ static struct object *find_node(struct client *c, const char *name)
 {
 	struct object *o;
 
-	spa_list_for_each(o, &c->context.nodes, link) {
+	spa_list_for_each(o, &c->context.node_hash[hash_name(name)], hash_link[HASH_NAME]) {
 		if (!strcmp(o->node.name, name))
 			return o;
 	}
@@ -545,11 +789,18 @@ static struct object *find_node(struct client *c, const char *name)
 static struct object *find_port(struct client *c, const char *name)
 {
 	struct object *o;
+	uint32_t h = hash_name(name);
 
-	spa_list_for_each(o, &c->context.ports, link) {
-		if (strcmp(o->port.name, name) == 0 ||
-		    strcmp(o->port.alias1, name) == 0 ||
-		    strcmp(o->port.alias2, name) == 0)
+	spa_list_for_each(o, &c->context.port_hash[HASH_NAME][h], hash_link[HASH_NAME]) {
+		if (strcmp(o->port.name, name) == 0)
+			return o;
+	}
+	spa_list_for_each(o, &c->context.port_hash[HASH_ALIAS1][h], hash_link[HASH_ALIAS1]) {
+		if (strcmp(o->port.alias1, name) == 0)
+			return o;
+	}
+	spa_list_for_each(o, &c->context.port_hash[HASH_ALIAS2][h], hash_link[HASH_ALIAS2]) {
+		if (strcmp(o->port.alias2, name) == 0)
 			return o;
 	}
 	return NULL;
@@ -559,7 +810,7 @@ static struct object *find_link(struct client *c, uint32_t src, uint32_t dst)
 {
 	struct object *l;
 
-	spa_list_for_each(l, &c->context.links, link) {
+	spa_list_for_each(l, &c->context.link_hash[hash_link(src, dst)], hash_link[HASH_NAME]) {
 		if (l->port_link.src == src &&
 		    l->port_link.dst == dst) {
 			return l;
@@ -582,42 +833,6 @@ static struct buffer *dequeue_buffer(struct mix *mix)
 	return b;
 }
 
-#if defined (__SSE__)
-#include <xmmintrin.h>
-static void mix2_sse(float *dst, float *src1, float *src2, int n_samples)
-{
-	int n, unrolled;
-	__m128 in[2];
-
-	if (SPA_IS_ALIGNED(src1, 16) &&
-	    SPA_IS_ALIGNED(src2, 16) &&
-	    SPA_IS_ALIGNED(dst, 16))
-		unrolled = n_samples / 4;
-	else
-		unrolled = 0;
-
-	for (n = 0; unrolled--; n += 4) {
-		in[0] = _mm_load_ps(&src1[n]),
-		in[1] = _mm_load_ps(&src2[n]),
-		in[0] = _mm_add_ps(in[0], in[1]);
-		_mm_store_ps(&dst[n], in[0]);
-	}
-	for (; n < n_samples; n++) {
-		in[0] = _mm_load_ss(&src1[n]),
-		in[1] = _mm_load_ss(&src2[n]),
-		in[0] = _mm_add_ss(in[0], in[1]);
-		_mm_store_ss(&dst[n], in[0]);
-	}
-}
-#endif
-
-static void mix2_c(float *dst, float *src1, float *src2, int n_samples)
-{
-	int i;
-	for (i = 0; i < n_samples; i++)
-		dst[i] = src1[i] + src2[i];
-}
-
 SPA_EXPORT
 void jack_get_version(int *major_ptr, int *minor_ptr, int *micro_ptr, int *proto_ptr)
 {
@@ -780,30 +995,52 @@ static void convert_from_midi(void *midi, void *buffer, size_t size)
         spa_pod_builder_pop(&b, &f);
 }
 
+static inline bool control_less(struct spa_pod_control **c, uint32_t a, uint32_t b)
+{
+	/* on equal offsets, keep the order of the sequences */
+	return c[a]->offset < c[b]->offset ||
+		(c[a]->offset == c[b]->offset && a < b);
+}
+
+static inline void control_heap_down(uint32_t *heap, uint32_t n_heap,
+		struct spa_pod_control **c, uint32_t i)
+{
+	while (true) {
+		uint32_t l = 2 * i + 1, r = l + 1, min = i, t;
+
+		if (l < n_heap && control_less(c, heap[l], heap[min]))
+			min = l;
+		if (r < n_heap && control_less(c, heap[r], heap[min]))
+			min = r;
+		if (min == i)
+			break;
+		t = heap[i];
+		heap[i] = heap[min];
+		heap[min] = t;
+		i = min;
+	}
+}
+
 static void convert_to_midi(struct spa_pod_sequence **seq, uint32_t n_seq, void *midi)
 {
 	struct spa_pod_control *c[n_seq];
-	uint32_t i;
+	uint32_t heap[n_seq], n_heap = 0, i;
 
-	for (i = 0; i < n_seq; i++)
+	/* k-way merge of the sequences with a min-heap on the offset */
+	for (i = 0; i < n_seq; i++) {
 		c[i] = spa_pod_control_first(&seq[i]->body);
+		if (spa_pod_control_is_inside(&seq[i]->body,
+					SPA_POD_BODY_SIZE(seq[i]), c[i]))
+			heap[n_heap++] = i;
+	}
+	for (i = n_heap / 2; i-- > 0;)
+		control_heap_down(heap, n_heap, c, i);
 
-	while (true) {
-		struct spa_pod_control *next = NULL;
-		uint32_t next_index = 0;
-
-		for (i = 0; i < n_seq; i++) {
-			if (!spa_pod_control_is_inside(&seq[i]->body,
-						SPA_POD_BODY_SIZE(seq[i]), c[i]))
-				continue;
+	while (n_heap > 0) {
+		struct spa_pod_control *next;
 
-			if (next == NULL || c[i]->offset < next->offset) {
-				next = c[i];
-				next_index = i;
-			}
-		}
-		if (SPA_UNLIKELY(next == NULL))
-			break;
+		i = heap[0];
+		next = c[i];
 
 		switch(next->type) {
 		case SPA_CONTROL_Midi:
@@ -813,8 +1050,76 @@ static void convert_to_midi(struct spa_pod_sequence **seq, uint32_t n_seq, void
 					SPA_POD_BODY_SIZE(&next->value));
 			break;
 		}
-		c[next_index] = spa_pod_control_next(c[next_index]);
+		c[i] = spa_pod_control_next(next);
+		if (!spa_pod_control_is_inside(&seq[i]->body,
+					SPA_POD_BODY_SIZE(seq[i]), c[i]))
+			heap[0] = heap[--n_heap];
+		control_heap_down(heap, n_heap, c, 0);
+	}
+}
+
+/* Make the midi buffer read the events directly from the sequence. This
+ * only works when the events in the sequence are all valid jack events,
+ * otherwise they need to be copied with convert_to_midi(). */
+static bool attach_midi_sequence(struct midi_buffer *mb, struct spa_pod_sequence *seq)
+{
+	struct spa_pod_control *c;
+	uint32_t count = 0, last = 0;
+
+	SPA_POD_SEQUENCE_FOREACH(seq, c) {
+		if (c->type != SPA_CONTROL_Midi)
+			continue;
+		if (c->offset >= mb->nframes || c->offset < last ||
+		    SPA_POD_BODY_SIZE(&c->value) == 0)
+			return false;
+		last = c->offset;
+		count++;
+	}
+	mb->seq = seq;
+	mb->seq_control = NULL;
+	mb->seq_index = 0;
+	mb->event_count = count;
+	return true;
+}
+
+static int get_midi_sequence_event(struct midi_buffer *mb,
+		jack_midi_event_t *event, uint32_t event_index)
+{
+	struct spa_pod_sequence *seq = mb->seq;
+	struct spa_pod_control *c = mb->seq_control;
+
+	/* events are usually read in order, continue from the last one */
+	if (c == NULL || event_index < mb->seq_index) {
+		c = spa_pod_control_first(&seq->body);
+		mb->seq_index = 0;
+	}
+	for (; spa_pod_control_is_inside(&seq->body, SPA_POD_BODY_SIZE(seq), c);
+	     c = spa_pod_control_next(c)) {
+		if (c->type != SPA_CONTROL_Midi)
+			continue;
+		if (mb->seq_index == event_index) {
+			mb->seq_control = c;
+			event->time = c->offset;
+			event->size = SPA_POD_BODY_SIZE(&c->value);
+			event->buffer = SPA_POD_BODY(&c->value);
+			return 0;
+		}
+		mb->seq_index++;
 	}
+	mb->seq_control = NULL;
+	return -ENOBUFS;
+}
+
+/* copy the events of an attached sequence into the midi buffer so that
+ * it can be modified */
+static void detach_midi_sequence(struct midi_buffer *mb)
+{
+	struct spa_pod_sequence *seq = mb->seq;
+
+	mb->seq = NULL;
+	mb->event_count = 0;
+	mb->write_pos = 0;
+	convert_to_midi(&seq, 1, mb);
 }
 
 
@@ -1676,6 +1981,7 @@ static inline void *init_buffer(struct port *p)
 		mb->write_pos = 0;
 		mb->event_count = 0;
 		mb->lost_events = 0;
+		mb->seq = NULL;
 		pw_log_debug("port %p: init midi buffer size:%d", p, mb->buffer_size);
 	} else
 		memset(data, 0, MAX_BUFFER_FRAMES * sizeof(float));
@@ -2036,10 +2342,13 @@ static int metadata_property(void *object, uint32_t id,
 
 	if (id == PW_ID_CORE) {
 		uint32_t val = (key && value) ? (uint32_t)atoi(value) : SPA_ID_INVALID;
+		pthread_mutex_lock(&c->context.lock);
 		if (key == NULL || strcmp(key, "default.audio.sink") == 0)
 			c->metadata->default_audio_sink = val;
 		if (key == NULL || strcmp(key, "default.audio.source") == 0)
 			c->metadata->default_audio_source = val;
+		c->context.sorted_dirty = true;
+		pthread_mutex_unlock(&c->context.lock);
 	} else {
 		pthread_mutex_lock(&c->context.lock);
 		o = pw_map_lookup(&c->context.globals, id);
@@ -2119,8 +2428,11 @@ static void registry_event_global(void *data, uint32_t id,
 
 		pw_log_debug(NAME" %p: add node %d", c, id);
 
+		o->type = object_type;
+		o->id = id;
 		pthread_mutex_lock(&c->context.lock);
 		spa_list_append(&c->context.nodes, &o->link);
+		object_hash_add(c, o);
 		pthread_mutex_unlock(&c->context.lock);
 	}
 	else if (strcmp(type, PW_TYPE_INTERFACE_Port) == 0) {
@@ -2176,7 +2488,11 @@ static void registry_event_global(void *data, uint32_t id,
 			if (o != NULL)
 				pw_log_debug(NAME" %p: %s found our port %p", c, full_name, o);
 		}
-		if (o == NULL) {
+		if (o != NULL) {
+			pthread_mutex_lock(&c->context.lock);
+			object_hash_remove(c, o);
+			pthread_mutex_unlock(&c->context.lock);
+		} else {
 			o = alloc_object(c);
 			if (o == NULL)
 				goto exit;
@@ -2214,6 +2530,12 @@ static void registry_event_global(void *data, uint32_t id,
 			snprintf(o->port.name, sizeof(o->port.name), "%.*s-%d",
 					(int)(sizeof(op->port.name)-11), op->port.name, id);
 
+		o->type = object_type;
+		o->id = id;
+		pthread_mutex_lock(&c->context.lock);
+		object_hash_add(c, o);
+		pthread_mutex_unlock(&c->context.lock);
+
 		pw_log_debug(NAME" %p: add port %d name:%s %d", c, id,
 				o->port.name, type_id);
 	}
@@ -2233,6 +2555,12 @@ static void registry_event_global(void *data, uint32_t id,
 			goto exit_free;
 		o->port_link.dst = pw_properties_parse_int(str);
 
+		o->type = object_type;
+		o->id = id;
+		pthread_mutex_lock(&c->context.lock);
+		object_hash_add(c, o);
+		pthread_mutex_unlock(&c->context.lock);
+
 		pw_log_debug(NAME" %p: add link %d %d->%d", c, id,
 				o->port_link.src, o->port_link.dst);
 	}
@@ -2250,6 +2578,10 @@ static void registry_event_global(void *data, uint32_t id,
 		c->metadata->default_audio_sink = SPA_ID_INVALID;
 		c->metadata->default_audio_source = SPA_ID_INVALID;
 
+		pthread_mutex_lock(&c->context.lock);
+		c->context.sorted_dirty = true;
+		pthread_mutex_unlock(&c->context.lock);
+
 		pw_metadata_add_listener(proxy,
 				&c->metadata->listener,
 				&metadata_events, c);
@@ -2304,10 +2636,16 @@ static void registry_event_global_remove(void *object, uint32_t id)
 	pw_log_debug(NAME" %p: removed: %u", c, id);
 
 	if (c->metadata) {
-		if (id == c->metadata->default_audio_sink)
+		pthread_mutex_lock(&c->context.lock);
+		if (id == c->metadata->default_audio_sink) {
 			c->metadata->default_audio_sink = SPA_ID_INVALID;
-		if (id == c->metadata->default_audio_source)
+			c->context.sorted_dirty = true;
+		}
+		if (id == c->metadata->default_audio_source) {
 			c->metadata->default_audio_source = SPA_ID_INVALID;
+			c->context.sorted_dirty = true;
+		}
+		pthread_mutex_unlock(&c->context.lock);
 	}
 
 	pthread_mutex_lock(&c->context.lock);
@@ -2415,18 +2753,16 @@ jack_client_t * jack_client_open (const char *client_name,
 	spa_list_init(&client->context.nodes);
 	spa_list_init(&client->context.ports);
 	spa_list_init(&client->context.links);
+	init_object_hash(client);
+	pw_array_init(&client->context.sorted_ports, 64 * sizeof(struct object *));
 
 	support = pw_context_get_support(client->context.context, &n_support);
 
-	mix2 = mix2_c;
 	cpu_iface = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
-	if (cpu_iface) {
-#if defined (__SSE__)
-		uint32_t flags = spa_cpu_get_flags(cpu_iface);
-		if (flags & SPA_CPU_FLAG_SSE)
-			mix2 = mix2_sse;
-#endif
-	}
+	mix_ops.fmt = SPA_AUDIO_FORMAT_F32;
+	mix_ops.n_channels = 1;
+	mix_ops.cpu_flags = cpu_iface ? spa_cpu_get_flags(cpu_iface) : 0;
+	mix_ops_init(&mix_ops);
 
 	props = SPA_DICT_INIT(items, 0);
 	items[props.n_items++] = SPA_DICT_ITEM_INIT("loop.cancel", "true");
@@ -2599,6 +2935,8 @@ int jack_client_close (jack_client_t *client)
 	pw_thread_loop_destroy(c->context.loop);
 
 	pw_log_debug(NAME" %p: free", client);
+	clear_regex_cache(c);
+	pw_array_clear(&c->context.sorted_ports);
 	pthread_mutex_destroy(&c->context.lock);
 	pw_data_loop_destroy(c->loop);
 	pw_properties_free(c->props);
@@ -3237,6 +3575,10 @@ jack_port_t * jack_port_register (jack_client_t *client,
 	snprintf(o->port.name, sizeof(o->port.name), "%s:%s", c->name, port_name);
 	o->port.type_id = type_id;
 
+	pthread_mutex_lock(&c->context.lock);
+	object_hash_add(c, o);
+	pthread_mutex_unlock(&c->context.lock);
+
 	init_buffer(p);
 
 	if (direction == SPA_DIRECTION_INPUT) {
@@ -3353,8 +3695,9 @@ static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 	struct mix *mix;
 	struct buffer *b;
 	struct spa_io_buffers *io;
-	int layer = 0;
-	void *ptr = NULL;
+	const void **src = p->client->rt.mix_src;
+	uint32_t n_src = 0;
+	void *ptr;
 
 	spa_list_for_each(mix, &p->mix, port_link) {
 		pw_log_trace_fp(NAME" %p: port %p mix %d.%d get buffer %d",
@@ -3367,16 +3710,20 @@ static void *get_buffer_input_float(struct port *p, jack_nframes_t frames)
 
 		io->status = SPA_STATUS_NEED_DATA;
 		b = &mix->buffers[io->buffer_id];
-		if (layer++ == 0)
-			ptr = b->datas[0].data;
-		else  {
-			mix2(p->emptyptr, ptr, b->datas[0].data, frames);
-			ptr = p->emptyptr;
-			p->zeroed = false;
-		}
+		if (SPA_UNLIKELY(n_src == CONNECTION_NUM_FOR_PORT))
+			break;
+		src[n_src++] = b->datas[0].data;
 	}
-	if (ptr == NULL)
+	if (n_src == 0) {
 		ptr = init_buffer(p);
+	} else if (n_src == 1) {
+		ptr = (void*)src[0];
+	} else {
+		/* sum all inputs in one pass */
+		ptr = p->emptyptr;
+		mix_ops_process(&mix_ops, ptr, src, n_src, frames);
+		p->zeroed = false;
+	}
 	return ptr;
 }
 
@@ -3413,6 +3760,9 @@ static void *get_buffer_input_midi(struct port *p, jack_nframes_t frames)
 
 		seq[n_seq++] = pod;
 	}
+	if (n_seq == 1 && attach_midi_sequence(ptr, seq[0]))
+		return ptr;
+
 	convert_to_midi(seq, n_seq, ptr);
 
 	return ptr;
@@ -3704,17 +4054,25 @@ int jack_port_set_alias (jack_port_t *port, const char *alias)
 	c = o->client;
 
 	pw_thread_loop_lock(c->context.loop);
+	pthread_mutex_lock(&c->context.lock);
 
 	if (o->port.alias1[0] == '\0') {
 		key = PW_KEY_OBJECT_PATH;
+		object_hash_remove(c, o);
 		snprintf(o->port.alias1, sizeof(o->port.alias1), "%s", alias);
+		object_hash_add(c, o);
 	}
 	else if (o->port.alias2[0] == '\0') {
 		key = PW_KEY_PORT_ALIAS;
+		object_hash_remove(c, o);
 		snprintf(o->port.alias2, sizeof(o->port.alias2), "%s", alias);
+		object_hash_add(c, o);
 	}
-	else
+	else {
+		pthread_mutex_unlock(&c->context.lock);
 		goto error;
+	}
+	pthread_mutex_unlock(&c->context.lock);
 
 	p = GET_PORT(c, GET_DIRECTION(o->port.flags), o->port.port_id);
 
@@ -4164,48 +4522,6 @@ int jack_recompute_total_latency (jack_client_t *client, jack_port_t* port)
 	return 0;
 }
 
-static int port_compare_func(const void *v1, const void *v2)
-{
-	const struct object *const*o1 = v1, *const*o2 = v2;
-	struct client *c = (*o1)->client;
-	int res;
-	bool is_cap1, is_cap2, is_def1 = false, is_def2 = false;
-
-	is_cap1 = ((*o1)->port.flags & JackPortIsOutput) == JackPortIsOutput &&
-		!(*o1)->port.is_monitor;
-	is_cap2 = ((*o2)->port.flags & JackPortIsOutput) == JackPortIsOutput &&
-		!(*o2)->port.is_monitor;
-
-	if (c->metadata) {
-		if (is_cap1)
-			is_def1 = (*o1)->port.node_id == c->metadata->default_audio_source;
-		else if (!is_cap1)
-			is_def1 = (*o1)->port.node_id == c->metadata->default_audio_sink;
-
-		if (is_cap2)
-			is_def2 = (*o2)->port.node_id == c->metadata->default_audio_source;
-		else if (!is_cap2)
-			is_def2 = (*o2)->port.node_id == c->metadata->default_audio_sink;
-	}
-	if ((*o1)->port.type_id != (*o2)->port.type_id)
-		res = (*o1)->port.type_id - (*o2)->port.type_id;
-	else if ((is_cap1 || is_cap2) && is_cap1 != is_cap2)
-		res = is_cap2 - is_cap1;
-	else if ((is_def1 || is_def2) && is_def1 != is_def2)
-		res = is_def2 - is_def1;
-	else if ((*o1)->port.priority != (*o2)->port.priority)
-		res = (*o2)->port.priority - (*o1)->port.priority;
-	else if ((res = strcmp((*o1)->port.alias1, (*o2)->port.alias1) == 0))
-		res = (*o1)->id - (*o2)->id;
-
-	pw_log_debug("port type:%d<->%d def:%d<->%d prio:%d<->%d id:%d<->%d res:%d",
-			(*o1)->port.type_id, (*o2)->port.type_id,
-			is_def1, is_def2,
-			(*o1)->port.priority, (*o2)->port.priority,
-			(*o1)->id, (*o2)->id, res);
-	return res;
-}
-
 SPA_EXPORT
 const char ** jack_get_ports (jack_client_t *client,
                               const char *port_name_pattern,
@@ -4213,12 +4529,11 @@ const char ** jack_get_ports (jack_client_t *client,
                               unsigned long flags)
 {
 	struct client *c = (struct client *) client;
-	const char **res;
-	struct object *o;
-	struct object *tmp[JACK_PORT_MAX];
+	const char **res = NULL;
+	struct object **p, *o;
 	const char *str;
-	uint32_t i, count, id;
-	regex_t port_regex, type_regex;
+	uint32_t count, id;
+	regex_t *port_regex = NULL, *type_regex = NULL;
 
 	spa_return_val_if_fail(c != NULL, NULL);
 
@@ -4227,22 +4542,29 @@ const char ** jack_get_ports (jack_client_t *client,
 	else
 		id = SPA_ID_INVALID;
 
-	if (port_name_pattern && port_name_pattern[0])
-		regcomp(&port_regex, port_name_pattern, REG_EXTENDED | REG_NOSUB);
-	if (type_name_pattern && type_name_pattern[0])
-		regcomp(&type_regex, type_name_pattern, REG_EXTENDED | REG_NOSUB);
-
-
 	pw_log_debug(NAME" %p: ports id:%d name:%s type:%s flags:%08lx", c, id,
 			port_name_pattern, type_name_pattern, flags);
 
 	pthread_mutex_lock(&c->context.lock);
+	if (port_name_pattern && port_name_pattern[0] &&
+	    (port_regex = cached_regex(c, port_name_pattern)) == NULL)
+		goto exit;
+	if (type_name_pattern && type_name_pattern[0] &&
+	    (type_regex = cached_regex(c, type_name_pattern)) == NULL)
+		goto exit;
+
+	sorted_port_update(c);
+
+	res = malloc(sizeof(char*) *
+			(pw_array_get_len(&c->context.sorted_ports, struct object *) + 1));
+	if (res == NULL)
+		goto exit;
+
 	count = 0;
-	spa_list_for_each(o, &c->context.ports, link) {
+	pw_array_for_each(p, &c->context.sorted_ports) {
+		o = *p;
 		pw_log_debug(NAME" %p: check port type:%d flags:%08lx name:%s", c,
 				o->port.type_id, o->port.flags, o->port.name);
-		if (count == JACK_PORT_MAX)
-			break;
 		if (o->port.type_id > TYPE_ID_VIDEO)
 			continue;
 		if (!SPA_FLAG_IS_SET(o->port.flags, flags))
@@ -4250,37 +4572,26 @@ const char ** jack_get_ports (jack_client_t *client,
 		if (id != SPA_ID_INVALID && o->port.node_id != id)
 			continue;
 
-		if (port_name_pattern && port_name_pattern[0]) {
-			if (regexec(&port_regex, o->port.name, 0, NULL, 0) == REG_NOMATCH)
-				continue;
-		}
-		if (type_name_pattern && type_name_pattern[0]) {
-			if (regexec(&type_regex, type_to_string(o->port.type_id),
-						0, NULL, 0) == REG_NOMATCH)
-				continue;
-		}
+		if (port_regex &&
+		    regexec(port_regex, o->port.name, 0, NULL, 0) == REG_NOMATCH)
+			continue;
+		if (type_regex &&
+		    regexec(type_regex, type_to_string(o->port.type_id),
+				0, NULL, 0) == REG_NOMATCH)
+			continue;
 
 		pw_log_debug(NAME" %p: port %s prio:%d matches (%d)",
 				c, o->port.name, o->port.priority, count);
-		tmp[count++] = o;
+		res[count++] = o->port.name;
 	}
-	pthread_mutex_unlock(&c->context.lock);
+	res[count] = NULL;
 
-	if (count > 0) {
-		qsort(tmp, count, sizeof(struct object *), port_compare_func);
-
-		res = malloc(sizeof(char*) * (count + 1));
-		for (i = 0; i < count; i++)
-			res[i] = tmp[i]->port.name;
-		res[count] = NULL;
-	} else {
+	if (count == 0) {
+		free(res);
 		res = NULL;
 	}
-
-	if (port_name_pattern && port_name_pattern[0])
-		regfree(&port_regex);
-	if (type_name_pattern && type_name_pattern[0])
-		regfree(&type_regex);
+exit:
+	pthread_mutex_unlock(&c->context.lock);
 
 	return res;
 }
@@ -4858,6 +5169,8 @@ int jack_midi_event_get(jack_midi_event_t *event,
 	spa_return_val_if_fail(ev != NULL, -EINVAL);
 	if (event_index >= mb->event_count)
 		return -ENOBUFS;
+	if (mb->seq != NULL)
+		return get_midi_sequence_event(mb, event, event_index);
 	ev += event_index;
 	event->time = ev->time;
 	event->size = ev->size;
@@ -4873,6 +5186,7 @@ void jack_midi_clear_buffer(void *port_buffer)
 	mb->event_count = 0;
 	mb->write_pos = 0;
 	mb->lost_events = 0;
+	mb->seq = NULL;
 }
 
 SPA_EXPORT
@@ -4889,6 +5203,9 @@ size_t jack_midi_max_event_size(void* port_buffer)
 
 	spa_return_val_if_fail(mb != NULL, 0);
 
+	if (SPA_UNLIKELY(mb->seq != NULL))
+		detach_midi_sequence(mb);
+
 	buffer_size = mb->buffer_size;
 
         /* (event_count + 1) below accounts for jack_midi_port_internal_event_t
@@ -4918,6 +5235,9 @@ jack_midi_data_t* jack_midi_event_reserve(void *port_buffer,
 
 	spa_return_val_if_fail(mb != NULL, NULL);
 
+	if (SPA_UNLIKELY(mb->seq != NULL))
+		detach_midi_sequence(mb);
+
 	buffer_size = mb->buffer_size;
 
 	if (SPA_UNLIKELY(time >= mb->nframes)) {
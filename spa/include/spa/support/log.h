@@ -172,6 +172,10 @@ static inline void spa_log_trace_fp (struct spa_log *l, const char *format, ...)
 								  *  stderr. */
 #define SPA_KEY_LOG_TIMESTAMP		"log.timestamp"		/**< log timestamps */
 #define SPA_KEY_LOG_LINE		"log.line"		/**< log file and line numbers */
+#define SPA_KEY_LOG_DEFERRED		"log.deferred"		/**< store messages in binary form and
+								  *  format them later in a separate
+								  *  thread. Makes it safe to log from
+								  *  realtime threads. */
 
 #ifdef __cplusplus
 }  /* extern "C" */
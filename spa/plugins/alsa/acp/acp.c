@@ -22,9 +22,12 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <limits.h>
+
 #include "acp.h"
 #include "alsa-mixer.h"
 #include "alsa-ucm.h"
+#include "probe-cache.h"
 
 int _acp_log_level = 1;
 acp_log_func _acp_log_func;
@@ -1324,13 +1327,39 @@ static const char *acp_dict_lookup(const struct acp_dict *dict, const char *key)
 	return NULL;
 }
 
+/* The profiles of a card that failed to probe are cached in a file, keyed
+ * by the card driver, name and components and the hash of the profile-set
+ * file */
+static int probe_cache_key(uint32_t index, const pa_alsa_profile_set *ps,
+		char *key, size_t key_size)
+{
+	snd_ctl_t *ctl;
+	snd_ctl_card_info_t *info;
+	char name[16];
+	int err;
+
+	snd_ctl_card_info_alloca(&info);
+
+	snprintf(name, sizeof(name), "hw:%d", index);
+	if ((err = snd_ctl_open(&ctl, name, 0)) < 0)
+		return err;
+	if ((err = snd_ctl_card_info(ctl, info)) >= 0)
+		snprintf(key, key_size, "%s|%s|%s|%08x",
+				snd_ctl_card_info_get_driver(info),
+				snd_ctl_card_info_get_longname(info),
+				snd_ctl_card_info_get_components(info),
+				ps->hash);
+	snd_ctl_close(ctl);
+	return err;
+}
+
 struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 {
 	pa_card *impl;
 	struct acp_card *card;
 	const char *s, *profile_set = NULL, *profile = NULL;
-	char device_id[16];
-	bool ignore_dB = false;
+	char device_id[16], cache_key[1024], cache_dir[PATH_MAX], cache_path[PATH_MAX];
+	bool ignore_dB = false, probe_cache = true;
 	uint32_t profile_index;
 	int res;
 
@@ -1367,6 +1396,8 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 			impl->auto_profile = (strcmp(s, "true") == 0 || atoi(s) == 1);
 		if ((s = acp_dict_lookup(props, "api.acp.auto-port")) != NULL)
 			impl->auto_port = (strcmp(s, "true") == 0 || atoi(s) == 1);
+		if ((s = acp_dict_lookup(props, "api.acp.probe-cache")) != NULL)
+			probe_cache = (strcmp(s, "true") == 0 || atoi(s) == 1);
 	}
 
 	impl->ucm.default_sample_spec.format = PA_SAMPLE_S16NE;
@@ -1408,12 +1439,31 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 
 	impl->profile_set->ignore_dB = ignore_dB;
 
+	/* UCM has its own configuration for the card, only cache the
+	 * results of the profile-set files */
+	if (probe_cache && !impl->use_ucm &&
+	    probe_cache_key(index, impl->profile_set, cache_key, sizeof(cache_key)) >= 0 &&
+	    pa_alsa_probe_cache_path(cache_key, cache_dir, sizeof(cache_dir),
+		    cache_path, sizeof(cache_path)) >= 0) {
+		impl->profile_set->probe_cache = pa_alsa_probe_cache_load(cache_path, cache_key);
+		if (impl->profile_set->probe_cache == NULL) {
+			impl->profile_set->probe_cache = pa_alsa_probe_cache_new();
+			impl->profile_set->probe_cache_changed = true;
+		}
+	} else {
+		probe_cache = false;
+	}
+
 	pa_alsa_profile_set_probe(impl->profile_set, impl->ucm.mixers,
 			device_id,
 			&impl->ucm.default_sample_spec,
 			impl->ucm.default_n_fragments,
 			impl->ucm.default_fragment_size_msec);
 
+	if (probe_cache && impl->profile_set->probe_cache_changed)
+		pa_alsa_probe_cache_save(impl->profile_set->probe_cache,
+				cache_dir, cache_path, cache_key);
+
 	pa_alsa_init_proplist_card(NULL, impl->proplist, impl->card.index);
 	pa_proplist_sets(impl->proplist, PA_PROP_DEVICE_STRING, device_id);
 	pa_alsa_init_description(impl->proplist, NULL);
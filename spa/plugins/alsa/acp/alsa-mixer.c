@@ -33,6 +33,7 @@
 #include "conf-parser.h"
 #include "alsa-mixer.h"
 #include "alsa-util.h"
+#include "probe-cache.h"
 
 #ifdef HAVE_VALGRIND_MEMCHECK_H
 /* These macros are workarounds for a bug in valgrind, which is not handling the
@@ -3899,6 +3900,9 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *ps) {
     if (ps->decibel_fixes)
         pa_hashmap_free(ps->decibel_fixes);
 
+    if (ps->probe_cache)
+        pa_hashmap_free(ps->probe_cache);
+
     pa_xfree(ps);
 }
 
@@ -4897,6 +4901,19 @@ static const char *get_default_profile_dir(void) {
     return PA_ALSA_PROFILE_SETS_DIR;
 }
 
+static uint32_t profile_set_file_hash(const char *fn) {
+    FILE *f;
+    uint32_t hash = 2166136261u;
+    int c;
+
+    if ((f = fopen(fn, "re")) == NULL)
+        return 0;
+    while ((c = getc(f)) != EOF)
+        hash = (hash ^ (uint8_t) c) * 16777619u;
+    fclose(f);
+    return hash;
+}
+
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus) {
     pa_alsa_profile_set *ps;
     pa_alsa_profile *p;
@@ -4954,6 +4971,7 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
 			    get_default_profile_dir());
     }
     r = pa_config_parse(fn, NULL, items, NULL, false, ps);
+    ps->hash = profile_set_file_hash(fn);
     pa_xfree(fn);
 
     if (r < 0)
@@ -5150,6 +5168,8 @@ void pa_alsa_profile_set_probe(
 
     for (pp = probe_order; *pp; pp++) {
         uint32_t idx;
+        int probe_error = 0;
+        void *cached;
         p = *pp;
 
         /* Skip if fallback and already found something */
@@ -5161,13 +5181,20 @@ void pa_alsa_profile_set_probe(
         /* Skip if this is already marked that it is supported (i.e. from the config file) */
         if (!p->supported) {
 
+            if (ps->probe_cache && (cached = pa_hashmap_get(ps->probe_cache, p->name))) {
+                pa_log_debug("Skipping profile %s - failed in probe cache: %s", p->name,
+                             pa_cstrerror(PA_PTR_TO_UINT(cached)));
+                continue;
+            }
+
             profile_finalize_probing(last, p);
             p->supported = true;
 
             if (p->output_mappings) {
                 PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
-                    if (pa_hashmap_get(broken_outputs, m) == m) {
+                    if ((cached = pa_hashmap_get(broken_outputs, m))) {
                         pa_log_debug("Skipping profile %s - will not be able to open output:%s", p->name, m->name);
+                        probe_error = PA_PTR_TO_UINT(cached);
                         p->supported = false;
                         break;
                     }
@@ -5176,8 +5203,9 @@ void pa_alsa_profile_set_probe(
 
             if (p->input_mappings && p->supported) {
                 PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
-                    if (pa_hashmap_get(broken_inputs, m) == m) {
+                    if ((cached = pa_hashmap_get(broken_inputs, m))) {
                         pa_log_debug("Skipping profile %s - will not be able to open input:%s", p->name, m->name);
+                        probe_error = PA_PTR_TO_UINT(cached);
                         p->supported = false;
                         break;
                     }
@@ -5199,11 +5227,12 @@ void pa_alsa_profile_set_probe(
                                                            SND_PCM_STREAM_PLAYBACK,
                                                            default_n_fragments,
                                                            default_fragment_size_msec))) {
+                        probe_error = errno ? errno : EIO;
                         p->supported = false;
                         if (pa_idxset_size(p->output_mappings) == 1 &&
                             ((!p->input_mappings) || pa_idxset_size(p->input_mappings) == 0)) {
                             pa_log_debug("Caching failure to open output:%s", m->name);
-                            pa_hashmap_put(broken_outputs, m, m);
+                            pa_hashmap_put(broken_outputs, m, PA_UINT_TO_PTR(probe_error));
                         }
                         break;
                     }
@@ -5223,11 +5252,12 @@ void pa_alsa_profile_set_probe(
                                                           SND_PCM_STREAM_CAPTURE,
                                                           default_n_fragments,
                                                           default_fragment_size_msec))) {
+                        probe_error = errno ? errno : EIO;
                         p->supported = false;
                         if (pa_idxset_size(p->input_mappings) == 1 &&
                             ((!p->output_mappings) || pa_idxset_size(p->output_mappings) == 0)) {
                             pa_log_debug("Caching failure to open input:%s", m->name);
-                            pa_hashmap_put(broken_inputs, m, m);
+                            pa_hashmap_put(broken_inputs, m, PA_UINT_TO_PTR(probe_error));
                         }
                         break;
                     }
@@ -5238,8 +5268,15 @@ void pa_alsa_profile_set_probe(
 
             last = p;
 
-            if (!p->supported)
+            if (!p->supported) {
+                /* a busy device or other transient error is probed
+                 * again next time */
+                if (ps->probe_cache && pa_alsa_probe_cache_is_hard_error(probe_error)) {
+                    pa_hashmap_put(ps->probe_cache, pa_xstrdup(p->name), PA_UINT_TO_PTR(probe_error));
+                    ps->probe_cache_changed = true;
+                }
                 continue;
+            }
         }
 
         pa_log_debug("Profile %s supported.", p->name);
@@ -413,9 +413,15 @@ struct pa_alsa_profile_set {
     pa_hashmap *input_paths;
     pa_hashmap *output_paths;
 
+    /* names of the profiles that failed to probe with an error that will
+     * not go away, mapped to the errno. These are not probed again */
+    pa_hashmap *probe_cache;
+    uint32_t hash; /* hash of the profile-set file */
+
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
+    bool probe_cache_changed:1;
 };
 
 void pa_alsa_mapping_dump(pa_alsa_mapping *m);
@@ -737,6 +737,7 @@ snd_pcm_t *pa_alsa_open_by_device_string(
             pa_log("Device %s has %u channels, but PulseAudio supports only %u channels. Unable to use the device.",
                    d, ss->channels, PA_CHANNELS_MAX);
             snd_pcm_close(pcm_handle);
+            err = -EINVAL;
             goto fail;
         }
 
@@ -753,6 +754,7 @@ snd_pcm_t *pa_alsa_open_by_device_string(
 
 fail:
     pa_xfree(d);
+    errno = -err;
 
     return NULL;
 }
@@ -773,6 +775,7 @@ snd_pcm_t *pa_alsa_open_by_template(
 
     snd_pcm_t *pcm_handle;
     char **i;
+    int err = ENOENT;
 
     for (i = template; *i; i++) {
         char *d;
@@ -796,8 +799,14 @@ snd_pcm_t *pa_alsa_open_by_template(
 
         if (pcm_handle)
             return pcm_handle;
+
+        /* a device that is missing or can't do the format is only
+         * reported when none of the others failed for another reason */
+        if (errno != 0 && (err == ENOENT || err == EINVAL))
+            err = errno;
     }
 
+    errno = err;
     return NULL;
 }
 
@@ -30,6 +30,7 @@ extern "C" {
 #endif
 
 #include "array.h"
+#include "hashtable.h"
 
 typedef unsigned (*pa_hash_func_t)(const void *p);
 typedef int (*pa_compare_func_t)(const void *a, const void *b);
@@ -37,10 +38,16 @@ typedef int (*pa_compare_func_t)(const void *a, const void *b);
 typedef struct pa_hashmap_item {
 	void *key;
 	void *value;
+	unsigned hash;
 } pa_hashmap_item;
 
+/* The items are kept in insertion order in the array, removed items leave
+ * a hole with a NULL key until the array is compacted. The table indexes
+ * the items by hash. */
 typedef struct pa_hashmap {
 	pa_array array;
+	pa_hashtable table;
+	unsigned n_items;
 	pa_hash_func_t hash_func;
 	pa_compare_func_t compare_func;
 	pa_free_cb_t key_free_func;
@@ -51,6 +58,7 @@ static inline pa_hashmap *pa_hashmap_new(pa_hash_func_t hash_func, pa_compare_fu
 {
         pa_hashmap *m = calloc(1, sizeof(pa_hashmap));
         pa_array_init(&m->array, 16);
+	pa_hashtable_init(&m->table);
 	m->hash_func = hash_func;
 	m->compare_func = compare_func;
 	return m;
@@ -79,35 +87,55 @@ static inline void pa_hashmap_remove_all(pa_hashmap *h)
 	pa_array_for_each(item, &h->array)
 		pa_hashmap_item_free(h, item);
 	pa_array_reset(&h->array);
+	pa_hashtable_reset(&h->table);
+	h->n_items = 0;
 }
 
 static inline void pa_hashmap_free(pa_hashmap *h)
 {
 	pa_hashmap_remove_all(h);
 	pa_array_clear(&h->array);
+	pa_hashtable_clear(&h->table);
 	free(h);
 }
 
-static inline pa_hashmap_item* pa_hashmap_find_free(pa_hashmap *h)
+/* remove the holes from the array and index the items again */
+static inline void pa_hashmap_compact(pa_hashmap *h)
 {
-	pa_hashmap_item *item;
+	pa_hashmap_item *item, *d = pa_array_first(&h->array);
+	uint32_t index = 0;
+
+	pa_hashtable_reset(&h->table);
 	pa_array_for_each(item, &h->array) {
 		if (item->key == NULL)
-			return item;
+			continue;
+		d[index] = *item;
+		pa_hashtable_add_slot(&h->table, item->hash, index);
+		index++;
 	}
-	return pa_array_add(&h->array, sizeof(*item));
+	h->array.size = index * sizeof(pa_hashmap_item);
 }
 
-static inline pa_hashmap_item* pa_hashmap_find(const pa_hashmap *h, const void *key)
+static inline pa_hashtable_slot* pa_hashmap_find_slot(const pa_hashmap *h, const void *key)
 {
-	pa_hashmap_item *item = NULL;
-	pa_array_for_each(item, &h->array) {
-		if (item->key != NULL && h->compare_func(item->key, key) == 0)
-			return item;
+	pa_hashtable_slot *s;
+	unsigned hash = h->hash_func(key);
+	pa_hashtable_for_each(s, &h->table, hash) {
+		pa_hashmap_item *item = pa_array_get_unchecked(&h->array, s->index - 1, pa_hashmap_item);
+		if (s->hash == hash && h->compare_func(item->key, key) == 0)
+			return s;
 	}
 	return NULL;
 }
 
+static inline pa_hashmap_item* pa_hashmap_find(const pa_hashmap *h, const void *key)
+{
+	pa_hashtable_slot *s = pa_hashmap_find_slot(h, key);
+	if (s == NULL)
+		return NULL;
+	return pa_array_get_unchecked(&h->array, s->index - 1, pa_hashmap_item);
+}
+
 static inline void* pa_hashmap_get(const pa_hashmap *h, const void *key)
 {
 	const pa_hashmap_item *item = pa_hashmap_find(h, key);
@@ -118,21 +146,43 @@ static inline void* pa_hashmap_get(const pa_hashmap *h, const void *key)
 
 static inline int pa_hashmap_put(pa_hashmap *h, void *key, void *value)
 {
-	pa_hashmap_item *item = pa_hashmap_find(h, key);
-	if (item != NULL)
+	pa_hashmap_item *item;
+	uint32_t index;
+
+	if (pa_hashmap_find_slot(h, key) != NULL)
 		return -1;
-	item = pa_hashmap_find_free(h);
+
+	/* the array would grow, reuse the space of the removed items first */
+	index = pa_array_get_len(&h->array, pa_hashmap_item);
+	if (index > h->n_items &&
+	    h->array.size + sizeof(pa_hashmap_item) > h->array.alloc) {
+		pa_hashmap_compact(h);
+		index = h->n_items;
+	}
+	if (pa_hashtable_ensure(&h->table, h->n_items + 1) < 0)
+		return -1;
+	if ((item = pa_array_add(&h->array, sizeof(*item))) == NULL)
+		return -1;
+
 	item->key = key;
 	item->value = value;
+	item->hash = h->hash_func(key);
+	pa_hashtable_add_slot(&h->table, item->hash, index);
+	h->n_items++;
 	return 0;
 }
 
 static inline void* pa_hashmap_remove(pa_hashmap *h, const void *key)
 {
-	pa_hashmap_item *item = pa_hashmap_find(h, key);
+	pa_hashtable_slot *s = pa_hashmap_find_slot(h, key);
+	pa_hashmap_item *item;
 	void *value;
-	if (item == NULL)
+	if (s == NULL)
 		return NULL;
+	item = pa_array_get_unchecked(&h->array, s->index - 1, pa_hashmap_item);
+	pa_hashtable_remove(&h->table, s);
+	h->n_items--;
+
 	value = item->value;
 	if (h->key_free_func)
 		h->key_free_func(item->key);
@@ -177,29 +227,22 @@ static inline void *pa_hashmap_iterate(const pa_hashmap *h, void **state, const
 
 static inline bool pa_hashmap_isempty(const pa_hashmap *h)
 {
-	pa_hashmap_item *item;
-	pa_array_for_each(item, &h->array)
-		if (item->key != NULL)
-			return false;
-	return true;
+	return h->n_items == 0;
 }
 
 static inline unsigned pa_hashmap_size(const pa_hashmap *h)
 {
-	unsigned count = 0;
-	pa_hashmap_item *item;
-	pa_array_for_each(item, &h->array)
-		if (item->key != NULL)
-			count++;
-	return count;
+	return h->n_items;
 }
 
 static inline void pa_hashmap_sort(pa_hashmap *h,
 		int (*compar)(const void *, const void *))
 {
+	pa_hashmap_compact(h);
         qsort((void*)h->array.data,
 			pa_array_get_len(&h->array, pa_hashmap_item),
 			sizeof(pa_hashmap_item), compar);
+	pa_hashmap_compact(h);
 }
 
 #define PA_HASHMAP_FOREACH(e, h, state) \
@@ -0,0 +1,165 @@
+/* ALSA Card Profile
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PA_HASHTABLE_H
+#define PA_HASHTABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Open addressing index for the items of a hashmap or idxset. The items
+ * themselves stay in an array, a slot stores the hash and the array index
+ * of an item. Linear probing is used and removed slots are filled by
+ * shifting the following slots back, so no tombstones are needed. */
+
+#define PA_HASHTABLE_MIN_SIZE	16u
+
+typedef struct pa_hashtable_slot {
+	unsigned hash;
+	uint32_t index;		/**< array index + 1, 0 for an empty slot */
+} pa_hashtable_slot;
+
+typedef struct pa_hashtable {
+	pa_hashtable_slot *slots;
+	uint32_t size;		/**< number of slots, a power of 2 */
+	uint32_t shift;		/**< 32 - log2(size) */
+	uint32_t n_used;
+} pa_hashtable;
+
+static inline void pa_hashtable_init(pa_hashtable *t)
+{
+	t->slots = NULL;
+	t->size = t->shift = t->n_used = 0;
+}
+
+static inline void pa_hashtable_clear(pa_hashtable *t)
+{
+	free(t->slots);
+	pa_hashtable_init(t);
+}
+
+static inline void pa_hashtable_reset(pa_hashtable *t)
+{
+	if (t->slots)
+		memset(t->slots, 0, t->size * sizeof(pa_hashtable_slot));
+	t->n_used = 0;
+}
+
+/* fibonacci hashing, the pointer hashes have their low bits cleared so
+ * take the high bits of the product */
+static inline pa_hashtable_slot *pa_hashtable_first(const pa_hashtable *t, unsigned hash)
+{
+	if (t->size == 0)
+		return NULL;
+	return &t->slots[((uint32_t)hash * 2654435769u) >> t->shift];
+}
+
+static inline pa_hashtable_slot *pa_hashtable_next(const pa_hashtable *t, pa_hashtable_slot *s)
+{
+	return &t->slots[(s - t->slots + 1) & (t->size - 1)];
+}
+
+/* iterate the occupied slots that can contain hash, the caller checks
+ * the hash and the item */
+#define pa_hashtable_for_each(s, t, hash)					\
+	for ((s) = pa_hashtable_first(t, hash);					\
+	     (s) != NULL && (s)->index != 0;					\
+	     (s) = pa_hashtable_next(t, s))
+
+static inline void pa_hashtable_add_slot(pa_hashtable *t, unsigned hash, uint32_t index)
+{
+	pa_hashtable_slot *s = pa_hashtable_first(t, hash);
+	while (s->index != 0)
+		s = pa_hashtable_next(t, s);
+	s->hash = hash;
+	s->index = index + 1;
+	t->n_used++;
+}
+
+/* make room for n_items while keeping the load factor under 1/2 */
+static inline int pa_hashtable_ensure(pa_hashtable *t, uint32_t n_items)
+{
+	pa_hashtable old = *t;
+	uint32_t i, size, shift;
+
+	if (n_items * 2 <= t->size)
+		return 0;
+
+	for (size = PA_HASHTABLE_MIN_SIZE, shift = 28; size < n_items * 2; size *= 2)
+		shift--;
+
+	if ((t->slots = calloc(size, sizeof(pa_hashtable_slot))) == NULL) {
+		*t = old;
+		return -errno;
+	}
+	t->size = size;
+	t->shift = shift;
+	t->n_used = 0;
+
+	for (i = 0; i < old.size; i++) {
+		if (old.slots[i].index != 0)
+			pa_hashtable_add_slot(t, old.slots[i].hash, old.slots[i].index - 1);
+	}
+	free(old.slots);
+	return 0;
+}
+
+static inline int pa_hashtable_add(pa_hashtable *t, unsigned hash, uint32_t index)
+{
+	int res;
+	if ((res = pa_hashtable_ensure(t, t->n_used + 1)) < 0)
+		return res;
+	pa_hashtable_add_slot(t, hash, index);
+	return 0;
+}
+
+static inline void pa_hashtable_remove(pa_hashtable *t, pa_hashtable_slot *s)
+{
+	uint32_t mask = t->size - 1, i, j, k;
+
+	i = s - t->slots;
+	for (j = (i + 1) & mask; t->slots[j].index != 0; j = (j + 1) & mask) {
+		k = ((uint32_t)t->slots[j].hash * 2654435769u) >> t->shift;
+		/* move the slot back when its ideal position is not in (i, j] */
+		if ((j > i && (k <= i || k > j)) ||
+		    (j < i && (k <= i && k > j))) {
+			t->slots[i] = t->slots[j];
+			i = j;
+		}
+	}
+	t->slots[i].index = 0;
+	t->n_used--;
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* PA_HASHTABLE_H */
@@ -30,6 +30,7 @@ extern "C" {
 #endif
 
 #include "array.h"
+#include "hashtable.h"
 
 #define PA_IDXSET_INVALID ((uint32_t) -1)
 
@@ -40,8 +41,12 @@ typedef struct pa_idxset_item {
 	void *ptr;
 } pa_idxset_item;
 
+/* The index of an item is its position in the array, the table finds the
+ * position of a pointer. */
 typedef struct pa_idxset {
 	pa_array array;
+	pa_hashtable table;
+	unsigned n_items;
 	pa_hash_func_t hash_func;
 	pa_compare_func_t compare_func;
 } pa_idxset;
@@ -74,6 +79,7 @@ static inline pa_idxset *pa_idxset_new(pa_hash_func_t hash_func, pa_compare_func
 {
         pa_idxset *s = calloc(1, sizeof(pa_idxset));
         pa_array_init(&s->array, 16);
+	pa_hashtable_init(&s->table);
 	s->hash_func = hash_func;
 	s->compare_func = compare_func;
 	return s;
@@ -87,13 +93,16 @@ static inline void pa_idxset_free(pa_idxset *s, pa_free_cb_t free_cb)
 			free_cb(item->ptr);
 	}
 	pa_array_clear(&s->array);
+	pa_hashtable_clear(&s->table);
 	free(s);
 }
 
 static inline pa_idxset_item* pa_idxset_find(const pa_idxset *s, const void *ptr)
 {
-	pa_idxset_item *item;
-	pa_array_for_each(item, &s->array) {
+	pa_hashtable_slot *sl;
+	unsigned hash = s->hash_func(ptr);
+	pa_hashtable_for_each(sl, &s->table, hash) {
+		pa_idxset_item *item = pa_array_get_unchecked(&s->array, sl->index - 1, pa_idxset_item);
 		if (item->ptr == ptr)
 			return item;
 	}
@@ -105,10 +114,14 @@ static inline int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx)
 	pa_idxset_item *item = pa_idxset_find(s, p);
 	int res = item ? -1 : 0;
 	if (item == NULL) {
-		item = pa_idxset_find(s, NULL);
-		if (item == NULL)
-			item = pa_array_add(&s->array, sizeof(*item));
+		uint32_t index = pa_array_get_len(&s->array, pa_idxset_item);
+		if (pa_hashtable_ensure(&s->table, s->n_items + 1) < 0)
+			return -1;
+		if ((item = pa_array_add(&s->array, sizeof(*item))) == NULL)
+			return -1;
+		pa_hashtable_add_slot(&s->table, s->hash_func(p), index);
 		item->ptr = p;
+		s->n_items++;
 	}
 	if (idx)
 		*idx = item - (pa_idxset_item*)s->array.data;
@@ -128,20 +141,11 @@ static inline pa_idxset *pa_idxset_copy(pa_idxset *s, pa_copy_func_t copy_func)
 
 static inline bool pa_idxset_isempty(const pa_idxset *s)
 {
-	pa_idxset_item *item;
-	pa_array_for_each(item, &s->array)
-		if (item->ptr != NULL)
-			return false;
-	return true;
+	return s->n_items == 0;
 }
 static inline unsigned pa_idxset_size(pa_idxset*s)
 {
-	unsigned count = 0;
-	pa_idxset_item *item;
-	pa_array_for_each(item, &s->array)
-		if (item->ptr != NULL)
-			count++;
-	return count;
+	return s->n_items;
 }
 
 static inline void *pa_idxset_search(pa_idxset *s, uint32_t *idx)
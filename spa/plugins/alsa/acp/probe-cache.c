@@ -0,0 +1,151 @@
+/* ALSA Card Profile
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "probe-cache.h"
+
+#define PROBE_CACHE_VERSION	2
+
+bool pa_alsa_probe_cache_is_hard_error(int err)
+{
+	/* the device or configuration does not exist or the hardware can't
+	 * do what the mapping asks. Other errors, like a busy device, can go
+	 * away and the profile is probed again next time */
+	return err == ENOENT || err == EINVAL;
+}
+
+pa_hashmap *pa_alsa_probe_cache_new(void)
+{
+	return pa_hashmap_new_full(pa_idxset_string_hash_func,
+			pa_idxset_string_compare_func, pa_xfree, NULL);
+}
+
+int pa_alsa_probe_cache_path(const char *key, char *dir, size_t dir_size,
+		char *path, size_t path_size)
+{
+	const char *home;
+	int len;
+
+	if ((home = getenv("XDG_CACHE_HOME")) != NULL)
+		snprintf(dir, dir_size, "%s/pipewire/acp", home);
+	else if ((home = getenv("HOME")) != NULL)
+		snprintf(dir, dir_size, "%s/.cache/pipewire/acp", home);
+	else
+		return -ENOENT;
+
+	len = snprintf(path, path_size, "%s/card-%08x", dir,
+			pa_idxset_string_hash_func(key));
+	if (len < 0 || (size_t)len >= path_size)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+/* the first line has the version and the key, then a line with the name
+ * and the errno for each failed profile */
+pa_hashmap *pa_alsa_probe_cache_load(const char *path, const char *key)
+{
+	FILE *f;
+	char line[1024], *name, *s;
+	pa_hashmap *cache = NULL;
+	int version, len, err;
+
+	if ((f = fopen(path, "re")) == NULL)
+		return NULL;
+
+	if (fgets(line, sizeof(line), f) == NULL ||
+	    sscanf(line, "%d %n", &version, &len) != 1 ||
+	    version != PROBE_CACHE_VERSION ||
+	    strcmp(pa_strip(line + len), key) != 0) {
+		pa_log_debug("probe cache %s does not match card", path);
+		goto done;
+	}
+	cache = pa_alsa_probe_cache_new();
+	while (fgets(line, sizeof(line), f) != NULL) {
+		name = pa_strip(line);
+		if ((s = strrchr(name, ' ')) == NULL)
+			continue;
+		*s++ = '\0';
+		/* only keep the errors we would have cached ourselves */
+		if (*name == '\0' || pa_atoi(s, &err) < 0 ||
+		    !pa_alsa_probe_cache_is_hard_error(err))
+			continue;
+		pa_hashmap_put(cache, pa_xstrdup(name), PA_UINT_TO_PTR(err));
+	}
+	pa_log_info("using probe cache %s with %u failed profiles", path,
+			pa_hashmap_size(cache));
+done:
+	fclose(f);
+	return cache;
+}
+
+int pa_alsa_probe_cache_save(pa_hashmap *cache, const char *dir,
+		const char *path, const char *key)
+{
+	FILE *f;
+	char tmp[PATH_MAX], *p;
+	const char *name;
+	void *err, *state;
+	int res;
+
+	/* make the cache dir and its parents */
+	snprintf(tmp, sizeof(tmp), "%s", dir);
+	for (p = tmp + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(tmp, 0700) < 0 && errno != EEXIST)
+			goto error_dir;
+		*p = '/';
+	}
+	if (mkdir(tmp, 0700) < 0 && errno != EEXIST)
+		goto error_dir;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+		return -ENAMETOOLONG;
+	if ((f = fopen(tmp, "we")) == NULL) {
+		res = -errno;
+		pa_log_debug("can't write probe cache %s: %m", tmp);
+		return res;
+	}
+	fprintf(f, "%d %s\n", PROBE_CACHE_VERSION, key);
+	PA_HASHMAP_FOREACH_KV(name, err, cache, state)
+		fprintf(f, "%s %u\n", name, PA_PTR_TO_UINT(err));
+	if (fclose(f) != 0 || rename(tmp, path) < 0) {
+		res = -errno;
+		pa_log_debug("can't save probe cache %s: %m", path);
+		unlink(tmp);
+		return res;
+	}
+	return 0;
+
+error_dir:
+	res = -errno;
+	pa_log_debug("can't create %s: %m", tmp);
+	return res;
+}
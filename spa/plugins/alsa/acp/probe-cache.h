@@ -0,0 +1,55 @@
+/* ALSA Card Profile
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PA_ALSA_PROBE_CACHE_H
+#define PA_ALSA_PROBE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "compat.h"
+
+/* The probe cache keeps the profiles of a card that failed to probe with an
+ * error that will not go away, mapped to the errno of the failure. Those
+ * profiles are not probed again while the cache key matches. */
+
+bool pa_alsa_probe_cache_is_hard_error(int err);
+
+pa_hashmap *pa_alsa_probe_cache_new(void);
+
+int pa_alsa_probe_cache_path(const char *key, char *dir, size_t dir_size,
+		char *path, size_t path_size);
+
+pa_hashmap *pa_alsa_probe_cache_load(const char *path, const char *key);
+
+int pa_alsa_probe_cache_save(pa_hashmap *cache, const char *dir,
+		const char *path, const char *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PA_ALSA_PROBE_CACHE_H */
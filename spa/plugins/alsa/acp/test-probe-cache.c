@@ -0,0 +1,125 @@
+/* ALSA Card Profile
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <spa/utils/defs.h>
+
+#include "probe-cache.h"
+
+int _acp_log_level = 1;
+acp_log_func _acp_log_func;
+void *_acp_log_data;
+
+#define KEY	"driver|Long Name|components|01234567"
+
+static void test_round_trip(const char *dir)
+{
+	char path[PATH_MAX];
+	pa_hashmap *cache, *loaded;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/card", dir);
+
+	cache = pa_alsa_probe_cache_new();
+	pa_hashmap_put(cache, pa_xstrdup("output:hdmi-stereo"), PA_UINT_TO_PTR(ENOENT));
+	pa_hashmap_put(cache, pa_xstrdup("output:analog-surround-71+input:analog-stereo"),
+			PA_UINT_TO_PTR(EINVAL));
+	spa_assert(pa_alsa_probe_cache_save(cache, dir, path, KEY) == 0);
+
+	loaded = pa_alsa_probe_cache_load(path, KEY);
+	spa_assert(loaded != NULL);
+	spa_assert(pa_hashmap_size(loaded) == 2);
+	spa_assert(PA_PTR_TO_UINT(pa_hashmap_get(loaded, "output:hdmi-stereo")) == ENOENT);
+	spa_assert(PA_PTR_TO_UINT(pa_hashmap_get(loaded,
+			"output:analog-surround-71+input:analog-stereo")) == EINVAL);
+	pa_hashmap_free(loaded);
+
+	/* another card or profile-set */
+	spa_assert(pa_alsa_probe_cache_load(path, KEY "x") == NULL);
+	spa_assert(pa_alsa_probe_cache_load(path, "driver") == NULL);
+
+	/* an empty cache is valid */
+	pa_hashmap_remove_all(cache);
+	spa_assert(pa_alsa_probe_cache_save(cache, dir, path, KEY) == 0);
+	loaded = pa_alsa_probe_cache_load(path, KEY);
+	spa_assert(loaded != NULL);
+	spa_assert(pa_hashmap_size(loaded) == 0);
+	pa_hashmap_free(loaded);
+	pa_hashmap_free(cache);
+
+	/* transient errors and the cache of the older version are ignored */
+	f = fopen(path, "w");
+	spa_assert(f != NULL);
+	fprintf(f, "2 %s\noutput:hdmi-stereo %d\noutput:iec958-stereo %d\n"
+			"output:analog-stereo %d\n", KEY, EBUSY, EAGAIN, ENOENT);
+	fclose(f);
+	loaded = pa_alsa_probe_cache_load(path, KEY);
+	spa_assert(loaded != NULL);
+	spa_assert(pa_hashmap_size(loaded) == 1);
+	spa_assert(PA_PTR_TO_UINT(pa_hashmap_get(loaded, "output:analog-stereo")) == ENOENT);
+	pa_hashmap_free(loaded);
+
+	f = fopen(path, "w");
+	spa_assert(f != NULL);
+	fprintf(f, "%s\noutput:analog-stereo\n", KEY);
+	fclose(f);
+	spa_assert(pa_alsa_probe_cache_load(path, KEY) == NULL);
+
+	unlink(path);
+	spa_assert(pa_alsa_probe_cache_load(path, KEY) == NULL);
+}
+
+static void test_hard_error(void)
+{
+	spa_assert(pa_alsa_probe_cache_is_hard_error(ENOENT));
+	spa_assert(pa_alsa_probe_cache_is_hard_error(EINVAL));
+	spa_assert(!pa_alsa_probe_cache_is_hard_error(0));
+	spa_assert(!pa_alsa_probe_cache_is_hard_error(EBUSY));
+	spa_assert(!pa_alsa_probe_cache_is_hard_error(EAGAIN));
+	spa_assert(!pa_alsa_probe_cache_is_hard_error(EIO));
+}
+
+int main(int argc, char *argv[])
+{
+	char dir[] = "/tmp/test-probe-cache-XXXXXX";
+	char sub[PATH_MAX];
+
+	spa_assert(mkdtemp(dir) != NULL);
+	/* the cache dir and its parents are created */
+	snprintf(sub, sizeof(sub), "%s/pipewire/acp", dir);
+
+	test_hard_error();
+	test_round_trip(sub);
+
+	rmdir(sub);
+	snprintf(sub, sizeof(sub), "%s/pipewire", dir);
+	rmdir(sub);
+	spa_assert(rmdir(dir) == 0);
+
+	return 0;
+}
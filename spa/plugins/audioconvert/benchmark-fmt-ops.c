@@ -31,6 +31,9 @@
 #include <errno.h>
 #include <time.h>
 
+#include <spa/debug/types.h>
+#include <spa/param/audio/type-info.h>
+
 #include "test-helper.h"
 #include "fmt-ops.h"
 
@@ -58,7 +61,7 @@ static uint8_t samp_out[MAX_SAMPLES * MAX_CHANNELS * 4];
 static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
 static const int channel_counts[] = { 1, 2, 4, 6, 8, 11 };
 
-#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 70
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 300
 
 static uint32_t n_results = 0;
 static struct stats results[MAX_RESULTS];
@@ -73,7 +76,11 @@ static void run_test1(const char *name, const char *impl, bool in_packed, bool o
 	uint64_t count, t1, t2;
 	struct convert conv;
 
+	spa_zero(conv);
 	conv.n_channels = n_channels;
+	for (j = 0; j < n_channels; j++)
+		for (i = 0; i < (int)DITHER_LANES; i++)
+			conv.random[j][i] = j * DITHER_LANES + i + 1;
 
 	for (j = 0; j < n_channels; j++) {
 		ip[j] = &samp_in[j * n_samples * 4];
@@ -124,12 +131,22 @@ static void run_test(const char *name, const char *impl, bool in_packed, bool ou
 	}
 }
 
+#define run_test_n(name,func,arch,in_packed,out_packed)					\
+({											\
+	run_testc(name "_1", #arch, in_packed, out_packed, conv_##func##_1_##arch, 1);	\
+	run_testc(name "_2", #arch, in_packed, out_packed, conv_##func##_2_##arch, 2);	\
+	run_testc(name "_4", #arch, in_packed, out_packed, conv_##func##_4_##arch, 4);	\
+	run_testc(name "_8", #arch, in_packed, out_packed, conv_##func##_8_##arch, 8);	\
+})
+
 static void test_f32_u8(void)
 {
 	run_test("test_f32_u8", "c", true, true, conv_f32_to_u8_c);
 	run_test("test_f32d_u8", "c", false, true, conv_f32d_to_u8_c);
 	run_test("test_f32_u8d", "c", true, false, conv_f32_to_u8d_c);
 	run_test("test_f32d_u8d", "c", false, false, conv_f32d_to_u8d_c);
+	run_test_n("test_f32_u8d", f32_to_u8d, c, true, false);
+	run_test_n("test_f32d_u8", f32d_to_u8, c, false, true);
 }
 
 static void test_u8_f32(void)
@@ -138,6 +155,24 @@ static void test_u8_f32(void)
 	run_test("test_u8d_f32", "c", false, true, conv_u8d_to_f32_c);
 	run_test("test_u8_f32d", "c", true, false, conv_u8_to_f32d_c);
 	run_test("test_u8d_f32d", "c", false, false, conv_u8d_to_f32d_c);
+	run_test_n("test_u8_f32d", u8_to_f32d, c, true, false);
+	run_test_n("test_u8d_f32", u8d_to_f32, c, false, true);
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_u8_f32", "neon", true, true, conv_u8_to_f32_neon);
+		run_test("test_u8d_f32d", "neon", false, false, conv_u8d_to_f32d_neon);
+		run_test_n("test_u8_f32d", u8_to_f32d, neon, true, false);
+		run_test_n("test_u8d_f32", u8d_to_f32, neon, false, true);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_u8_f32", "avx2", true, true, conv_u8_to_f32_avx2);
+		run_test("test_u8d_f32d", "avx2", false, false, conv_u8d_to_f32d_avx2);
+		run_test_n("test_u8_f32d", u8_to_f32d, avx2, true, false);
+		run_test_n("test_u8d_f32", u8d_to_f32, avx2, false, true);
+	}
+#endif
 }
 
 static void test_f32_s16(void)
@@ -159,6 +194,8 @@ static void test_f32_s16(void)
 #endif
 	run_test("test_f32_s16d", "c", true, false, conv_f32_to_s16d_c);
 	run_test("test_f32d_s16d", "c", false, false, conv_f32d_to_s16d_c);
+	run_test_n("test_f32_s16d", f32_to_s16d, c, true, false);
+	run_test_n("test_f32d_s16", f32d_to_s16, c, false, true);
 }
 
 static void test_s16_f32(void)
@@ -179,6 +216,25 @@ static void test_s16_f32(void)
 	}
 #endif
 	run_test("test_s16d_f32d", "c", false, false, conv_s16d_to_f32d_c);
+	run_test_n("test_s16_f32d", s16_to_f32d, c, true, false);
+	run_test_n("test_s16d_f32", s16d_to_f32, c, false, true);
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_s16_f32", "neon", true, true, conv_s16_to_f32_neon);
+		run_test("test_s16d_f32d", "neon", false, false, conv_s16d_to_f32d_neon);
+		run_test_n("test_s16d_f32", s16d_to_f32, neon, false, true);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_s16_f32", "avx2", true, true, conv_s16_to_f32_avx2);
+		run_test("test_s16d_f32d", "avx2", false, false, conv_s16d_to_f32d_avx2);
+		run_testc("test_s16_f32d_1", "avx2", true, false, conv_s16_to_f32d_1_avx2, 1);
+		run_testc("test_s16_f32d_4", "avx2", true, false, conv_s16_to_f32d_4_avx2, 4);
+		run_testc("test_s16_f32d_8", "avx2", true, false, conv_s16_to_f32d_8_avx2, 8);
+		run_test_n("test_s16d_f32", s16d_to_f32, avx2, false, true);
+	}
+#endif
 }
 
 static void test_f32_s32(void)
@@ -197,6 +253,8 @@ static void test_f32_s32(void)
 #endif
 	run_test("test_f32_s32d", "c", true, false, conv_f32_to_s32d_c);
 	run_test("test_f32d_s32d", "c", false, false, conv_f32d_to_s32d_c);
+	run_test_n("test_f32_s32d", f32_to_s32d, c, true, false);
+	run_test_n("test_f32d_s32", f32d_to_s32, c, false, true);
 }
 
 static void test_s32_f32(void)
@@ -215,6 +273,23 @@ static void test_s32_f32(void)
 #endif
 	run_test("test_s32_f32d", "c", true, false, conv_s32_to_f32d_c);
 	run_test("test_s32d_f32d", "c", false, false, conv_s32d_to_f32d_c);
+	run_test_n("test_s32_f32d", s32_to_f32d, c, true, false);
+	run_test_n("test_s32d_f32", s32d_to_f32, c, false, true);
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_s32_f32", "neon", true, true, conv_s32_to_f32_neon);
+		run_test("test_s32d_f32d", "neon", false, false, conv_s32d_to_f32d_neon);
+		run_test_n("test_s32_f32d", s32_to_f32d, neon, true, false);
+		run_test_n("test_s32d_f32", s32d_to_f32, neon, false, true);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_s32_f32", "avx2", true, true, conv_s32_to_f32_avx2);
+		run_test("test_s32d_f32d", "avx2", false, false, conv_s32d_to_f32d_avx2);
+		run_test_n("test_s32d_f32", s32d_to_f32, avx2, false, true);
+	}
+#endif
 }
 
 static void test_f32_s24(void)
@@ -223,6 +298,8 @@ static void test_f32_s24(void)
 	run_test("test_f32d_s24", "c", false, true, conv_f32d_to_s24_c);
 	run_test("test_f32_s24d", "c", true, false, conv_f32_to_s24d_c);
 	run_test("test_f32d_s24d", "c", false, false, conv_f32d_to_s24d_c);
+	run_test_n("test_f32_s24d", f32_to_s24d, c, true, false);
+	run_test_n("test_f32d_s24", f32d_to_s24, c, false, true);
 }
 
 static void test_s24_f32(void)
@@ -251,6 +328,8 @@ static void test_s24_f32(void)
 	}
 #endif
 	run_test("test_s24d_f32d", "c", false, false, conv_s24d_to_f32d_c);
+	run_test_n("test_s24_f32d", s24_to_f32d, c, true, false);
+	run_test_n("test_s24d_f32", s24d_to_f32, c, false, true);
 }
 
 static void test_f32_s24_32(void)
@@ -259,6 +338,8 @@ static void test_f32_s24_32(void)
 	run_test("test_f32d_s24_32", "c", false, true, conv_f32d_to_s24_32_c);
 	run_test("test_f32_s24_32d", "c", true, false, conv_f32_to_s24_32d_c);
 	run_test("test_f32d_s24_32d", "c", false, false, conv_f32d_to_s24_32d_c);
+	run_test_n("test_f32_s24_32d", f32_to_s24_32d, c, true, false);
+	run_test_n("test_f32d_s24_32", f32d_to_s24_32, c, false, true);
 }
 
 static void test_s24_32_f32(void)
@@ -267,6 +348,62 @@ static void test_s24_32_f32(void)
 	run_test("test_s24_32d_f32", "c", false, true, conv_s24_32d_to_f32_c);
 	run_test("test_s24_32_f32d", "c", true, false, conv_s24_32_to_f32d_c);
 	run_test("test_s24_32d_f32d", "c", false, false, conv_s24_32d_to_f32d_c);
+	run_test_n("test_s24_32_f32d", s24_32_to_f32d, c, true, false);
+	run_test_n("test_s24_32d_f32", s24_32d_to_f32, c, false, true);
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test("test_s24_32_f32", "neon", true, true, conv_s24_32_to_f32_neon);
+		run_test("test_s24_32d_f32d", "neon", false, false, conv_s24_32d_to_f32d_neon);
+		run_test_n("test_s24_32_f32d", s24_32_to_f32d, neon, true, false);
+		run_test_n("test_s24_32d_f32", s24_32d_to_f32, neon, false, true);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_s24_32_f32", "avx2", true, true, conv_s24_32_to_f32_avx2);
+		run_test("test_s24_32d_f32d", "avx2", false, false, conv_s24_32d_to_f32d_avx2);
+		run_test_n("test_s24_32_f32d", s24_32_to_f32d, avx2, true, false);
+		run_test_n("test_s24_32d_f32", s24_32d_to_f32, avx2, false, true);
+	}
+#endif
+}
+
+static void test_f32_s24s(void)
+{
+	run_test("test_f32_s24s", "c", true, true, conv_f32_to_s24s_c);
+	run_test("test_f32d_s24s", "c", false, true, conv_f32d_to_s24s_c);
+	run_test_n("test_f32d_s24s", f32d_to_s24s, c, false, true);
+}
+
+static void test_s24s_f32(void)
+{
+	run_test("test_s24s_f32", "c", true, true, conv_s24s_to_f32_c);
+	run_test("test_s24s_f32d", "c", true, false, conv_s24s_to_f32d_c);
+	run_test_n("test_s24s_f32d", s24s_to_f32d, c, true, false);
+}
+
+static void test_dither(void)
+{
+	run_test("test_f32d_s16_tpdf", "c", false, true, conv_f32d_to_s16_tpdf_c);
+	run_test("test_f32d_s16d_tpdf", "c", false, false, conv_f32d_to_s16d_tpdf_c);
+	run_test("test_f32d_s24_tpdf", "c", false, true, conv_f32d_to_s24_tpdf_c);
+	run_test("test_f32d_s24_32_tpdf", "c", false, true, conv_f32d_to_s24_32_tpdf_c);
+	run_test("test_f32d_s16_shaped", "c", false, true, conv_f32d_to_s16_shaped_c);
+	run_test("test_f32d_s16d_shaped", "c", false, false, conv_f32d_to_s16d_shaped_c);
+	run_test("test_f32d_s24_shaped", "c", false, true, conv_f32d_to_s24_shaped_c);
+	run_test("test_f32d_s24_32_shaped", "c", false, true, conv_f32d_to_s24_32_shaped_c);
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test("test_f32d_s16_tpdf", "avx2", false, true, conv_f32d_to_s16_tpdf_avx2);
+		run_test("test_f32d_s16d_tpdf", "avx2", false, false, conv_f32d_to_s16d_tpdf_avx2);
+		run_test("test_f32d_s24_tpdf", "avx2", false, true, conv_f32d_to_s24_tpdf_avx2);
+		run_test("test_f32d_s24_32_tpdf", "avx2", false, true, conv_f32d_to_s24_32_tpdf_avx2);
+		run_test("test_f32d_s16_shaped", "avx2", false, true, conv_f32d_to_s16_shaped_avx2);
+		run_test("test_f32d_s16d_shaped", "avx2", false, false, conv_f32d_to_s16d_shaped_avx2);
+		run_test("test_f32d_s24_shaped", "avx2", false, true, conv_f32d_to_s24_shaped_avx2);
+		run_test("test_f32d_s24_32_shaped", "avx2", false, true, conv_f32d_to_s24_32_shaped_avx2);
+	}
+#endif
 }
 
 static void test_interleave(void)
@@ -275,6 +412,24 @@ static void test_interleave(void)
 	run_test("test_interleave_16", "c", false, true, conv_interleave_16_c);
 	run_test("test_interleave_24", "c", false, true, conv_interleave_24_c);
 	run_test("test_interleave_32", "c", false, true, conv_interleave_32_c);
+	run_test_n("test_interleave_8", interleave_8, c, false, true);
+	run_test_n("test_interleave_16", interleave_16, c, false, true);
+	run_test_n("test_interleave_24", interleave_24, c, false, true);
+	run_test_n("test_interleave_32", interleave_32, c, false, true);
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test_n("test_interleave_8", interleave_8, neon, false, true);
+		run_test_n("test_interleave_16", interleave_16, neon, false, true);
+		run_test_n("test_interleave_32", interleave_32, neon, false, true);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test_n("test_interleave_8", interleave_8, avx2, false, true);
+		run_test_n("test_interleave_16", interleave_16, avx2, false, true);
+		run_test_n("test_interleave_32", interleave_32, avx2, false, true);
+	}
+#endif
 }
 
 static void test_deinterleave(void)
@@ -283,6 +438,72 @@ static void test_deinterleave(void)
 	run_test("test_deinterleave_16", "c", true, false, conv_deinterleave_16_c);
 	run_test("test_deinterleave_24", "c", true, false, conv_deinterleave_24_c);
 	run_test("test_deinterleave_32", "c", true, false, conv_deinterleave_32_c);
+	run_test_n("test_deinterleave_8", deinterleave_8, c, true, false);
+	run_test_n("test_deinterleave_16", deinterleave_16, c, true, false);
+	run_test_n("test_deinterleave_24", deinterleave_24, c, true, false);
+	run_test_n("test_deinterleave_32", deinterleave_32, c, true, false);
+#if defined (HAVE_NEON)
+	if (cpu_flags & SPA_CPU_FLAG_NEON) {
+		run_test_n("test_deinterleave_8", deinterleave_8, neon, true, false);
+		run_test_n("test_deinterleave_16", deinterleave_16, neon, true, false);
+		run_test_n("test_deinterleave_32", deinterleave_32, neon, true, false);
+	}
+#endif
+#if defined (HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test_n("test_deinterleave_8", deinterleave_8, avx2, true, false);
+		run_test_n("test_deinterleave_16", deinterleave_16, avx2, true, false);
+		run_test_n("test_deinterleave_32", deinterleave_32, avx2, true, false);
+	}
+#endif
+}
+
+static const uint32_t formats[] = {
+	SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_U8P,
+	SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_S16P,
+	SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24P,
+	SPA_AUDIO_FORMAT_S24_OE,
+	SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P,
+	SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P,
+	SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P,
+};
+
+/* run the converter that convert_init() selects for every supported
+ * pair of formats and every channel count */
+static void test_all_pairs(void)
+{
+	static char names[SPA_N_ELEMENTS(formats) * SPA_N_ELEMENTS(formats)][64];
+	uint32_t n_names = 0;
+	size_t i, j, k, l;
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(formats); j++) {
+			char *name = names[n_names];
+
+			snprintf(name, sizeof(names[0]), "pair_%s_%s",
+				spa_debug_type_find_short_name(spa_type_audio_format, formats[i]),
+				spa_debug_type_find_short_name(spa_type_audio_format, formats[j]));
+
+			for (k = 0; k < SPA_N_ELEMENTS(channel_counts); k++) {
+				struct convert conv;
+				int n_channels = channel_counts[k];
+
+				spa_zero(conv);
+				conv.src_fmt = formats[i];
+				conv.dst_fmt = formats[j];
+				conv.n_channels = n_channels;
+				conv.cpu_flags = cpu_flags;
+				if (convert_init(&conv) < 0)
+					continue;
+
+				for (l = 0; l < SPA_N_ELEMENTS(sample_sizes); l++)
+					run_test1(name, "best", false, false, conv.process, n_channels,
+						(sample_sizes[l] + (n_channels -1)) / n_channels);
+				convert_free(&conv);
+			}
+			n_names++;
+		}
+	}
 }
 
 static int compare_func(const void *_a, const void *_b)
@@ -313,8 +534,12 @@ int main(int argc, char *argv[])
 	test_s24_f32();
 	test_f32_s24_32();
 	test_s24_32_f32();
+	test_f32_s24s();
+	test_s24s_f32();
+	test_dither();
 	test_interleave();
 	test_deinterleave();
+	test_all_pairs();
 
 	qsort(results, n_results, sizeof(struct stats), compare_func);
 
@@ -22,7 +22,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-#include "fmt-ops.h"
+#include "fmt-ops-impl.h"
 
 #include <immintrin.h>
 // GCC: workaround for missing AVX intrinsic: "_mm256_setr_m128()"
@@ -1060,3 +1060,239 @@ conv_f32d_to_s16_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const v
 		d += 2;
 	}
 }
+
+/* TPDF dither to interleaved s16. The 16 xorshift32 generators of
+ * dither_noise() are kept in two registers per channel and stepped for
+ * every block of 16 samples, which gives the same noise as the generic
+ * version without a pass over a noise buffer. The dithered samples are
+ * stored with the transposes of conv_f32d_to_s16_avx2. */
+static inline __m256 dither_noise_avx2(__m256i *r)
+{
+	__m256i t = *r;
+	t = _mm256_xor_si256(t, _mm256_slli_epi32(t, 13));
+	t = _mm256_xor_si256(t, _mm256_srli_epi32(t, 17));
+	t = _mm256_xor_si256(t, _mm256_slli_epi32(t, 5));
+	*r = t;
+	t = _mm256_add_epi32(_mm256_and_si256(t, _mm256_set1_epi32(0xffff)),
+			_mm256_srli_epi32(t, 16));
+	t = _mm256_sub_epi32(t, _mm256_set1_epi32(0xffff));
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(t), _mm256_set1_ps(1.0f / 65536.0f));
+}
+
+static inline __m256i dither_s16_avx2(const float *s, __m256i *r)
+{
+	__m256 in;
+	in = _mm256_mul_ps(_mm256_loadu_ps(s), _mm256_set1_ps(S16_SCALE));
+	in = _mm256_add_ps(in, dither_noise_avx2(r));
+	in = _mm256_min_ps(_mm256_set1_ps(S16_MAX), _mm256_max_ps(in, _mm256_set1_ps(S16_MIN)));
+	return _mm256_cvtps_epi32(in);
+}
+
+static inline void dither_noise_load_avx2(__m256i r[2], const uint32_t *state)
+{
+	r[0] = _mm256_loadu_si256((const __m256i*)&state[0]);
+	r[1] = _mm256_loadu_si256((const __m256i*)&state[8]);
+}
+
+static inline void dither_noise_store_avx2(uint32_t *state, __m256i r[2], float *noise)
+{
+	if (noise) {
+		_mm256_storeu_ps(&noise[0], dither_noise_avx2(&r[0]));
+		_mm256_storeu_ps(&noise[8], dither_noise_avx2(&r[1]));
+	}
+	_mm256_storeu_si256((__m256i*)&state[0], r[0]);
+	_mm256_storeu_si256((__m256i*)&state[8], r[1]);
+}
+
+static void
+conv_f32d_to_s16_tpdf_1s_avx2(uint32_t random[][DITHER_LANES], int16_t * SPA_RESTRICT d,
+		const void * SPA_RESTRICT src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0];
+	float noise[1][DITHER_LANES];
+	uint32_t n, h, unrolled = n_samples & ~15;
+	__m256i r[1][2], t[1];
+	__m128i out[1];
+
+	dither_noise_load_avx2(r[0], random[0]);
+
+	for(n = 0; n < unrolled; n += 16) {
+		for (h = 0; h < 2; h++) {
+			t[0] = dither_s16_avx2(&s0[n+h*8], &r[0][h]);
+
+			out[0] = _mm_packs_epi32(_mm256_extracti128_si256(t[0], 0),
+					_mm256_extracti128_si256(t[0], 1));
+
+			d[0*n_channels] = _mm_extract_epi16(out[0], 0);
+			d[1*n_channels] = _mm_extract_epi16(out[0], 1);
+			d[2*n_channels] = _mm_extract_epi16(out[0], 2);
+			d[3*n_channels] = _mm_extract_epi16(out[0], 3);
+			d[4*n_channels] = _mm_extract_epi16(out[0], 4);
+			d[5*n_channels] = _mm_extract_epi16(out[0], 5);
+			d[6*n_channels] = _mm_extract_epi16(out[0], 6);
+			d[7*n_channels] = _mm_extract_epi16(out[0], 7);
+			d += 8*n_channels;
+		}
+	}
+	dither_noise_store_avx2(random[0], r[0], n < n_samples ? noise[0] : NULL);
+	for(h = 0; n < n_samples; n++, h++) {
+		*d = QUANTIZE(s0[n] * S16_SCALE + noise[0][h], S16_MIN, S16_MAX);
+		d += n_channels;
+	}
+}
+
+static void
+conv_f32d_to_s16_tpdf_2s_avx2(uint32_t random[][DITHER_LANES], int16_t * SPA_RESTRICT d,
+		const void * SPA_RESTRICT src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	float noise[2][DITHER_LANES];
+	uint32_t n, h, unrolled = n_samples & ~15;
+	__m256i r[2][2], out[2], t[2];
+
+	dither_noise_load_avx2(r[0], random[0]);
+	dither_noise_load_avx2(r[1], random[1]);
+
+	for(n = 0; n < unrolled; n += 16) {
+		for (h = 0; h < 2; h++) {
+			out[0] = dither_s16_avx2(&s0[n+h*8], &r[0][h]); /* a0 a1 a2 a3 a4 a5 a6 a7 */
+			out[1] = dither_s16_avx2(&s1[n+h*8], &r[1][h]); /* b0 b1 b2 b3 b4 b5 b6 b7 */
+
+			t[0] = _mm256_unpacklo_epi32(out[0], out[1]); /* a0 b0 a1 b1 a4 b4 a5 b5 */
+			t[1] = _mm256_unpackhi_epi32(out[0], out[1]); /* a2 b2 a3 b3 a6 b6 a7 b7 */
+
+			out[0] = _mm256_packs_epi32(t[0], t[1]); /* a0 b0 a1 b1 a2 b2 a3 b3 a4 b4 a5 b5 a6 b6 a7 b7 */
+
+			*((int32_t*)(d + 0*n_channels)) = _mm256_extract_epi32(out[0],0);
+			*((int32_t*)(d + 1*n_channels)) = _mm256_extract_epi32(out[0],1);
+			*((int32_t*)(d + 2*n_channels)) = _mm256_extract_epi32(out[0],2);
+			*((int32_t*)(d + 3*n_channels)) = _mm256_extract_epi32(out[0],3);
+			*((int32_t*)(d + 4*n_channels)) = _mm256_extract_epi32(out[0],4);
+			*((int32_t*)(d + 5*n_channels)) = _mm256_extract_epi32(out[0],5);
+			*((int32_t*)(d + 6*n_channels)) = _mm256_extract_epi32(out[0],6);
+			*((int32_t*)(d + 7*n_channels)) = _mm256_extract_epi32(out[0],7);
+			d += 8*n_channels;
+		}
+	}
+	dither_noise_store_avx2(random[0], r[0], n < n_samples ? noise[0] : NULL);
+	dither_noise_store_avx2(random[1], r[1], n < n_samples ? noise[1] : NULL);
+	for(h = 0; n < n_samples; n++, h++) {
+		d[0] = QUANTIZE(s0[n] * S16_SCALE + noise[0][h], S16_MIN, S16_MAX);
+		d[1] = QUANTIZE(s1[n] * S16_SCALE + noise[1][h], S16_MIN, S16_MAX);
+		d += n_channels;
+	}
+}
+
+static void
+conv_f32d_to_s16_tpdf_4s_avx2(uint32_t random[][DITHER_LANES], int16_t * SPA_RESTRICT d,
+		const void * SPA_RESTRICT src[], uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+	float noise[4][DITHER_LANES];
+	uint32_t i, n, h, unrolled = n_samples & ~15;
+	__m256i r[4][2], out[4], t[4];
+
+	for (i = 0; i < 4; i++)
+		dither_noise_load_avx2(r[i], random[i]);
+
+	for(n = 0; n < unrolled; n += 16) {
+		for (h = 0; h < 2; h++) {
+			t[0] = dither_s16_avx2(&s0[n+h*8], &r[0][h]);  /* a0 a1 a2 a3 a4 a5 a6 a7 */
+			t[1] = dither_s16_avx2(&s1[n+h*8], &r[1][h]);  /* b0 b1 b2 b3 b4 b5 b6 b7 */
+			t[2] = dither_s16_avx2(&s2[n+h*8], &r[2][h]);  /* c0 c1 c2 c3 c4 c5 c6 c7 */
+			t[3] = dither_s16_avx2(&s3[n+h*8], &r[3][h]);  /* d0 d1 d2 d3 d4 d5 d6 d7 */
+
+			t[0] = _mm256_packs_epi32(t[0], t[2]); /* a0 a1 a2 a3 c0 c1 c2 c3 a4 a5 a6 a7 c4 c5 c6 c7 */
+			t[1] = _mm256_packs_epi32(t[1], t[3]); /* b0 b1 b2 b3 d0 d1 d2 d3 b4 b5 b6 b7 d4 d5 d6 d7 */
+
+			out[0] = _mm256_unpacklo_epi16(t[0], t[1]);     /* a0 b0 a1 b1 a2 b2 a3 b3 a4 b4 a5 b5 a6 b6 a7 b7 */
+			out[1] = _mm256_unpackhi_epi16(t[0], t[1]);     /* c0 d0 c1 d1 c2 d2 c3 d3 c4 d4 c5 d5 c6 d6 c7 d7 */
+
+			out[2] = _mm256_unpacklo_epi32(out[0], out[1]); /* a0 b0 c0 d0 a1 b1 c1 d1 a4 b4 c4 d4 a5 b5 c5 d5 */
+			out[3] = _mm256_unpackhi_epi32(out[0], out[1]); /* a2 b2 c2 d2 a3 b3 c3 d3 a6 b6 c6 d6 a7 b7 c7 d7 */
+
+#ifdef __x86_64__
+			*(int64_t*)(d + 0*n_channels) = _mm256_extract_epi64(out[2], 0); /* a0 b0 c0 d0 */
+			*(int64_t*)(d + 1*n_channels) = _mm256_extract_epi64(out[2], 1); /* a1 b1 c1 d1 */
+			*(int64_t*)(d + 2*n_channels) = _mm256_extract_epi64(out[3], 0); /* a2 b2 c2 d2 */
+			*(int64_t*)(d + 3*n_channels) = _mm256_extract_epi64(out[3], 1); /* a3 b3 c3 d3 */
+			*(int64_t*)(d + 4*n_channels) = _mm256_extract_epi64(out[2], 2); /* a4 b4 c4 d4 */
+			*(int64_t*)(d + 5*n_channels) = _mm256_extract_epi64(out[2], 3); /* a5 b5 c5 d5 */
+			*(int64_t*)(d + 6*n_channels) = _mm256_extract_epi64(out[3], 2); /* a6 b6 c6 d6 */
+			*(int64_t*)(d + 7*n_channels) = _mm256_extract_epi64(out[3], 3); /* a7 b7 c7 d7 */
+#else
+			_mm_storel_pi((__m64*)(d + 0*n_channels), (__m128)_mm256_extracti128_si256(out[2], 0));
+			_mm_storeh_pi((__m64*)(d + 1*n_channels), (__m128)_mm256_extracti128_si256(out[2], 0));
+			_mm_storel_pi((__m64*)(d + 2*n_channels), (__m128)_mm256_extracti128_si256(out[3], 0));
+			_mm_storeh_pi((__m64*)(d + 3*n_channels), (__m128)_mm256_extracti128_si256(out[3], 0));
+			_mm_storel_pi((__m64*)(d + 4*n_channels), (__m128)_mm256_extracti128_si256(out[2], 1));
+			_mm_storeh_pi((__m64*)(d + 5*n_channels), (__m128)_mm256_extracti128_si256(out[2], 1));
+			_mm_storel_pi((__m64*)(d + 6*n_channels), (__m128)_mm256_extracti128_si256(out[3], 1));
+			_mm_storeh_pi((__m64*)(d + 7*n_channels), (__m128)_mm256_extracti128_si256(out[3], 1));
+#endif
+			d += 8*n_channels;
+		}
+	}
+	for (i = 0; i < 4; i++)
+		dither_noise_store_avx2(random[i], r[i], n < n_samples ? noise[i] : NULL);
+	for(h = 0; n < n_samples; n++, h++) {
+		d[0] = QUANTIZE(s0[n] * S16_SCALE + noise[0][h], S16_MIN, S16_MAX);
+		d[1] = QUANTIZE(s1[n] * S16_SCALE + noise[1][h], S16_MIN, S16_MAX);
+		d[2] = QUANTIZE(s2[n] * S16_SCALE + noise[2][h], S16_MIN, S16_MAX);
+		d[3] = QUANTIZE(s3[n] * S16_SCALE + noise[3][h], S16_MIN, S16_MAX);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s16_tpdf_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_f32d_to_s16_tpdf_4s_avx2(&conv->random[i], &d[i], &src[i], n_channels, n_samples);
+	for(; i + 1 < n_channels; i += 2)
+		conv_f32d_to_s16_tpdf_2s_avx2(&conv->random[i], &d[i], &src[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_f32d_to_s16_tpdf_1s_avx2(&conv->random[i], &d[i], &src[i], n_channels, n_samples);
+}
+
+/* generic converters, vectorized by the compiler. Only the conversions to
+ * f32 and the plain (de)interleavers are instantiated here, the conversions
+ * from f32 and the 24 bits formats are not faster than the C versions. */
+MAKE_CONV_PACKED(u8_to_f32, READ_U8, WRITE_F32, avx2);
+MAKE_CONV_PLANAR(u8d_to_f32d, READ_U8, WRITE_F32, avx2);
+MAKE_CONV_PACKED(s16_to_f32, READ_S16, WRITE_F32, avx2);
+MAKE_CONV_PLANAR(s16d_to_f32d, READ_S16, WRITE_F32, avx2);
+MAKE_CONV_PACKED(s24_32_to_f32, READ_S24_32, WRITE_F32, avx2);
+MAKE_CONV_PLANAR(s24_32d_to_f32d, READ_S24_32, WRITE_F32, avx2);
+MAKE_CONV_PACKED(s32_to_f32, READ_S32, WRITE_F32, avx2);
+MAKE_CONV_PLANAR(s32d_to_f32d, READ_S32, WRITE_F32, avx2);
+
+/* variants for a fixed number of channels */
+MAKE_DEINTERLEAVE(u8_to_f32d, READ_U8, WRITE_F32, avx2);
+MAKE_DEINTERLEAVE_N(s16_to_f32d, READ_S16, WRITE_F32, 1, avx2);
+MAKE_DEINTERLEAVE_N(s16_to_f32d, READ_S16, WRITE_F32, 4, avx2);
+MAKE_DEINTERLEAVE_N(s16_to_f32d, READ_S16, WRITE_F32, 8, avx2);
+MAKE_DEINTERLEAVE(s24_32_to_f32d, READ_S24_32, WRITE_F32, avx2);
+MAKE_DEINTERLEAVE_N(s32_to_f32d, READ_S32, WRITE_F32, 1, avx2);
+MAKE_DEINTERLEAVE(deinterleave_8, READ_8, WRITE_8, avx2);
+MAKE_DEINTERLEAVE(deinterleave_16, READ_16, WRITE_16, avx2);
+MAKE_DEINTERLEAVE(deinterleave_32, READ_32, WRITE_32, avx2);
+MAKE_INTERLEAVE(u8d_to_f32, READ_U8, WRITE_F32, avx2);
+MAKE_INTERLEAVE(s16d_to_f32, READ_S16, WRITE_F32, avx2);
+MAKE_INTERLEAVE(s24_32d_to_f32, READ_S24_32, WRITE_F32, avx2);
+MAKE_INTERLEAVE(s32d_to_f32, READ_S32, WRITE_F32, avx2);
+MAKE_INTERLEAVE(interleave_8, READ_8, WRITE_8, avx2);
+MAKE_INTERLEAVE(interleave_16, READ_16, WRITE_16, avx2);
+MAKE_INTERLEAVE(interleave_32, READ_32, WRITE_32, avx2);
+
+/* the interleaved s16 TPDF dither is done with the transposes above */
+MAKE_DITHER_TPDF(f32d_to_s16d_tpdf, S16_SCALE, S16_MIN, S16_MAX, STORE_S16, false, avx2);
+MAKE_DITHER_SHAPED(f32d_to_s16_shaped, S16_SCALE, S16_MIN, S16_MAX, STORE_S16, true, avx2);
+MAKE_DITHER_SHAPED(f32d_to_s16d_shaped, S16_SCALE, S16_MIN, S16_MAX, STORE_S16, false, avx2);
+MAKE_DITHER(s24, S24_SCALE, S24_MIN, S24_MAX, STORE_S24, avx2);
+MAKE_DITHER(s24_32, S24_SCALE, S24_MIN, S24_MAX, STORE_S24_32, avx2);
+MAKE_DITHER(s32, S24_SCALE, S24_MIN, S24_MAX, STORE_S32, avx2);
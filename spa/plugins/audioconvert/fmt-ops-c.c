@@ -30,7 +30,7 @@
 #include <spa/utils/defs.h>
 #include <spa/param/audio/format-utils.h>
 
-#include "fmt-ops.h"
+#include "fmt-ops-impl.h"
 
 void
 conv_copy8d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
@@ -830,3 +830,45 @@ conv_interleave_32_c(struct convert *conv, void * SPA_RESTRICT dst[], const void
 			*d++ = s[i][j];
 	}
 }
+
+/* variants for a fixed number of channels */
+MAKE_DEINTERLEAVE(u8_to_f32d, READ_U8, WRITE_F32, c);
+MAKE_DEINTERLEAVE(s16_to_f32d, READ_S16, WRITE_F32, c);
+MAKE_DEINTERLEAVE(s24_to_f32d, READ_S24, WRITE_F32, c);
+MAKE_DEINTERLEAVE(s24s_to_f32d, READ_S24S, WRITE_F32, c);
+MAKE_DEINTERLEAVE(s24_32_to_f32d, READ_S24_32, WRITE_F32, c);
+MAKE_DEINTERLEAVE(s32_to_f32d, READ_S32, WRITE_F32, c);
+MAKE_DEINTERLEAVE(f32_to_u8d, READ_F32, WRITE_U8, c);
+MAKE_DEINTERLEAVE(f32_to_s16d, READ_F32, WRITE_S16, c);
+MAKE_DEINTERLEAVE(f32_to_s24d, READ_F32, WRITE_S24, c);
+MAKE_DEINTERLEAVE(f32_to_s24_32d, READ_F32, WRITE_S24_32, c);
+MAKE_DEINTERLEAVE(f32_to_s32d, READ_F32, WRITE_S32, c);
+MAKE_DEINTERLEAVE(deinterleave_8, READ_8, WRITE_8, c);
+MAKE_DEINTERLEAVE(deinterleave_16, READ_16, WRITE_16, c);
+MAKE_DEINTERLEAVE(deinterleave_24, READ_24, WRITE_24, c);
+MAKE_DEINTERLEAVE(deinterleave_32, READ_32, WRITE_32, c);
+
+MAKE_INTERLEAVE(u8d_to_f32, READ_U8, WRITE_F32, c);
+MAKE_INTERLEAVE(s16d_to_f32, READ_S16, WRITE_F32, c);
+MAKE_INTERLEAVE(s24d_to_f32, READ_S24, WRITE_F32, c);
+MAKE_INTERLEAVE(s24_32d_to_f32, READ_S24_32, WRITE_F32, c);
+MAKE_INTERLEAVE(s32d_to_f32, READ_S32, WRITE_F32, c);
+MAKE_INTERLEAVE(f32d_to_u8, READ_F32, WRITE_U8, c);
+MAKE_INTERLEAVE(f32d_to_s16, READ_F32, WRITE_S16, c);
+MAKE_INTERLEAVE(f32d_to_s24, READ_F32, WRITE_S24, c);
+MAKE_INTERLEAVE(f32d_to_s24s, READ_F32, WRITE_S24S, c);
+MAKE_INTERLEAVE(f32d_to_s24_32, READ_F32, WRITE_S24_32, c);
+MAKE_INTERLEAVE(f32d_to_s32, READ_F32, WRITE_S32, c);
+MAKE_INTERLEAVE(interleave_8, READ_8, WRITE_8, c);
+MAKE_INTERLEAVE(interleave_16, READ_16, WRITE_16, c);
+MAKE_INTERLEAVE(interleave_24, READ_24, WRITE_24, c);
+MAKE_INTERLEAVE(interleave_32, READ_32, WRITE_32, c);
+
+/* pairs without a dedicated implementation */
+MAKE_CONV_PACKED(s24s_to_f32, READ_S24S, WRITE_F32, c);
+MAKE_CONV_PACKED(f32_to_s24s, READ_F32, WRITE_S24S, c);
+
+MAKE_DITHER(s16, S16_SCALE, S16_MIN, S16_MAX, STORE_S16, c);
+MAKE_DITHER(s24, S24_SCALE, S24_MIN, S24_MAX, STORE_S24, c);
+MAKE_DITHER(s24_32, S24_SCALE, S24_MIN, S24_MAX, STORE_S24_32, c);
+MAKE_DITHER(s32, S24_SCALE, S24_MIN, S24_MAX, STORE_S32, c);
@@ -0,0 +1,232 @@
+/* Spa
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fmt-ops.h"
+
+/* Generic converter templates. Each arch specific file instantiates these
+ * with its own compiler flags so that the inner loops, which have a
+ * constant channel count and restrict qualified pointers, are vectorized
+ * by the compiler. */
+
+/* sample accessors, the index is in samples */
+#define READ_U8(s,i)		U8_TO_F32(((const uint8_t*)(s))[i])
+#define READ_S16(s,i)		S16_TO_F32(((const int16_t*)(s))[i])
+#define READ_S24(s,i)		S24_TO_F32(read_s24(&((const uint8_t*)(s))[(i)*3]))
+#define READ_S24S(s,i)		S24_TO_F32(read_s24s(&((const uint8_t*)(s))[(i)*3]))
+#define READ_S24_32(s,i)	S24_TO_F32(((const int32_t*)(s))[i])
+#define READ_S32(s,i)		S32_TO_F32(((const int32_t*)(s))[i])
+#define READ_F32(s,i)		(((const float*)(s))[i])
+
+#define WRITE_U8(d,i,v)		((uint8_t*)(d))[i] = F32_TO_U8(v)
+#define WRITE_S16(d,i,v)	((int16_t*)(d))[i] = F32_TO_S16(v)
+#define WRITE_S24(d,i,v)	write_s24(&((uint8_t*)(d))[(i)*3], F32_TO_S24(v))
+#define WRITE_S24S(d,i,v)	write_s24s(&((uint8_t*)(d))[(i)*3], F32_TO_S24(v))
+#define WRITE_S24_32(d,i,v)	((int32_t*)(d))[i] = F32_TO_S24(v)
+#define WRITE_S32(d,i,v)	((int32_t*)(d))[i] = F32_TO_S32(v)
+#define WRITE_F32(d,i,v)	((float*)(d))[i] = (v)
+
+/* raw accessors for (de)interleaving without conversion */
+#define READ_8(s,i)		(((const uint8_t*)(s))[i])
+#define READ_16(s,i)		(((const uint16_t*)(s))[i])
+#define READ_24(s,i)		read_s24(&((const uint8_t*)(s))[(i)*3])
+#define READ_32(s,i)		(((const uint32_t*)(s))[i])
+#define WRITE_8(d,i,v)		((uint8_t*)(d))[i] = (v)
+#define WRITE_16(d,i,v)		((uint16_t*)(d))[i] = (v)
+#define WRITE_24(d,i,v)		write_s24(&((uint8_t*)(d))[(i)*3], v)
+#define WRITE_32(d,i,v)		((uint32_t*)(d))[i] = (v)
+
+/* interleaved to interleaved */
+#define MAKE_CONV_PACKED(name,READ,WRITE,arch)					\
+DEFINE_FUNCTION(name,arch)							\
+{										\
+	const void * SPA_RESTRICT s = src[0];					\
+	void * SPA_RESTRICT d = dst[0];						\
+	uint32_t j, n_samples_total = n_samples * conv->n_channels;		\
+	for (j = 0; j < n_samples_total; j++)					\
+		WRITE(d, j, READ(s, j));					\
+}
+
+/* planar to planar */
+#define MAKE_CONV_PLANAR(name,READ,WRITE,arch)					\
+DEFINE_FUNCTION(name,arch)							\
+{										\
+	uint32_t i, j, n_channels = conv->n_channels;				\
+	for (i = 0; i < n_channels; i++) {					\
+		const void * SPA_RESTRICT s = src[i];				\
+		void * SPA_RESTRICT d = dst[i];					\
+		for (j = 0; j < n_samples; j++)					\
+			WRITE(d, j, READ(s, j));				\
+	}									\
+}
+
+/* interleaved to planar with a fixed number of channels */
+#define MAKE_DEINTERLEAVE_N(name,READ,WRITE,n,arch)				\
+DEFINE_FUNCTION(name##_##n,arch)						\
+{										\
+	const void * SPA_RESTRICT s = src[0];					\
+	void * SPA_RESTRICT d[n];						\
+	uint32_t i, j;								\
+	for (i = 0; i < n; i++)							\
+		d[i] = dst[i];							\
+	for (j = 0; j < n_samples; j++) {					\
+		for (i = 0; i < n; i++)						\
+			WRITE(d[i], j, READ(s, j * n + i));			\
+	}									\
+}
+
+/* planar to interleaved with a fixed number of channels */
+#define MAKE_INTERLEAVE_N(name,READ,WRITE,n,arch)				\
+DEFINE_FUNCTION(name##_##n,arch)						\
+{										\
+	const void * SPA_RESTRICT s[n];						\
+	void * SPA_RESTRICT d = dst[0];						\
+	uint32_t i, j;								\
+	for (i = 0; i < n; i++)							\
+		s[i] = src[i];							\
+	for (j = 0; j < n_samples; j++) {					\
+		for (i = 0; i < n; i++)						\
+			WRITE(d, j * n + i, READ(s[i], j));			\
+	}									\
+}
+
+#define MAKE_DEINTERLEAVE(name,READ,WRITE,arch)					\
+	MAKE_DEINTERLEAVE_N(name,READ,WRITE,1,arch)				\
+	MAKE_DEINTERLEAVE_N(name,READ,WRITE,2,arch)				\
+	MAKE_DEINTERLEAVE_N(name,READ,WRITE,4,arch)				\
+	MAKE_DEINTERLEAVE_N(name,READ,WRITE,8,arch)
+
+#define MAKE_INTERLEAVE(name,READ,WRITE,arch)					\
+	MAKE_INTERLEAVE_N(name,READ,WRITE,1,arch)				\
+	MAKE_INTERLEAVE_N(name,READ,WRITE,2,arch)				\
+	MAKE_INTERLEAVE_N(name,READ,WRITE,4,arch)				\
+	MAKE_INTERLEAVE_N(name,READ,WRITE,8,arch)
+
+/* Fill d with n (a multiple of DITHER_LANES) samples of TPDF noise of +-1 LSB.
+ * Every lane runs its own xorshift32 generator, the two 16 bits halves of
+ * the output are summed to get the triangular distribution. */
+static inline void dither_noise(uint32_t * SPA_RESTRICT state, float * SPA_RESTRICT d, uint32_t n)
+{
+	uint32_t j, k, r[DITHER_LANES];
+	for (k = 0; k < DITHER_LANES; k++)
+		r[k] = state[k];
+	for (j = 0; j < n; j += DITHER_LANES) {
+		for (k = 0; k < DITHER_LANES; k++) {
+			r[k] ^= r[k] << 13;
+			r[k] ^= r[k] >> 17;
+			r[k] ^= r[k] << 5;
+			d[j + k] = ((int32_t)(r[k] & 0xffff) + (int32_t)(r[k] >> 16) - 0xffff) *
+				(1.0f / 65536.0f);
+		}
+	}
+	for (k = 0; k < DITHER_LANES; k++)
+		state[k] = r[k];
+}
+
+/* clamp and round to the nearest integer */
+#define QUANTIZE(v,min,max)	((int32_t)rintf(SPA_CLAMP(v, min, max)))
+
+#define STORE_S16(d,i,v)	((int16_t*)(d))[i] = (v)
+#define STORE_S24(d,i,v)	write_s24(&((uint8_t*)(d))[(i)*3], v)
+#define STORE_S24_32(d,i,v)	((int32_t*)(d))[i] = (v)
+#define STORE_S32(d,i,v)	((int32_t*)(d))[i] = (int32_t)((uint32_t)(v) << 8)
+
+/* planar f32 to integer with TPDF dither, packed selects interleaved output.
+ * The samples are quantized in blocks so that the loop stays vectorizable
+ * when the store is strided. */
+#define MAKE_DITHER_TPDF(name,SCALE,MIN,MAX,STORE,packed,arch)			\
+DEFINE_FUNCTION(name,arch)							\
+{										\
+	uint32_t i, j, k, n_channels = conv->n_channels;			\
+	uint32_t stride = packed ? n_channels : 1;				\
+	float noise[DITHER_SIZE];						\
+	int32_t q[DITHER_SIZE];							\
+	for (i = 0; i < n_channels; i++) {					\
+		const float * SPA_RESTRICT s = src[i];				\
+		void * SPA_RESTRICT d = packed ? dst[0] : dst[i];		\
+		uint32_t offs = packed ? i : 0;					\
+		for (j = 0; j < n_samples;) {					\
+			uint32_t chunk = SPA_MIN(n_samples - j, DITHER_SIZE);	\
+			dither_noise(conv->random[i], noise, SPA_ROUND_UP_N(chunk, DITHER_LANES)); \
+			if (packed) {						\
+				for (k = j; k < j + chunk; k++) {		\
+					float v = s[k] * SCALE + noise[k - j];	\
+					q[k - j] = QUANTIZE(v, MIN, MAX);	\
+				}						\
+				for (k = 0; k < chunk; k++, offs += stride)	\
+					STORE(d, offs, q[k]);			\
+			} else {						\
+				for (k = j; k < j + chunk; k++) {		\
+					float v = s[k] * SCALE + noise[k - j];	\
+					STORE(d, k, QUANTIZE(v, MIN, MAX));	\
+				}						\
+			}							\
+			j += chunk;						\
+		}								\
+	}									\
+}
+
+/* TPDF dither with the 5 tap error feedback filter from Lipshitz et al.,
+ * this moves the noise away from the most sensitive frequencies. The filter
+ * is recursive so only the noise generation is vectorized, the older errors
+ * are summed first to keep the dependency chain per sample short. The error
+ * is taken before clipping so that it stays within +-1.5 LSB. */
+#define MAKE_DITHER_SHAPED(name,SCALE,MIN,MAX,STORE,packed,arch)		\
+DEFINE_FUNCTION(name,arch)							\
+{										\
+	uint32_t i, j, k, n_channels = conv->n_channels;			\
+	uint32_t stride = packed ? n_channels : 1;				\
+	float noise[DITHER_SIZE];						\
+	for (i = 0; i < n_channels; i++) {					\
+		const float * SPA_RESTRICT s = src[i];				\
+		void * SPA_RESTRICT d = packed ? dst[0] : dst[i];		\
+		uint32_t offs = packed ? i : 0;					\
+		float e0 = conv->ns[i][0], e1 = conv->ns[i][1];			\
+		float e2 = conv->ns[i][2], e3 = conv->ns[i][3];			\
+		float e4 = conv->ns[i][4];					\
+		for (j = 0; j < n_samples;) {					\
+			uint32_t chunk = SPA_MIN(n_samples - j, DITHER_SIZE);	\
+			dither_noise(conv->random[i], noise, SPA_ROUND_UP_N(chunk, DITHER_LANES)); \
+			for (k = j; k < j + chunk; k++) {			\
+				float v, q;					\
+				v = s[k] * SCALE + 2.165f * e1 - 1.959f * e2 +	\
+					1.590f * e3 - 0.6149f * e4;		\
+				v -= 2.033f * e0;				\
+				q = rintf(v + noise[k - j]);			\
+				e4 = e3; e3 = e2; e2 = e1;			\
+				e1 = e0; e0 = q - v;				\
+				STORE(d, k * stride + offs, (int32_t)SPA_CLAMP(q, MIN, MAX)); \
+			}							\
+			j += chunk;						\
+		}								\
+		conv->ns[i][0] = e0; conv->ns[i][1] = e1;			\
+		conv->ns[i][2] = e2; conv->ns[i][3] = e3;			\
+		conv->ns[i][4] = e4;						\
+	}									\
+}
+
+#define MAKE_DITHER(name,SCALE,MIN,MAX,STORE,arch)				\
+	MAKE_DITHER_TPDF(f32d_to_##name##_tpdf,SCALE,MIN,MAX,STORE,true,arch)	\
+	MAKE_DITHER_TPDF(f32d_to_##name##d_tpdf,SCALE,MIN,MAX,STORE,false,arch)	\
+	MAKE_DITHER_SHAPED(f32d_to_##name##_shaped,SCALE,MIN,MAX,STORE,true,arch) \
+	MAKE_DITHER_SHAPED(f32d_to_##name##d_shaped,SCALE,MIN,MAX,STORE,false,arch)
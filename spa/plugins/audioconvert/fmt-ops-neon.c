@@ -26,7 +26,7 @@
 #include <stdio.h>
 #include <math.h>
 
-#include "fmt-ops.h"
+#include "fmt-ops-impl.h"
 
 static void
 conv_s16_to_f32d_2s_neon(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
@@ -361,3 +361,30 @@ conv_f32d_to_s16_neon(struct convert *conv, void * SPA_RESTRICT dst[], const voi
 	for(; i < n_channels; i++)
 		conv_f32d_to_s16_1s_neon(conv, &d[i], &src[i], n_channels, n_samples);
 }
+
+/* generic converters, vectorized by the compiler. Only the conversions to
+ * f32 and the plain (de)interleavers are instantiated here, the conversions
+ * from f32 and the 24 bits formats are not faster than the C versions. */
+MAKE_CONV_PACKED(u8_to_f32, READ_U8, WRITE_F32, neon);
+MAKE_CONV_PLANAR(u8d_to_f32d, READ_U8, WRITE_F32, neon);
+MAKE_CONV_PACKED(s16_to_f32, READ_S16, WRITE_F32, neon);
+MAKE_CONV_PLANAR(s16d_to_f32d, READ_S16, WRITE_F32, neon);
+MAKE_CONV_PACKED(s24_32_to_f32, READ_S24_32, WRITE_F32, neon);
+MAKE_CONV_PLANAR(s24_32d_to_f32d, READ_S24_32, WRITE_F32, neon);
+MAKE_CONV_PACKED(s32_to_f32, READ_S32, WRITE_F32, neon);
+MAKE_CONV_PLANAR(s32d_to_f32d, READ_S32, WRITE_F32, neon);
+
+/* variants for a fixed number of channels */
+MAKE_DEINTERLEAVE(u8_to_f32d, READ_U8, WRITE_F32, neon);
+MAKE_DEINTERLEAVE(s24_32_to_f32d, READ_S24_32, WRITE_F32, neon);
+MAKE_DEINTERLEAVE(s32_to_f32d, READ_S32, WRITE_F32, neon);
+MAKE_DEINTERLEAVE(deinterleave_8, READ_8, WRITE_8, neon);
+MAKE_DEINTERLEAVE(deinterleave_16, READ_16, WRITE_16, neon);
+MAKE_DEINTERLEAVE(deinterleave_32, READ_32, WRITE_32, neon);
+MAKE_INTERLEAVE(u8d_to_f32, READ_U8, WRITE_F32, neon);
+MAKE_INTERLEAVE(s16d_to_f32, READ_S16, WRITE_F32, neon);
+MAKE_INTERLEAVE(s24_32d_to_f32, READ_S24_32, WRITE_F32, neon);
+MAKE_INTERLEAVE(s32d_to_f32, READ_S32, WRITE_F32, neon);
+MAKE_INTERLEAVE(interleave_8, READ_8, WRITE_8, neon);
+MAKE_INTERLEAVE(interleave_16, READ_16, WRITE_16, neon);
+MAKE_INTERLEAVE(interleave_32, READ_32, WRITE_32, neon);
@@ -42,47 +42,141 @@ struct conv_info {
 	uint32_t cpu_flags;
 
 	convert_func_t process;
+	uint32_t method;
 };
 
+#define MAKE_N(src,dst,name,flags,arch)				\
+	{ src, dst, 1, flags, conv_##name##_1_##arch },		\
+	{ src, dst, 2, flags, conv_##name##_2_##arch },		\
+	{ src, dst, 4, flags, conv_##name##_4_##arch },		\
+	{ src, dst, 8, flags, conv_##name##_8_##arch }
+
 static struct conv_info conv_table[] =
 {
 	/* to f32 */
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_NEON, conv_u8_to_f32_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_AVX2, conv_u8_to_f32_avx2 },
+#endif
 	{ SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_F32, 0, 0, conv_u8_to_f32_c },
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_u8d_to_f32d_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_u8d_to_f32d_avx2 },
+#endif
 	{ SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_u8d_to_f32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_F32P, u8_to_f32d, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_F32P, u8_to_f32d, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_F32P, u8_to_f32d, 0, c),
 	{ SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_u8_to_f32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_F32, u8d_to_f32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_F32, u8d_to_f32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_F32, u8d_to_f32, 0, c),
 	{ SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_u8d_to_f32_c },
 
 
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_NEON, conv_s16_to_f32_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_AVX2, conv_s16_to_f32_avx2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s16_to_f32_c },
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s16d_to_f32d_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s16d_to_f32d_avx2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s16d_to_f32d_c },
 #if defined (HAVE_NEON)
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s16_to_f32d_neon },
 #endif
 #if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_1_avx2 },
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_2_avx2 },
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 4, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_4_avx2 },
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 8, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_8_avx2 },
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_avx2 },
 #endif
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_SSE2, conv_s16_to_f32d_2_sse2 },
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_s16_to_f32d_sse2 },
 #endif
+	MAKE_N(SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, s16_to_f32d, 0, c),
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s16_to_f32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32, s16d_to_f32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32, s16d_to_f32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32, s16d_to_f32, 0, c),
 	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s16d_to_f32_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, deinterleave_32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, deinterleave_32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, deinterleave_32, 0, c),
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, interleave_32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, interleave_32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, interleave_32, 0, c),
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_interleave_32_c },
 
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, s32_to_f32d, SPA_CPU_FLAG_NEON, neon),
+#endif
 #if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX2, conv_s32_to_f32d_1_avx2 },
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s32_to_f32d_avx2 },
 #endif
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_s32_to_f32d_sse2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_NEON, conv_s32_to_f32_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_AVX2, conv_s32_to_f32_avx2 },
 #endif
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s32_to_f32_c },
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s32d_to_f32d_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s32d_to_f32d_avx2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s32d_to_f32d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, s32_to_f32d, 0, c),
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s32_to_f32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32, s32d_to_f32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32, s32d_to_f32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32, s32d_to_f32, 0, c),
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s32d_to_f32_c },
 
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24_to_f32_c },
@@ -99,20 +193,52 @@ static struct conv_info conv_table[] =
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_s24_to_f32d_sse2 },
 #endif
+	MAKE_N(SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32P, s24_to_f32d, 0, c),
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24_to_f32d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_F32, s24d_to_f32, 0, c),
 	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24d_to_f32_c },
 
+	MAKE_N(SPA_AUDIO_FORMAT_S24_OE, SPA_AUDIO_FORMAT_F32P, s24s_to_f32d, 0, c),
 	{ SPA_AUDIO_FORMAT_S24_OE, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24s_to_f32d_c },
+	{ SPA_AUDIO_FORMAT_S24_OE, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24s_to_f32_c },
 
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_NEON, conv_s24_32_to_f32_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_AVX2, conv_s24_32_to_f32_avx2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24_32_to_f32_c },
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s24_32d_to_f32d_neon },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s24_32d_to_f32d_avx2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24_32d_to_f32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P, s24_32_to_f32d, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P, s24_32_to_f32d, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P, s24_32_to_f32d, 0, c),
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24_32_to_f32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32, s24_32d_to_f32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32, s24_32d_to_f32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32, s24_32d_to_f32, 0, c),
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24_32d_to_f32_c },
 
 	/* from f32 */
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_U8, 0, 0, conv_f32_to_u8_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_U8P, 0, 0, conv_f32d_to_u8d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_U8P, f32_to_u8d, 0, c),
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_U8P, 0, 0, conv_f32_to_u8d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_U8, f32d_to_u8, 0, c),
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_U8, 0, 0, conv_f32d_to_u8_c },
 
 #if defined (HAVE_SSE2)
@@ -125,6 +251,7 @@ static struct conv_info conv_table[] =
 #endif
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_f32d_to_s16d_c },
 
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S16P, f32_to_s16d, 0, c),
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_f32_to_s16d_c },
 
 #if defined (HAVE_NEON)
@@ -139,10 +266,12 @@ static struct conv_info conv_table[] =
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 2, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_2_sse2 },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_sse2 },
 #endif
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, f32d_to_s16, 0, c),
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32, 0, 0, conv_f32_to_s32_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32d_to_s32d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32P, f32_to_s32d, 0, c),
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32_to_s32d_c },
 #if defined (HAVE_AVX2)
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s32_avx2 },
@@ -150,56 +279,188 @@ static struct conv_info conv_table[] =
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s32_sse2 },
 #endif
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, f32d_to_s32, 0, c),
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, 0, conv_f32d_to_s32_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32_to_s24_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32d_to_s24d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24P, f32_to_s24d, 0, c),
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32_to_s24d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, f32d_to_s24, 0, c),
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_c },
 
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_OE, f32d_to_s24s, 0, c),
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_OE, 0, 0, conv_f32d_to_s24s_c },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_OE, 0, 0, conv_f32_to_s24s_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_f32_to_s24_32_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_f32d_to_s24_32d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_32P, f32_to_s24_32d, 0, c),
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_f32_to_s24_32d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, f32d_to_s24_32, 0, c),
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_f32d_to_s24_32_c },
 
 	/* u8 */
 	{ SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_U8, 0, 0, conv_copy8_c },
 	{ SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_U8P, 0, 0, conv_copy8d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_U8P, deinterleave_8, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_U8P, deinterleave_8, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_U8P, deinterleave_8, 0, c),
 	{ SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_U8P, 0, 0, conv_deinterleave_8_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_U8, interleave_8, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_U8, interleave_8, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_U8, interleave_8, 0, c),
 	{ SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_U8, 0, 0, conv_interleave_8_c },
 
 	/* s16 */
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_S16, 0, 0, conv_copy16_c },
 	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_copy16d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_S16P, deinterleave_16, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_S16P, deinterleave_16, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_S16P, deinterleave_16, 0, c),
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_deinterleave_16_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_S16, interleave_16, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_S16, interleave_16, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_S16, interleave_16, 0, c),
 	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_interleave_16_c },
 
 	/* s32 */
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, deinterleave_32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, deinterleave_32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, deinterleave_32, 0, c),
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, interleave_32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, interleave_32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, interleave_32, 0, c),
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 0, 0, conv_interleave_32_c },
 
 	/* s24 */
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24, 0, 0, conv_copy24_c },
 	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_copy24d_c },
+	MAKE_N(SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24P, deinterleave_24, 0, c),
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_deinterleave_24_c },
+	MAKE_N(SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_S24, interleave_24, 0, c),
 	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_interleave_24_c },
 
 	/* s24_32 */
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, deinterleave_32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, deinterleave_32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, deinterleave_32, 0, c),
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_NEON)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, interleave_32, SPA_CPU_FLAG_NEON, neon),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, interleave_32, SPA_CPU_FLAG_AVX2, avx2),
+#endif
+	MAKE_N(SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, interleave_32, 0, c),
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_interleave_32_c },
+	/* dither, triangular */
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_tpdf_c, DITHER_METHOD_TRIANGULAR },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16d_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_f32d_to_s16d_tpdf_c, DITHER_METHOD_TRIANGULAR },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_tpdf_c, DITHER_METHOD_TRIANGULAR },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24d_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32d_to_s24d_tpdf_c, DITHER_METHOD_TRIANGULAR },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_32_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_f32d_to_s24_32_tpdf_c, DITHER_METHOD_TRIANGULAR },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_32d_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_f32d_to_s24_32d_tpdf_c, DITHER_METHOD_TRIANGULAR },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s32_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, 0, conv_f32d_to_s32_tpdf_c, DITHER_METHOD_TRIANGULAR },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s32d_tpdf_avx2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32d_to_s32d_tpdf_c, DITHER_METHOD_TRIANGULAR },
+
+	/* dither, noise shaped */
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_shaped_c, DITHER_METHOD_SHAPED },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16d_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_f32d_to_s16d_shaped_c, DITHER_METHOD_SHAPED },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_shaped_c, DITHER_METHOD_SHAPED },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24d_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32d_to_s24d_shaped_c, DITHER_METHOD_SHAPED },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_32_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_f32d_to_s24_32_shaped_c, DITHER_METHOD_SHAPED },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_32d_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_f32d_to_s24_32d_shaped_c, DITHER_METHOD_SHAPED },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s32_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, 0, conv_f32d_to_s32_shaped_c, DITHER_METHOD_SHAPED },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32P, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s32d_shaped_avx2, DITHER_METHOD_SHAPED },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32d_to_s32d_shaped_c, DITHER_METHOD_SHAPED },
 };
 
 #define MATCH_CHAN(a,b)		((a) == 0 || (a) == (b))
 #define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
 
 static const struct conv_info *find_conv_info(uint32_t src_fmt, uint32_t dst_fmt,
-		uint32_t n_channels, uint32_t cpu_flags)
+		uint32_t n_channels, uint32_t cpu_flags, uint32_t method)
 {
 	size_t i;
 
@@ -207,7 +468,8 @@ static const struct conv_info *find_conv_info(uint32_t src_fmt, uint32_t dst_fmt
 		if (conv_table[i].src_fmt == src_fmt &&
 		    conv_table[i].dst_fmt == dst_fmt &&
 		    MATCH_CHAN(conv_table[i].n_channels, n_channels) &&
-		    MATCH_CPU_FLAGS(conv_table[i].cpu_flags, cpu_flags))
+		    MATCH_CPU_FLAGS(conv_table[i].cpu_flags, cpu_flags) &&
+		    conv_table[i].method == method)
 			return &conv_table[i];
 	}
 	return NULL;
@@ -220,14 +482,28 @@ static void impl_convert_free(struct convert *conv)
 
 int convert_init(struct convert *conv)
 {
-	const struct conv_info *info;
+	const struct conv_info *info = NULL;
+	uint32_t i, j;
 
-	info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels, conv->cpu_flags);
+	/* dither is only done when converting to integer formats */
+	if (conv->method != DITHER_METHOD_NONE)
+		info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels,
+				conv->cpu_flags, conv->method);
+	if (info == NULL)
+		info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels,
+				conv->cpu_flags, DITHER_METHOD_NONE);
 	if (info == NULL)
 		return -ENOTSUP;
 
+	for (i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++) {
+		for (j = 0; j < DITHER_LANES; j++)
+			conv->random[i][j] = 0x9e3779b9u * (i * DITHER_LANES + j + 1);
+	}
+	spa_zero(conv->ns);
+
 	conv->is_passthrough = conv->src_fmt == conv->dst_fmt;
 	conv->cpu_flags = info->cpu_flags;
+	conv->method = info->method;
 	conv->process = info->process;
 	conv->free = impl_convert_free;
 
@@ -25,6 +25,7 @@
 #include <math.h>
 
 #include <spa/utils/defs.h>
+#include <spa/param/audio/raw.h>
 
 #define U8_MIN		0
 #define U8_MAX		255
@@ -101,18 +102,26 @@ static inline void write_s24s(void *dst, int32_t val)
 #endif
 }
 
-#define MAX_NS	64
+#define DITHER_LANES	16u
+#define DITHER_SIZE	256u
+#define NS_SIZE		5
+
+enum dither_method {
+	DITHER_METHOD_NONE,
+	DITHER_METHOD_TRIANGULAR,	/* TPDF noise of +-1 LSB */
+	DITHER_METHOD_SHAPED,		/* TPDF noise with error feedback */
+};
 
 struct convert {
 	uint32_t src_fmt;
 	uint32_t dst_fmt;
 	uint32_t n_channels;
 	uint32_t cpu_flags;
+	uint32_t method;
 
 	unsigned int is_passthrough:1;
-	float ns_data[MAX_NS];
-	uint32_t ns_idx;
-	uint32_t ns_size;
+	uint32_t random[SPA_AUDIO_MAX_CHANNELS][DITHER_LANES];
+	float ns[SPA_AUDIO_MAX_CHANNELS][NS_SIZE];
 
 	void (*process) (struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
 			uint32_t n_samples);
@@ -128,6 +137,13 @@ int convert_init(struct convert *conv);
 void conv_##name##_##arch(struct convert *conv, void * SPA_RESTRICT dst[],	\
 		const void * SPA_RESTRICT src[], uint32_t n_samples)		\
 
+/* variants for 1, 2, 4 and 8 channels, see fmt-ops-impl.h */
+#define DEFINE_FUNCTION_N(name,arch)	\
+	DEFINE_FUNCTION(name##_1,arch);	\
+	DEFINE_FUNCTION(name##_2,arch);	\
+	DEFINE_FUNCTION(name##_4,arch);	\
+	DEFINE_FUNCTION(name##_8,arch)
+
 DEFINE_FUNCTION(copy8d, c);
 DEFINE_FUNCTION(copy8, c);
 DEFINE_FUNCTION(copy16d, c);
@@ -186,10 +202,79 @@ DEFINE_FUNCTION(interleave_8, c);
 DEFINE_FUNCTION(interleave_16, c);
 DEFINE_FUNCTION(interleave_24, c);
 DEFINE_FUNCTION(interleave_32, c);
+DEFINE_FUNCTION(s24s_to_f32, c);
+DEFINE_FUNCTION(f32_to_s24s, c);
+DEFINE_FUNCTION(f32d_to_s16_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s16_shaped, c);
+DEFINE_FUNCTION(f32d_to_s16d_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s16d_shaped, c);
+DEFINE_FUNCTION(f32d_to_s24_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s24_shaped, c);
+DEFINE_FUNCTION(f32d_to_s24d_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s24d_shaped, c);
+DEFINE_FUNCTION(f32d_to_s24_32_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s24_32_shaped, c);
+DEFINE_FUNCTION(f32d_to_s24_32d_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s24_32d_shaped, c);
+DEFINE_FUNCTION(f32d_to_s32_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s32_shaped, c);
+DEFINE_FUNCTION(f32d_to_s32d_tpdf, c);
+DEFINE_FUNCTION(f32d_to_s32d_shaped, c);
+DEFINE_FUNCTION_N(u8_to_f32d, c);
+DEFINE_FUNCTION_N(s16_to_f32d, c);
+DEFINE_FUNCTION_N(s24_to_f32d, c);
+DEFINE_FUNCTION_N(s24s_to_f32d, c);
+DEFINE_FUNCTION_N(s24_32_to_f32d, c);
+DEFINE_FUNCTION_N(s32_to_f32d, c);
+DEFINE_FUNCTION_N(f32_to_u8d, c);
+DEFINE_FUNCTION_N(f32_to_s16d, c);
+DEFINE_FUNCTION_N(f32_to_s24d, c);
+DEFINE_FUNCTION_N(f32_to_s24_32d, c);
+DEFINE_FUNCTION_N(f32_to_s32d, c);
+DEFINE_FUNCTION_N(deinterleave_8, c);
+DEFINE_FUNCTION_N(deinterleave_16, c);
+DEFINE_FUNCTION_N(deinterleave_24, c);
+DEFINE_FUNCTION_N(deinterleave_32, c);
+DEFINE_FUNCTION_N(u8d_to_f32, c);
+DEFINE_FUNCTION_N(s16d_to_f32, c);
+DEFINE_FUNCTION_N(s24d_to_f32, c);
+DEFINE_FUNCTION_N(s24_32d_to_f32, c);
+DEFINE_FUNCTION_N(s32d_to_f32, c);
+DEFINE_FUNCTION_N(f32d_to_u8, c);
+DEFINE_FUNCTION_N(f32d_to_s16, c);
+DEFINE_FUNCTION_N(f32d_to_s24, c);
+DEFINE_FUNCTION_N(f32d_to_s24s, c);
+DEFINE_FUNCTION_N(f32d_to_s24_32, c);
+DEFINE_FUNCTION_N(f32d_to_s32, c);
+DEFINE_FUNCTION_N(interleave_8, c);
+DEFINE_FUNCTION_N(interleave_16, c);
+DEFINE_FUNCTION_N(interleave_24, c);
+DEFINE_FUNCTION_N(interleave_32, c);
 
 #if defined(HAVE_NEON)
 DEFINE_FUNCTION(s16_to_f32d, neon);
 DEFINE_FUNCTION(f32d_to_s16, neon);
+DEFINE_FUNCTION(u8_to_f32, neon);
+DEFINE_FUNCTION(u8d_to_f32d, neon);
+DEFINE_FUNCTION(s16_to_f32, neon);
+DEFINE_FUNCTION(s16d_to_f32d, neon);
+DEFINE_FUNCTION(s24_32_to_f32, neon);
+DEFINE_FUNCTION(s24_32d_to_f32d, neon);
+DEFINE_FUNCTION(s32_to_f32, neon);
+DEFINE_FUNCTION(s32d_to_f32d, neon);
+DEFINE_FUNCTION_N(u8_to_f32d, neon);
+DEFINE_FUNCTION_N(s24_32_to_f32d, neon);
+DEFINE_FUNCTION_N(s32_to_f32d, neon);
+DEFINE_FUNCTION_N(deinterleave_8, neon);
+DEFINE_FUNCTION_N(deinterleave_16, neon);
+DEFINE_FUNCTION_N(deinterleave_32, neon);
+DEFINE_FUNCTION_N(u8d_to_f32, neon);
+DEFINE_FUNCTION_N(s16d_to_f32, neon);
+DEFINE_FUNCTION_N(s24_32d_to_f32, neon);
+DEFINE_FUNCTION_N(s32d_to_f32, neon);
+DEFINE_FUNCTION_N(interleave_8, neon);
+DEFINE_FUNCTION_N(interleave_16, neon);
+DEFINE_FUNCTION_N(interleave_32, neon);
 #endif
 #if defined(HAVE_SSE2)
 DEFINE_FUNCTION(s16_to_f32d_2, sse2);
@@ -217,4 +302,44 @@ DEFINE_FUNCTION(f32d_to_s32, avx2);
 DEFINE_FUNCTION(f32d_to_s16_4, avx2);
 DEFINE_FUNCTION(f32d_to_s16_2, avx2);
 DEFINE_FUNCTION(f32d_to_s16, avx2);
+DEFINE_FUNCTION(u8_to_f32, avx2);
+DEFINE_FUNCTION(u8d_to_f32d, avx2);
+DEFINE_FUNCTION(s16_to_f32, avx2);
+DEFINE_FUNCTION(s16d_to_f32d, avx2);
+DEFINE_FUNCTION(s24_32_to_f32, avx2);
+DEFINE_FUNCTION(s24_32d_to_f32d, avx2);
+DEFINE_FUNCTION(s32_to_f32, avx2);
+DEFINE_FUNCTION(s32d_to_f32d, avx2);
+DEFINE_FUNCTION_N(u8_to_f32d, avx2);
+DEFINE_FUNCTION(s16_to_f32d_1, avx2);
+DEFINE_FUNCTION(s16_to_f32d_4, avx2);
+DEFINE_FUNCTION(s16_to_f32d_8, avx2);
+DEFINE_FUNCTION_N(s24_32_to_f32d, avx2);
+DEFINE_FUNCTION(s32_to_f32d_1, avx2);
+DEFINE_FUNCTION_N(deinterleave_8, avx2);
+DEFINE_FUNCTION_N(deinterleave_16, avx2);
+DEFINE_FUNCTION_N(deinterleave_32, avx2);
+DEFINE_FUNCTION_N(u8d_to_f32, avx2);
+DEFINE_FUNCTION_N(s16d_to_f32, avx2);
+DEFINE_FUNCTION_N(s24_32d_to_f32, avx2);
+DEFINE_FUNCTION_N(s32d_to_f32, avx2);
+DEFINE_FUNCTION_N(interleave_8, avx2);
+DEFINE_FUNCTION_N(interleave_16, avx2);
+DEFINE_FUNCTION_N(interleave_32, avx2);
+DEFINE_FUNCTION(f32d_to_s16_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s16_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s16d_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s16d_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s24_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s24_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s24d_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s24d_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32d_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s24_32d_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s32_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s32_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s32d_tpdf, avx2);
+DEFINE_FUNCTION(f32d_to_s32d_shaped, avx2);
 #endif
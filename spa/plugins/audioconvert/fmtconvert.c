@@ -54,7 +54,7 @@
 #define MAX_DATAS	SPA_AUDIO_MAX_CHANNELS
 
 #define PROP_DEFAULT_TRUNCATE	false
-#define PROP_DEFAULT_DITHER	0
+#define PROP_DEFAULT_DITHER	DITHER_METHOD_NONE
 
 struct impl;
 
@@ -69,6 +69,15 @@ static void props_reset(struct props *props)
 	props->dither = PROP_DEFAULT_DITHER;
 }
 
+static uint32_t dither_method_from_label(const char *label)
+{
+	if (strcmp(label, "triangular") == 0)
+		return DITHER_METHOD_TRIANGULAR;
+	else if (strcmp(label, "shaped") == 0)
+		return DITHER_METHOD_SHAPED;
+	return DITHER_METHOD_NONE;
+}
+
 struct buffer {
 	uint32_t id;
 #define BUFFER_FLAG_OUT		(1 << 0)
@@ -194,14 +203,16 @@ static int setup_convert(struct impl *this)
 	this->conv.dst_fmt = dst_fmt;
 	this->conv.n_channels = outformat.info.raw.channels;
 	this->conv.cpu_flags = this->cpu_flags;
+	this->conv.method = this->props.dither;
 
 	if ((res = convert_init(&this->conv)) < 0)
 		return res;
 
 	this->is_passthrough = this->conv.is_passthrough;
 
-	spa_log_debug(this->log, NAME " %p: got converter features %08x:%08x passthrough:%d", this,
-			this->cpu_flags, this->conv.cpu_flags, this->is_passthrough);
+	spa_log_debug(this->log, NAME " %p: got converter features %08x:%08x dither:%d passthrough:%d",
+			this, this->cpu_flags, this->conv.cpu_flags, this->conv.method,
+			this->is_passthrough);
 
 	return 0;
 }
@@ -995,6 +1006,7 @@ impl_init(const struct spa_handle_factory *factory,
 	  uint32_t n_support)
 {
 	struct impl *this;
+	const char *str;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -1023,6 +1035,11 @@ impl_init(const struct spa_handle_factory *factory,
 	this->info.n_params = 0;
 	props_reset(&this->props);
 
+	if (info != NULL) {
+		if ((str = spa_dict_lookup(info, "dither.method")) != NULL)
+			this->props.dither = dither_method_from_label(str);
+	}
+
 	init_port(this, SPA_DIRECTION_OUTPUT, 0);
 	init_port(this, SPA_DIRECTION_INPUT, 0);
 
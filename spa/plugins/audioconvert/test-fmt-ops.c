@@ -328,6 +328,159 @@ static void test_s24_32_f32(void)
 			false, false, conv_s24_32d_to_f32d_c);
 }
 
+static uint8_t temp_ref[N_SAMPLES * N_CHANNELS * 4];
+
+/* compare a converter for a fixed number of channels against the generic
+ * one */
+static void run_test_n(const char *name, size_t in_size, size_t out_size,
+		bool in_float, bool in_packed, bool out_packed,
+		convert_func_t ref, convert_func_t func, uint32_t n_channels)
+{
+	const void *ip[N_CHANNELS];
+	void *rp[N_CHANNELS], *tp[N_CHANNELS];
+	struct convert conv;
+	uint32_t i;
+
+	conv.n_channels = n_channels;
+
+	if (in_float) {
+		float *f = (float *) temp_in;
+		for (i = 0; i < N_SAMPLES * N_CHANNELS; i++)
+			f[i] = ((int32_t)(i * 2654435761u) / 2147483648.0f) * 1.1f;
+	} else {
+		for (i = 0; i < sizeof(temp_in); i++)
+			temp_in[i] = i * 2654435761u >> 24;
+	}
+	for (i = 0; i < n_channels; i++) {
+		ip[i] = in_packed ? temp_in : &temp_in[i * N_SAMPLES * in_size];
+		rp[i] = out_packed ? temp_ref : &temp_ref[i * N_SAMPLES * out_size];
+		tp[i] = out_packed ? temp_out : &temp_out[i * N_SAMPLES * out_size];
+	}
+	spa_zero(temp_ref);
+	spa_zero(temp_out);
+
+	fprintf(stderr, "test %s %d:\n", name, n_channels);
+	ref(&conv, rp, ip, N_SAMPLES);
+	func(&conv, tp, ip, N_SAMPLES);
+
+	spa_assert(memcmp(temp_ref, temp_out, N_SAMPLES * n_channels * out_size) == 0);
+}
+
+#define run_test_channels(name,in_size,out_size,in_float,in_packed,out_packed,ref,func,arch)	\
+({												\
+	run_test_n(name, in_size, out_size, in_float, in_packed, out_packed,			\
+			ref, conv_##func##_1_##arch, 1);					\
+	run_test_n(name, in_size, out_size, in_float, in_packed, out_packed,			\
+			ref, conv_##func##_2_##arch, 2);					\
+	run_test_n(name, in_size, out_size, in_float, in_packed, out_packed,			\
+			ref, conv_##func##_4_##arch, 4);					\
+	run_test_n(name, in_size, out_size, in_float, in_packed, out_packed,			\
+			ref, conv_##func##_8_##arch, 8);					\
+})
+
+static void test_channels(void)
+{
+	run_test_channels("test_u8_f32d_n", 1, 4, false, true, false,
+			conv_u8_to_f32d_c, u8_to_f32d, c);
+	run_test_channels("test_s16_f32d_n", 2, 4, false, true, false,
+			conv_s16_to_f32d_c, s16_to_f32d, c);
+	run_test_channels("test_s24_f32d_n", 3, 4, false, true, false,
+			conv_s24_to_f32d_c, s24_to_f32d, c);
+	run_test_channels("test_s24s_f32d_n", 3, 4, false, true, false,
+			conv_s24s_to_f32d_c, s24s_to_f32d, c);
+	run_test_channels("test_s32d_f32_n", 4, 4, false, false, true,
+			conv_s32d_to_f32_c, s32d_to_f32, c);
+	run_test_channels("test_f32_s16d_n", 4, 2, true, true, false,
+			conv_f32_to_s16d_c, f32_to_s16d, c);
+	run_test_channels("test_f32d_s24_n", 4, 3, true, false, true,
+			conv_f32d_to_s24_c, f32d_to_s24, c);
+	run_test_channels("test_f32d_s24s_n", 4, 3, true, false, true,
+			conv_f32d_to_s24s_c, f32d_to_s24s, c);
+	run_test_channels("test_f32d_u8_n", 4, 1, true, false, true,
+			conv_f32d_to_u8_c, f32d_to_u8, c);
+	run_test_channels("test_deinterleave_24_n", 3, 3, false, true, false,
+			conv_deinterleave_24_c, deinterleave_24, c);
+	run_test_channels("test_interleave_16_n", 2, 2, false, false, true,
+			conv_interleave_16_c, interleave_16, c);
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test_n("test_s16_f32d_1_avx2", 2, 4, false, true, false,
+				conv_s16_to_f32d_c, conv_s16_to_f32d_1_avx2, 1);
+		run_test_n("test_s16_f32d_4_avx2", 2, 4, false, true, false,
+				conv_s16_to_f32d_c, conv_s16_to_f32d_4_avx2, 4);
+		run_test_channels("test_u8d_f32_n_avx2", 1, 4, false, false, true,
+				conv_u8d_to_f32_c, u8d_to_f32, avx2);
+		run_test_channels("test_s24_32_f32d_n_avx2", 4, 4, false, true, false,
+				conv_s24_32_to_f32d_c, s24_32_to_f32d, avx2);
+		run_test_channels("test_deinterleave_32_n_avx2", 4, 4, false, true, false,
+				conv_deinterleave_32_c, deinterleave_32, avx2);
+		run_test_n("test_s16_f32_avx2", 2, 4, false, true, true,
+				conv_s16_to_f32_c, conv_s16_to_f32_avx2, 2);
+		run_test_n("test_s32d_f32d_avx2", 4, 4, false, false, false,
+				conv_s32d_to_f32d_c, conv_s32d_to_f32d_avx2, 3);
+	}
+#endif
+}
+
+/* dithered output must stay close to the exact value and be the same for
+ * all implementations */
+static void run_test_dither(const char *name, convert_func_t ref, convert_func_t func,
+		bool packed, float max_error)
+{
+	const void *ip[N_CHANNELS];
+	void *rp[N_CHANNELS], *tp[N_CHANNELS];
+	struct convert c1, c2;
+	const float *f = (const float *) temp_in;
+	const int16_t *d = (const int16_t *) temp_ref;
+	uint32_t i, j;
+
+	spa_zero(c1);
+	c1.n_channels = N_CHANNELS;
+	for (i = 0; i < N_CHANNELS; i++)
+		for (j = 0; j < DITHER_LANES; j++)
+			c1.random[i][j] = i * DITHER_LANES + j + 1;
+	c2 = c1;
+
+	for (i = 0; i < N_SAMPLES * N_CHANNELS; i++)
+		((float *) temp_in)[i] = ((int32_t)(i * 2654435761u) / 2147483648.0f) * 0.9f;
+	for (i = 0; i < N_CHANNELS; i++) {
+		ip[i] = &temp_in[i * N_SAMPLES * 4];
+		rp[i] = &temp_ref[i * N_SAMPLES * 2];
+		tp[i] = &temp_out[i * N_SAMPLES * 2];
+	}
+	fprintf(stderr, "test %s:\n", name);
+	ref(&c1, rp, ip, N_SAMPLES);
+	func(&c2, tp, ip, N_SAMPLES);
+
+	for (i = 0; i < N_CHANNELS; i++) {
+		for (j = 0; j < N_SAMPLES; j++) {
+			uint32_t o = packed ? j * N_CHANNELS + i : i * N_SAMPLES + j;
+			spa_assert(fabsf(d[o] - f[i * N_SAMPLES + j] * S16_SCALE) <= max_error);
+		}
+	}
+	spa_assert(memcmp(temp_ref, temp_out, N_SAMPLES * N_CHANNELS * 2) == 0);
+}
+
+static void test_dither(void)
+{
+	run_test_dither("test_f32d_s16d_tpdf", conv_f32d_to_s16d_tpdf_c,
+			conv_f32d_to_s16d_tpdf_c, false, 1.5f);
+	run_test_dither("test_f32d_s16_tpdf", conv_f32d_to_s16_tpdf_c,
+			conv_f32d_to_s16_tpdf_c, true, 1.5f);
+	run_test_dither("test_f32d_s16d_shaped", conv_f32d_to_s16d_shaped_c,
+			conv_f32d_to_s16d_shaped_c, false, 14.0f);
+#if defined(HAVE_AVX2)
+	if (cpu_flags & SPA_CPU_FLAG_AVX2) {
+		run_test_dither("test_f32d_s16d_tpdf_avx2", conv_f32d_to_s16d_tpdf_c,
+				conv_f32d_to_s16d_tpdf_avx2, false, 1.5f);
+		run_test_dither("test_f32d_s16_tpdf_avx2", conv_f32d_to_s16_tpdf_c,
+				conv_f32d_to_s16_tpdf_avx2, true, 1.5f);
+		run_test_dither("test_f32d_s16d_shaped_avx2", conv_f32d_to_s16d_shaped_c,
+				conv_f32d_to_s16d_shaped_avx2, false, 14.0f);
+	}
+#endif
+}
+
 int main(int argc, char *argv[])
 {
 	cpu_flags = get_cpu_flags();
@@ -343,5 +496,7 @@ int main(int argc, char *argv[])
 	test_s24_f32();
 	test_f32_s24_32();
 	test_s24_32_f32();
+	test_channels();
+	test_dither();
 	return 0;
 }
@@ -36,16 +36,22 @@ mix_f32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 {
 	uint32_t i, n;
 	float *d = dst;
+	const float **s = (const float **)src;
 
-	if (n_src == 0)
+	if (n_src == 0) {
 		memset(dst, 0, n_samples * sizeof(float));
-	else if (dst != src[0])
-		memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	} else if (n_src == 1) {
+		if (dst != src[0])
+			memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
 
-	for (i = 1; i < n_src; i++) {
-		const float *s = src[i];
-		for (n = 0; n < n_samples; n++)
-			d[n] += s[n];
+	for (n = 0; n < n_samples; n++) {
+		float sum = s[0][n];
+		for (i = 1; i < n_src; i++)
+			sum += s[i][n];
+		d[n] = sum;
 	}
 }
 
@@ -50,6 +50,10 @@ static struct mix_info mix_table[] =
 	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
 	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
 #endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_NEON, 4, mix_f32_neon },
+	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_NEON, 4, mix_f32_neon },
+#endif
 #if defined (HAVE_SSE)
 	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_SSE, 4, mix_f32_sse },
 	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_SSE, 4, mix_f32_sse },
@@ -0,0 +1,132 @@
+/* Spa
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <spa/utils/defs.h>
+
+#include "../audioconvert/test-helper.h"
+#include "mix-ops.c"
+
+#define N_SAMPLES	1029
+#define N_SOURCES	17
+
+static uint32_t cpu_flags;
+
+static float samp_in[N_SOURCES][N_SAMPLES + 8] SPA_ALIGNED(32);
+static float samp_out[N_SAMPLES + 8] SPA_ALIGNED(32);
+static float samp_ref[N_SAMPLES + 8] SPA_ALIGNED(32);
+
+static void run_test(const struct mix_info *info, uint32_t n_src,
+		uint32_t offset, bool inplace)
+{
+	struct mix_ops ops;
+	const void *src[N_SOURCES];
+	uint32_t i, n, n_samples = N_SAMPLES;
+	float *dst;
+
+	spa_zero(ops);
+	ops.priv = info;
+
+	for (i = 0; i < n_src; i++)
+		src[i] = &samp_in[i][offset];
+
+	/* reference, summed in the same order as the kernels */
+	for (n = 0; n < n_samples; n++) {
+		float sum = 0.0f;
+		if (n_src > 0) {
+			sum = samp_in[0][offset + n];
+			for (i = 1; i < n_src; i++)
+				sum += samp_in[i][offset + n];
+		}
+		samp_ref[n] = sum;
+	}
+
+	if (inplace && n_src > 0) {
+		static float tmp[N_SAMPLES + 8] SPA_ALIGNED(32);
+		memcpy(&tmp[offset], src[0], n_samples * sizeof(float));
+		src[0] = dst = &tmp[offset];
+	} else {
+		dst = &samp_out[offset];
+		for (n = 0; n < n_samples; n++)
+			dst[n] = 1.0f;
+	}
+
+	info->process(&ops, dst, src, n_src, n_samples);
+
+	for (n = 0; n < n_samples; n++) {
+		if (dst[n] != samp_ref[n]) {
+			fprintf(stderr, "cpu:%08x n_src:%u offset:%u inplace:%d sample %u: %f != %f\n",
+					info->cpu_flags, n_src, offset, inplace, n,
+					dst[n], samp_ref[n]);
+			spa_assert(dst[n] == samp_ref[n]);
+		}
+	}
+}
+
+static void test_f32(void)
+{
+	size_t i;
+	uint32_t n_src, offset;
+
+	for (i = 0; i < SPA_N_ELEMENTS(mix_table); i++) {
+		const struct mix_info *info = &mix_table[i];
+
+		if (info->fmt != SPA_AUDIO_FORMAT_F32 ||
+		    !MATCH_CPU_FLAGS(info->cpu_flags, cpu_flags))
+			continue;
+
+		for (n_src = 0; n_src <= N_SOURCES; n_src++) {
+			for (offset = 0; offset < 8; offset += 3) {
+				run_test(info, n_src, offset, false);
+				run_test(info, n_src, offset, true);
+			}
+		}
+		fprintf(stderr, "test f32 cpu:%08x OK\n", info->cpu_flags);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i, n;
+
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
+	srand(0);
+	for (i = 0; i < N_SOURCES; i++)
+		for (n = 0; n < N_SAMPLES + 8; n++)
+			samp_in[i][n] = (float)rand() / RAND_MAX - 0.5f;
+
+	test_f32();
+
+	return 0;
+}
@@ -52,6 +52,7 @@
 #include "defs.h"
 #include "rtp.h"
 #include "a2dp-codecs.h"
+#include "rate-control.h"
 
 struct codec;
 
@@ -124,7 +125,11 @@ struct impl {
 
 	uint64_t current_time;
 	uint64_t next_time;
-	uint64_t last_error;
+
+	struct rate_control rate_control;
+	uint64_t write_blocked;
+	uint32_t queued;
+	unsigned int codec_abr:1;
 
 	const struct a2dp_codec *codec;
 	void *codec_data;
@@ -342,6 +347,13 @@ static int reset_buffer(struct impl *this)
 	return 0;
 }
 
+static uint64_t get_time(struct impl *this)
+{
+	struct timespec now;
+	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_NSEC(&now);
+}
+
 static int get_transport_unused_size(struct impl *this)
 {
 	int res, value;
@@ -356,11 +368,11 @@ static int get_transport_unused_size(struct impl *this)
 
 static int send_buffer(struct impl *this)
 {
-	int written, unsent;
-	unsent = get_transport_unused_size(this);
-	if (unsent >= 0) {
-		unsent = this->fd_buffer_size - unsent;
-		this->codec->abr_process(this->codec_data, unsent);
+	int written, unused;
+	unused = get_transport_unused_size(this);
+	if (unused >= 0) {
+		this->queued = rate_control_queued(unused, this->fd_buffer_size);
+		this->codec_abr = this->codec->abr_process(this->codec_data, this->queued) >= 0;
 		update_num_blocks(this);
 	}
 
@@ -471,6 +483,36 @@ static void enable_flush(struct impl *this, bool enabled)
 	}
 }
 
+static void update_rate_control(struct impl *this, uint64_t now_time,
+		uint32_t queued, uint64_t latency)
+{
+	int res;
+
+	/* the codec does its own bitrate adaption */
+	if (this->codec_abr)
+		return;
+
+	switch (rate_control_update(&this->rate_control, now_time,
+				queued, this->fd_buffer_size, latency)) {
+	case RATE_CONTROL_REDUCE:
+		res = this->codec->reduce_bitpool(this->codec_data);
+		break;
+	case RATE_CONTROL_INCREASE:
+		res = this->codec->increase_bitpool(this->codec_data);
+		break;
+	default:
+		return;
+	}
+	if (res < 0)
+		return;
+
+	update_num_blocks(this);
+
+	spa_log_debug(this->log, NAME " %p: quality:%d queued:%u/%u latency:%"PRIu64
+			" num_blocks:%u", this, res, queued, this->fd_buffer_size,
+			latency, this->num_blocks);
+}
+
 static int flush_data(struct impl *this, uint64_t now_time)
 {
 	int written;
@@ -546,11 +588,10 @@ again:
 	written = flush_buffer(this, true);
 	if (written == -EAGAIN) {
 		spa_log_trace(this->log, NAME" %p: delay flush", this);
-		if (now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
-			this->codec->reduce_bitpool(this->codec_data);
-			update_num_blocks(this);
-			this->last_error = now_time;
-		}
+		if (this->write_blocked == 0)
+			this->write_blocked = now_time;
+		update_rate_control(this, now_time, this->fd_buffer_size,
+				now_time - this->write_blocked);
 		enable_flush(this, true);
 	}
 	else if (written < 0) {
@@ -559,11 +600,13 @@ again:
 		return written;
 	}
 	else if (written > 0) {
-		if (now_time - this->last_error > SPA_NSEC_PER_SEC) {
-			this->codec->increase_bitpool(this->codec_data);
-			update_num_blocks(this);
-			this->last_error = now_time;
+		uint64_t latency = 0;
+
+		if (this->write_blocked != 0) {
+			latency = now_time - this->write_blocked;
+			this->write_blocked = 0;
 		}
+		update_rate_control(this, now_time, this->queued, latency);
 		if (!spa_list_is_empty(&port->ready))
 			goto again;
 
@@ -584,7 +627,7 @@ static void a2dp_on_flush(struct spa_source *source)
 			spa_loop_remove_source(this->data_loop, &this->flush_source);
 		return;
 	}
-	flush_data(this, this->current_time);
+	flush_data(this, get_time(this));
 }
 
 static void a2dp_on_timeout(struct spa_source *source)
@@ -674,6 +717,10 @@ static int do_start(struct impl *this)
         spa_log_info(this->log, NAME " %p: using A2DP codec %s", this, this->codec->description);
 
 	this->seqnum = 0;
+	this->write_blocked = 0;
+	this->queued = 0;
+	this->codec_abr = false;
+	rate_control_init(&this->rate_control, get_time(this));
 
 	this->block_size = this->codec->get_block_size(this->codec_data);
 	this->num_blocks = this->codec->get_num_blocks(this->codec_data);
@@ -1204,7 +1251,7 @@ static int impl_node_process(void *object)
 		io->status = SPA_STATUS_OK;
 	}
 	if (!spa_list_is_empty(&port->ready))
-		flush_data(this, this->current_time);
+		flush_data(this, get_time(this));
 
 	return SPA_STATUS_HAVE_DATA;
 }
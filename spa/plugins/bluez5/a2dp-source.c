@@ -53,6 +53,7 @@
 #include "defs.h"
 #include "rtp.h"
 #include "a2dp-codecs.h"
+#include "jitter-buffer.h"
 
 struct props {
 	uint32_t min_latency;
@@ -78,6 +79,7 @@ struct port {
 	uint64_t info_all;
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
+	struct spa_io_rate_match *rate_match;
 	struct spa_param_info params[8];
 
 	struct buffer buffers[MAX_BUFFERS];
@@ -125,6 +127,8 @@ struct impl {
 	uint8_t buffer_read[4096];
 	struct timespec now;
 	uint32_t sample_count;
+
+	struct jitter_buffer jitter;
 };
 
 #define NAME "a2dp-source"
@@ -224,6 +228,19 @@ static int do_reassing_follower(struct spa_loop *loop,
 			size_t size,
 			void *user_data)
 {
+	struct impl *this = user_data;
+	struct port *port = &this->port;
+	struct buffer *b;
+
+	/* buffers queued for the driver path are not used when following */
+	spa_list_consume(b, &port->ready, link) {
+		spa_list_remove(&b->link);
+		spa_list_append(&port->free, &b->link);
+	}
+	port->n_ready = 0;
+	port->buffering = true;
+
+	jitter_buffer_reset(&this->jitter);
 	return 0;
 }
 
@@ -421,6 +438,12 @@ static void a2dp_on_ready_read(struct spa_source *source)
 	if (!this->started)
 		return;
 
+	/* the graph pulls from the jitter buffer when following */
+	if (this->following) {
+		jitter_buffer_write(&this->jitter, read_decoded, decoded);
+		return;
+	}
+
 	/* get buffer */
 	if (spa_list_is_empty(&port->free)) {
 		spa_log_warn(this->log, "no buffer available");
@@ -538,6 +561,7 @@ static int transport_start(struct impl *this)
 	spa_loop_add_source(this->data_loop, &this->source);
 
 	this->sample_count = 0;
+	jitter_buffer_reset(&this->jitter);
 
 	return 0;
 }
@@ -816,6 +840,12 @@ impl_node_port_enum_params(void *object, int seq,
 				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
 				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
 			break;
+		case 1:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_RateMatch),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_rate_match)));
+			break;
 		default:
 			return 0;
 		}
@@ -892,6 +922,9 @@ static int port_set_format(struct impl *this, struct port *port,
 
 		port->current_format = info;
 		port->have_format = true;
+
+		jitter_buffer_set_format(&this->jitter, port->frame_size,
+				info.info.raw.rate);
 	}
 
 	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
@@ -999,6 +1032,9 @@ impl_node_port_set_io(void *object,
 	case SPA_IO_Buffers:
 		port->io = data;
 		break;
+	case SPA_IO_RateMatch:
+		port->rate_match = data;
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -1026,6 +1062,54 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return 0;
 }
 
+static struct buffer *read_jitter_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct spa_io_position *pos = this->position;
+	struct buffer *buffer;
+	struct spa_data *datas;
+	uint32_t n_frames, period;
+	double corr;
+
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_warn(this->log, NAME " %p: no buffer available", this);
+		return NULL;
+	}
+	buffer = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&buffer->link);
+	datas = buffer->buf->datas;
+
+	/* the resampler asks for a few frames more or less to correct the
+	 * rate, the DLL runs on the graph period */
+	period = pos->clock.duration * port->current_format.info.raw.rate /
+		pos->clock.rate.denom;
+	if (port->rate_match && port->rate_match->size > 0)
+		n_frames = port->rate_match->size;
+	else
+		n_frames = period;
+	n_frames = SPA_MIN(n_frames, datas[0].maxsize / port->frame_size);
+
+	corr = jitter_buffer_update(&this->jitter, pos->clock.nsec, period, n_frames);
+	if (port->rate_match) {
+		port->rate_match->rate = SPA_CLAMP(1.0/corr, 0.95, 1.05);
+		SPA_FLAG_SET(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+	}
+	jitter_buffer_read(&this->jitter, datas[0].data, n_frames);
+
+	if (buffer->h) {
+		buffer->h->seq = this->sample_count;
+		buffer->h->pts = pos->clock.nsec;
+		buffer->h->dts_offset = 0;
+	}
+	datas[0].chunk->offset = 0;
+	datas[0].chunk->size = n_frames * port->frame_size;
+	datas[0].chunk->stride = port->frame_size;
+
+	this->sample_count += n_frames;
+
+	return buffer;
+}
+
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
@@ -1051,6 +1135,12 @@ static int impl_node_process(void *object)
 		io->buffer_id = SPA_ID_INVALID;
 	}
 
+	if (this->following && this->started && port->have_format) {
+		if ((buffer = read_jitter_buffer(this)) == NULL)
+			return SPA_STATUS_OK;
+		goto done;
+	}
+
 	/* Return if there are no buffers ready to be processed */
 	if (spa_list_is_empty(&port->ready))
 		return SPA_STATUS_OK;
@@ -1064,6 +1154,8 @@ static int impl_node_process(void *object)
 	spa_list_remove(&buffer->link);
 	if (--port->n_ready == 0)
 		port->buffering = true;
+
+done:
 	buffer->outstanding = true;
 
 	/* Set the new buffer in IO */
@@ -1173,6 +1265,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	struct port *port;
 	const char *str;
+	uint32_t latency = JITTER_BUFFER_DEFAULT_LATENCY;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -1239,6 +1332,10 @@ impl_init(const struct spa_handle_factory *factory,
 
 	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_BLUEZ5_TRANSPORT)))
 		sscanf(str, "pointer:%p", &this->transport);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_BLUEZ5_JITTER_LATENCY)))
+		latency = atoi(str);
+
+	jitter_buffer_init(&this->jitter, this->log, latency);
 
 	if (this->transport == NULL) {
 		spa_log_error(this->log, "a transport is needed");
@@ -1282,7 +1379,8 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 static const struct spa_dict_item info_items[] = {
 	{ SPA_KEY_FACTORY_AUTHOR, "Collabora Ltd. <contact@collabora.com>" },
 	{ SPA_KEY_FACTORY_DESCRIPTION, "Capture bluetooth audio with a2dp" },
-	{ SPA_KEY_FACTORY_USAGE, SPA_KEY_API_BLUEZ5_TRANSPORT"=<transport>" },
+	{ SPA_KEY_FACTORY_USAGE, SPA_KEY_API_BLUEZ5_TRANSPORT"=<transport> "
+		"["SPA_KEY_API_BLUEZ5_JITTER_LATENCY"=<msec>]" },
 };
 
 static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
@@ -0,0 +1,211 @@
+/* Spa Bluez5 Monitor
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef SPA_BLUEZ5_JITTER_BUFFER_H
+#define SPA_BLUEZ5_JITTER_BUFFER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/support/log.h>
+
+#include "../alsa/dll.h"
+
+/* Jitter buffer for the bluetooth sources.
+ *
+ * Decoded packets are written into the ringbuffer as they arrive from the
+ * socket. When the node is following another driver, the graph pulls a
+ * quantum from the buffer in each cycle. The difference between the fill
+ * level and the target latency is fed into a DLL and the resulting
+ * correction is given to the resampler of the adapter, so that the graph
+ * consumes exactly as fast as the remote device produces.
+ *
+ * The buffer starts (and restarts after an underrun) in buffering mode,
+ * where silence is produced until the target level is reached.
+ */
+#define JITTER_BUFFER_SIZE		(1u << 16)
+#define JITTER_BUFFER_DEFAULT_LATENCY	40	/* milliseconds */
+#define JITTER_BUFFER_BW_PERIOD		(3 * (uint64_t)SPA_NSEC_PER_SEC)
+
+struct jitter_buffer {
+	struct spa_log *log;
+
+	struct spa_ringbuffer ring;
+	uint32_t frame_size;
+	uint32_t rate;
+	uint32_t latency;		/**< target latency in milliseconds */
+	uint32_t target;		/**< target fill level in frames */
+	uint32_t period;		/**< graph period in frames */
+
+	struct spa_dll dll;
+	uint64_t base_time;
+	double corr;
+
+	uint32_t underruns;
+	uint32_t overruns;
+	unsigned int buffering:1;
+
+	uint8_t data[JITTER_BUFFER_SIZE];
+};
+
+static inline void jitter_buffer_reset(struct jitter_buffer *jb)
+{
+	spa_ringbuffer_init(&jb->ring);
+	spa_dll_init(&jb->dll);
+	jb->period = 0;
+	jb->corr = 1.0;
+	jb->buffering = true;
+}
+
+static inline void jitter_buffer_init(struct jitter_buffer *jb, struct spa_log *log,
+		uint32_t latency)
+{
+	jb->log = log;
+	jb->frame_size = 0;
+	jb->rate = 0;
+	jb->target = 0;
+	jb->latency = latency;
+	jb->underruns = 0;
+	jb->overruns = 0;
+	jitter_buffer_reset(jb);
+}
+
+/** configure the sample format, this resets the buffer */
+static inline void jitter_buffer_set_format(struct jitter_buffer *jb,
+		uint32_t frame_size, uint32_t rate)
+{
+	jb->frame_size = frame_size;
+	jb->rate = rate;
+	jb->target = SPA_MIN((uint64_t)jb->latency * rate / 1000,
+			JITTER_BUFFER_SIZE / frame_size / 2);
+	jitter_buffer_reset(jb);
+}
+
+static inline uint32_t jitter_buffer_avail(struct jitter_buffer *jb)
+{
+	uint32_t index;
+	int32_t filled = spa_ringbuffer_get_read_index(&jb->ring, &index);
+	return filled > 0 ? filled / jb->frame_size : 0;
+}
+
+/** append decoded data, the oldest data is dropped when the buffer is full */
+static inline void jitter_buffer_write(struct jitter_buffer *jb,
+		const void *data, uint32_t size)
+{
+	uint32_t index;
+	int32_t filled;
+
+	if (jb->frame_size == 0 || size == 0)
+		return;
+
+	size = SPA_MIN(size, JITTER_BUFFER_SIZE);
+	size -= size % jb->frame_size;
+
+	filled = spa_ringbuffer_get_write_index(&jb->ring, &index);
+	if (filled + size > JITTER_BUFFER_SIZE) {
+		uint32_t read_index, drop;
+
+		spa_ringbuffer_get_read_index(&jb->ring, &read_index);
+		drop = filled + size - JITTER_BUFFER_SIZE;
+		drop += (jb->frame_size - drop % jb->frame_size) % jb->frame_size;
+		spa_ringbuffer_read_update(&jb->ring, read_index + drop);
+		jb->overruns++;
+		spa_log_debug(jb->log, "jitter buffer %p: overrun, dropped %u bytes", jb, drop);
+	}
+	spa_ringbuffer_write_data(&jb->ring, jb->data, JITTER_BUFFER_SIZE,
+			index % JITTER_BUFFER_SIZE, data, size);
+	spa_ringbuffer_write_update(&jb->ring, index + size);
+}
+
+/** update the DLL with the fill level before reading \a n_frames frames.
+ * \param nsec the time of the graph cycle
+ * \param period the graph period in frames
+ * \param n_frames the frames that will be read, this follows the rate
+ *   correction and changes a little in each cycle
+ * \return the rate correction for the consumer
+ */
+static inline double jitter_buffer_update(struct jitter_buffer *jb, uint64_t nsec,
+		uint32_t period, uint32_t n_frames)
+{
+	uint32_t avail = jitter_buffer_avail(jb);
+	double err;
+
+	if (jb->buffering) {
+		if (avail < jb->target + n_frames)
+			return jb->corr;
+		spa_log_debug(jb->log, "jitter buffer %p: buffering done avail:%u target:%u",
+				jb, avail, jb->target);
+		jb->buffering = false;
+	}
+
+	err = (double)(jb->target + period) - avail;
+
+	/* only a new graph period restarts the DLL, like alsa-pcm */
+	if (SPA_UNLIKELY(jb->dll.bw == 0.0 || jb->period != period)) {
+		spa_dll_set_bw(&jb->dll, SPA_DLL_BW_MAX, period, jb->rate);
+		jb->period = period;
+		jb->base_time = nsec;
+	}
+	jb->corr = spa_dll_update(&jb->dll, err);
+
+	if (SPA_UNLIKELY(nsec - jb->base_time > JITTER_BUFFER_BW_PERIOD)) {
+		jb->base_time = nsec;
+		if (jb->dll.bw > SPA_DLL_BW_MIN)
+			spa_dll_set_bw(&jb->dll, jb->dll.bw / 2.0, period, jb->rate);
+
+		spa_log_debug(jb->log, "jitter buffer %p: rate:%f bw:%f avail:%u target:%u "
+				"err:%f underruns:%u overruns:%u", jb, jb->corr, jb->dll.bw,
+				avail, jb->target, err, jb->underruns, jb->overruns);
+	}
+	return jb->corr;
+}
+
+/** read \a n_frames into \a dst, silence is produced while buffering */
+static inline void jitter_buffer_read(struct jitter_buffer *jb, void *dst, uint32_t n_frames)
+{
+	uint32_t index, avail, size = n_frames * jb->frame_size;
+
+	if (jb->buffering) {
+		memset(dst, 0, size);
+		return;
+	}
+	avail = jitter_buffer_avail(jb) * jb->frame_size;
+	if (avail < size) {
+		memset(SPA_MEMBER(dst, avail, void), 0, size - avail);
+		size = avail;
+		jb->buffering = true;
+		jb->underruns++;
+		spa_log_debug(jb->log, "jitter buffer %p: underrun %u < %u",
+				jb, avail / jb->frame_size, n_frames);
+	}
+	spa_ringbuffer_get_read_index(&jb->ring, &index);
+	spa_ringbuffer_read_data(&jb->ring, jb->data, JITTER_BUFFER_SIZE,
+			index % JITTER_BUFFER_SIZE, dst, size);
+	spa_ringbuffer_read_update(&jb->ring, index + size);
+}
+
+#endif /* SPA_BLUEZ5_JITTER_BUFFER_H */
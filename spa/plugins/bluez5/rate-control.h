@@ -0,0 +1,120 @@
+/* Spa Bluez5 Monitor
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_BLUEZ5_RATE_CONTROL_H
+#define SPA_BLUEZ5_RATE_CONTROL_H
+
+#include <stdint.h>
+
+#include <spa/utils/defs.h>
+
+/* Closed loop quality control for a bluetooth socket.
+ *
+ * After each write, the fill level of the socket send queue and the time
+ * the write was delayed because the socket was full are fed into the
+ * controller. When the link is congested the quality is reduced right away
+ * (at most once per REDUCE_HOLD to let the queue react). The quality is
+ * only increased again when the queue stayed low for the probe interval.
+ * Every reduce doubles the probe interval so that we don't keep bouncing
+ * against the capacity of the link, the interval shrinks again when the
+ * link stays stable.
+ */
+#define RATE_CONTROL_HIGH_FILL		0.5
+#define RATE_CONTROL_LOW_FILL		0.125
+#define RATE_CONTROL_MAX_LATENCY	(40 * (uint64_t)SPA_NSEC_PER_MSEC)
+#define RATE_CONTROL_REDUCE_HOLD	(200 * (uint64_t)SPA_NSEC_PER_MSEC)
+#define RATE_CONTROL_MIN_PROBE		(1 * (uint64_t)SPA_NSEC_PER_SEC)
+#define RATE_CONTROL_MAX_PROBE		(16 * (uint64_t)SPA_NSEC_PER_SEC)
+
+#define RATE_CONTROL_REDUCE	-1
+#define RATE_CONTROL_HOLD	0
+#define RATE_CONTROL_INCREASE	1
+
+struct rate_control {
+	uint64_t last_change;		/**< time of the last quality change */
+	uint64_t last_reduce;		/**< time of the last reduce */
+	uint64_t low_since;		/**< start of the low fill stretch or 0 */
+	uint64_t probe_interval;	/**< time to stay low before increasing */
+};
+
+static inline void rate_control_init(struct rate_control *rc, uint64_t now)
+{
+	rc->last_change = now;
+	rc->last_reduce = now;
+	rc->low_since = 0;
+	rc->probe_interval = RATE_CONTROL_MIN_PROBE;
+}
+
+/** get the number of bytes in the send queue of a bluetooth socket.
+ * TIOCOUTQ on L2CAP sockets returns the free space in the send buffer and
+ * not the bytes that are still queued like it does on other sockets.
+ * \param outq the value returned by TIOCOUTQ
+ * \param queue_size size of the socket send queue (SO_SNDBUF)
+ */
+static inline uint32_t rate_control_queued(int outq, uint32_t queue_size)
+{
+	if (outq < 0 || (uint32_t)outq >= queue_size)
+		return 0;
+	return queue_size - outq;
+}
+
+/** update the controller with the send queue state after a write.
+ * \param queued bytes in the socket send queue
+ * \param queue_size size of the socket send queue
+ * \param latency time the write was delayed because the socket was full
+ * \return RATE_CONTROL_REDUCE, RATE_CONTROL_HOLD or RATE_CONTROL_INCREASE
+ */
+static inline int rate_control_update(struct rate_control *rc, uint64_t now,
+		uint32_t queued, uint32_t queue_size, uint64_t latency)
+{
+	double fill = queue_size > 0 ? (double)queued / queue_size : 0.0;
+
+	if (fill >= RATE_CONTROL_HIGH_FILL || latency >= RATE_CONTROL_MAX_LATENCY) {
+		rc->low_since = 0;
+		if (now - rc->last_change < RATE_CONTROL_REDUCE_HOLD)
+			return RATE_CONTROL_HOLD;
+
+		rc->last_change = rc->last_reduce = now;
+		rc->probe_interval = SPA_MIN(rc->probe_interval * 2, RATE_CONTROL_MAX_PROBE);
+		return RATE_CONTROL_REDUCE;
+	}
+	if (fill > RATE_CONTROL_LOW_FILL || latency > 0) {
+		rc->low_since = 0;
+		return RATE_CONTROL_HOLD;
+	}
+	if (rc->low_since == 0)
+		rc->low_since = now;
+
+	if (now - rc->low_since < rc->probe_interval)
+		return RATE_CONTROL_HOLD;
+
+	/* the link was stable for a while, probe faster again */
+	if (now - rc->last_reduce > 2 * rc->probe_interval)
+		rc->probe_interval = SPA_MAX(rc->probe_interval / 2, RATE_CONTROL_MIN_PROBE);
+
+	rc->last_change = rc->low_since = now;
+	return RATE_CONTROL_INCREASE;
+}
+
+#endif /* SPA_BLUEZ5_RATE_CONTROL_H */
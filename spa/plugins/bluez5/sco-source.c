@@ -51,6 +51,7 @@
 #include <sbc/sbc.h>
 
 #include "defs.h"
+#include "jitter-buffer.h"
 
 struct props {
 	uint32_t min_latency;
@@ -110,6 +111,7 @@ struct impl {
 	struct port port;
 
 	unsigned int started:1;
+	unsigned int following:1;
 
 	struct spa_io_clock *clock;
 	struct spa_io_position *position;
@@ -124,6 +126,8 @@ struct impl {
 	uint8_t msbc_buffer_pos;
 
 	struct timespec now;
+
+	struct jitter_buffer jitter;
 };
 
 #define NAME "sco-source"
@@ -216,9 +220,38 @@ static int impl_node_enum_params(void *object, int seq,
 	return 0;
 }
 
+static int do_reassing_follower(struct spa_loop *loop,
+			bool async,
+			uint32_t seq,
+			const void *data,
+			size_t size,
+			void *user_data)
+{
+	struct impl *this = user_data;
+	struct port *port = &this->port;
+	struct buffer *b;
+
+	/* buffers queued for the driver path are not used when following */
+	spa_list_consume(b, &port->ready, link) {
+		spa_list_remove(&b->link);
+		spa_list_append(&port->free, &b->link);
+	}
+	if (port->current_buffer)
+		port->ready_offset = 0;
+
+	jitter_buffer_reset(&this->jitter);
+	return 0;
+}
+
+static inline bool is_following(struct impl *this)
+{
+	return this->position && this->clock && this->position->clock.id != this->clock->id;
+}
+
 static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 {
 	struct impl *this = object;
+	bool following;
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 
@@ -233,6 +266,12 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 		return -ENOENT;
 	}
 
+	following = is_following(this);
+	if (this->started && following != this->following) {
+		spa_log_debug(this->log, NAME" %p: reassign follower %d->%d", this, this->following, following);
+		this->following = following;
+		spa_loop_invoke(this->data_loop, do_reassing_follower, 0, NULL, 0, true, this);
+	}
 	return 0;
 }
 
@@ -496,6 +535,14 @@ static int sco_source_cb(void *userdata, uint8_t *read_data, int size_read)
 		port->ready_offset += size_read;
 	}
 
+	/* the graph pulls from the jitter buffer when following, the
+	 * current buffer is only used to decode into */
+	if (this->following) {
+		jitter_buffer_write(&this->jitter, datas[0].data, port->ready_offset);
+		port->ready_offset = 0;
+		return 0;
+	}
+
 	/* send buffer if full */
 	if ((max_out_size + port->ready_offset) > (this->props.max_latency * port->frame_size)) {
 		uint64_t sample_count;
@@ -580,6 +627,8 @@ static int do_start(struct impl *this)
 
 	/* Reset the buffers and sample count */
 	reset_buffers(&this->port);
+	jitter_buffer_reset(&this->jitter);
+	this->following = is_following(this);
 
 	/* Init mSBC if needed */
 	if (this->transport->codec == HFP_AUDIO_CODEC_MSBC) {
@@ -919,6 +968,9 @@ static int port_set_format(struct impl *this, struct port *port,
 		port->frame_size = info.info.raw.channels * 2;
 		port->current_format = info;
 		port->have_format = true;
+
+		jitter_buffer_set_format(&this->jitter, port->frame_size,
+				info.info.raw.rate);
 	}
 
 	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
@@ -1056,6 +1108,47 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return 0;
 }
 
+static struct buffer *read_jitter_buffer(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct spa_io_position *pos = this->position;
+	struct buffer *buffer;
+	struct spa_data *datas;
+	uint32_t n_frames, period;
+	double corr;
+
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_warn(this->log, NAME " %p: no buffer available", this);
+		return NULL;
+	}
+	buffer = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&buffer->link);
+	datas = buffer->buf->datas;
+
+	/* the resampler asks for a few frames more or less to correct the
+	 * rate, the DLL runs on the graph period */
+	period = pos->clock.duration * port->current_format.info.raw.rate /
+		pos->clock.rate.denom;
+	if (port->rate_match && port->rate_match->size > 0)
+		n_frames = port->rate_match->size;
+	else
+		n_frames = period;
+	n_frames = SPA_MIN(n_frames, datas[0].maxsize / port->frame_size);
+
+	corr = jitter_buffer_update(&this->jitter, pos->clock.nsec, period, n_frames);
+	if (port->rate_match) {
+		port->rate_match->rate = SPA_CLAMP(1.0/corr, 0.95, 1.05);
+		SPA_FLAG_SET(port->rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE);
+	}
+	jitter_buffer_read(&this->jitter, datas[0].data, n_frames);
+
+	datas[0].chunk->offset = 0;
+	datas[0].chunk->size = n_frames * port->frame_size;
+	datas[0].chunk->stride = port->frame_size;
+
+	return buffer;
+}
+
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
@@ -1079,6 +1172,12 @@ static int impl_node_process(void *object)
 		io->buffer_id = SPA_ID_INVALID;
 	}
 
+	if (this->following && this->started && port->have_format) {
+		if ((buffer = read_jitter_buffer(this)) == NULL)
+			return SPA_STATUS_OK;
+		goto done;
+	}
+
 	/* Return if there are no buffers ready to be processed */
 	if (spa_list_is_empty(&port->ready))
 		return SPA_STATUS_OK;
@@ -1086,6 +1185,8 @@ static int impl_node_process(void *object)
 	/* Get the new buffer from the ready list */
 	buffer = spa_list_first(&port->ready, struct buffer, link);
 	spa_list_remove(&buffer->link);
+
+done:
 	buffer->outstanding = true;
 
 	/* Set the new buffer in IO */
@@ -1181,6 +1282,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	struct port *port;
 	const char *str;
+	uint32_t latency = JITTER_BUFFER_DEFAULT_LATENCY;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -1245,6 +1347,10 @@ impl_init(const struct spa_handle_factory *factory,
 
 	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_BLUEZ5_TRANSPORT)))
 		sscanf(str, "pointer:%p", &this->transport);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_BLUEZ5_JITTER_LATENCY)))
+		latency = atoi(str);
+
+	jitter_buffer_init(&this->jitter, this->log, latency);
 
 	if (this->transport == NULL) {
 		spa_log_error(this->log, "a transport is needed");
@@ -1282,7 +1388,8 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 static const struct spa_dict_item info_items[] = {
 	{ SPA_KEY_FACTORY_AUTHOR, "Collabora Ltd. <contact@collabora.com>" },
 	{ SPA_KEY_FACTORY_DESCRIPTION, "Capture bluetooth audio with hsp/hfp" },
-	{ SPA_KEY_FACTORY_USAGE, SPA_KEY_API_BLUEZ5_TRANSPORT"=<transport>" },
+	{ SPA_KEY_FACTORY_USAGE, SPA_KEY_API_BLUEZ5_TRANSPORT"=<transport> "
+		"["SPA_KEY_API_BLUEZ5_JITTER_LATENCY"=<msec>]" },
 };
 
 static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
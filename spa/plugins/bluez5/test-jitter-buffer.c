@@ -0,0 +1,178 @@
+/* Spa Bluez5 rate control test
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/utils/defs.h>
+
+#include "jitter-buffer.h"
+
+/* Simulate a remote device that sends packets with a clock that drifts
+ * against the graph clock. The graph reads one quantum per cycle, adjusted
+ * by the rate correction like the resampler of the adapter would. The fill
+ * level should settle around the target without underruns or overruns. */
+
+#define RATE		48000
+#define CHANNELS	2
+#define FRAME_SIZE	(CHANNELS * 2)
+#define PACKET		128
+#define QUANTUM		1024
+#define LATENCY		40
+/* the correction should follow the drift within this once locked */
+#define TOLERANCE	0.0001
+
+struct sim {
+	struct jitter_buffer jb;
+	double drift;
+	double produced;	/**< fractional frames produced by the device */
+	double consumed;	/**< fractional frames asked by the resampler */
+	uint64_t now;
+	uint8_t packet[PACKET * FRAME_SIZE];
+	uint8_t out[QUANTUM * 2 * FRAME_SIZE];
+};
+
+struct stats {
+	uint32_t min_avail;
+	uint32_t max_avail;
+	double min_corr;
+	double max_corr;
+};
+
+static void sim_init(struct sim *sim, double drift)
+{
+	jitter_buffer_init(&sim->jb, NULL, LATENCY);
+	jitter_buffer_set_format(&sim->jb, FRAME_SIZE, RATE);
+	sim->drift = drift;
+	sim->produced = 0.0;
+	sim->consumed = 0.0;
+	sim->now = SPA_NSEC_PER_SEC;
+}
+
+/* run one graph cycle */
+static void sim_cycle(struct sim *sim, struct stats *st)
+{
+	uint32_t n_frames;
+	double corr;
+
+	/* the device sends the packets that were completed in this cycle */
+	sim->produced += QUANTUM * sim->drift;
+	while (sim->produced >= PACKET) {
+		jitter_buffer_write(&sim->jb, sim->packet, sizeof(sim->packet));
+		sim->produced -= PACKET;
+	}
+
+	/* the resampler asks for one frame more or less in some cycles to
+	 * follow the correction */
+	sim->consumed += QUANTUM * sim->jb.corr;
+	n_frames = (uint32_t)sim->consumed;
+	sim->consumed -= n_frames;
+	corr = jitter_buffer_update(&sim->jb, sim->now, QUANTUM, n_frames);
+	jitter_buffer_read(&sim->jb, sim->out, n_frames);
+
+	if (st && !sim->jb.buffering) {
+		uint32_t avail = jitter_buffer_avail(&sim->jb);
+		st->min_avail = SPA_MIN(st->min_avail, avail);
+		st->max_avail = SPA_MAX(st->max_avail, avail);
+		st->min_corr = SPA_MIN(st->min_corr, corr);
+		st->max_corr = SPA_MAX(st->max_corr, corr);
+	}
+	sim->now += (uint64_t)QUANTUM * SPA_NSEC_PER_SEC / RATE;
+}
+
+static void run(struct sim *sim, uint32_t seconds, struct stats *st)
+{
+	uint32_t i, n_cycles = seconds * RATE / QUANTUM;
+
+	if (st) {
+		st->min_avail = UINT32_MAX;
+		st->max_avail = 0;
+		st->min_corr = 2.0;
+		st->max_corr = 0.0;
+	}
+	for (i = 0; i < n_cycles; i++)
+		sim_cycle(sim, st);
+}
+
+static void test_drift(double drift)
+{
+	struct sim sim;
+	struct stats st;
+	uint32_t underruns, target;
+
+	sim_init(&sim, drift);
+	target = sim.jb.target;
+
+	/* fill the buffer and let the DLL lock */
+	run(&sim, 60, NULL);
+	underruns = sim.jb.underruns;
+
+	run(&sim, 60, &st);
+	fprintf(stderr, "drift %f: avail %u..%u target %u corr %f..%f "
+			"underruns %u overruns %u\n", drift,
+			st.min_avail, st.max_avail, target,
+			st.min_corr, st.max_corr,
+			sim.jb.underruns, sim.jb.overruns);
+
+	spa_assert(sim.jb.underruns == underruns);
+	spa_assert(sim.jb.overruns == 0);
+	spa_assert(st.min_avail + QUANTUM >= target / 2);
+	spa_assert(st.max_avail <= target + 2 * QUANTUM);
+	spa_assert(sim.jb.dll.bw <= SPA_DLL_BW_MIN);
+	spa_assert(st.min_corr > drift - TOLERANCE && st.max_corr < drift + TOLERANCE);
+}
+
+static void test_underrun(void)
+{
+	struct sim sim;
+
+	sim_init(&sim, 1.0);
+	run(&sim, 10, NULL);
+	spa_assert(!sim.jb.buffering);
+
+	/* the device stops sending, we should go back to buffering
+	 * and produce silence */
+	sim.drift = 0.0;
+	run(&sim, 1, NULL);
+	spa_assert(sim.jb.buffering);
+	spa_assert(sim.jb.underruns == 1);
+	spa_assert(jitter_buffer_avail(&sim.jb) == 0);
+	spa_assert(sim.out[0] == 0);
+
+	/* and recover when it starts again */
+	sim.drift = 1.0;
+	run(&sim, 10, NULL);
+	spa_assert(!sim.jb.buffering);
+	spa_assert(sim.jb.underruns == 1);
+}
+
+int main(int argc, char *argv[])
+{
+	test_drift(1.0);
+	test_drift(1.002);
+	test_drift(0.997);
+	test_underrun();
+	return 0;
+}
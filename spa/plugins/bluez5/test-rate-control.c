@@ -0,0 +1,189 @@
+/* Spa Bluez5 rate control test
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <spa/utils/defs.h>
+
+#include "rate-control.h"
+
+/* Simulate an SBC like encoder writing to an L2CAP socket. The link only
+ * takes a limited number of bytes every period, like a congested radio
+ * link. The controller should settle on a quality the link can carry
+ * without collapsing to the minimum.
+ *
+ * Like on a real L2CAP socket, TIOCOUTQ reports the free space in the send
+ * buffer, not the queued bytes. */
+
+#define PERIOD		(20 * SPA_NSEC_PER_MSEC)
+#define MIN_QUALITY	2
+#define MAX_QUALITY	53
+#define QUEUE_SIZE	16384
+
+static int packet_size(int quality)
+{
+	return 60 + 16 * quality;
+}
+
+struct sim {
+	uint32_t queue_size;
+	uint32_t pending;
+	struct rate_control rc;
+	int quality;
+	uint64_t now;
+	uint64_t blocked;
+};
+
+static void sim_init(struct sim *sim)
+{
+	sim->queue_size = QUEUE_SIZE;
+	sim->pending = 0;
+	sim->quality = MAX_QUALITY;
+	sim->now = SPA_NSEC_PER_SEC;
+	sim->blocked = 0;
+	rate_control_init(&sim->rc, sim->now);
+}
+
+/* TIOCOUTQ of an L2CAP socket */
+static int sim_outq(struct sim *sim)
+{
+	return sim->queue_size - sim->pending;
+}
+
+static int sim_send(struct sim *sim, uint32_t size)
+{
+	if (sim->pending + size > sim->queue_size)
+		return -EAGAIN;
+	sim->pending += size;
+	return size;
+}
+
+static void sim_apply(struct sim *sim, int res)
+{
+	if (res == RATE_CONTROL_REDUCE)
+		sim->quality = SPA_MAX(sim->quality - 2, MIN_QUALITY);
+	else if (res == RATE_CONTROL_INCREASE)
+		sim->quality = SPA_MIN(sim->quality + 1, MAX_QUALITY);
+}
+
+/* run one period, returns true when the packet could not be sent */
+static bool sim_period(struct sim *sim, int capacity)
+{
+	uint32_t queued;
+	bool dropped = false;
+
+	queued = rate_control_queued(sim_outq(sim), sim->queue_size);
+
+	if (sim_send(sim, packet_size(sim->quality)) < 0) {
+		if (sim->blocked == 0)
+			sim->blocked = sim->now;
+		sim_apply(sim, rate_control_update(&sim->rc, sim->now,
+					sim->queue_size, sim->queue_size,
+					sim->now - sim->blocked));
+		dropped = true;
+	} else {
+		uint64_t latency = sim->blocked ? sim->now - sim->blocked : 0;
+		sim->blocked = 0;
+		sim_apply(sim, rate_control_update(&sim->rc, sim->now,
+					queued, sim->queue_size, latency));
+	}
+
+	/* the link */
+	sim->pending -= SPA_MIN(sim->pending, (uint32_t)capacity);
+	sim->now += PERIOD;
+	return dropped;
+}
+
+struct stats {
+	int min_quality;
+	int max_quality;
+	int dropped;
+};
+
+static void run(struct sim *sim, uint32_t seconds, int capacity, struct stats *st)
+{
+	uint32_t i, n_periods = seconds * SPA_NSEC_PER_SEC / PERIOD;
+
+	st->min_quality = MAX_QUALITY;
+	st->max_quality = MIN_QUALITY;
+	st->dropped = 0;
+
+	for (i = 0; i < n_periods; i++) {
+		if (sim_period(sim, capacity))
+			st->dropped++;
+		st->min_quality = SPA_MIN(st->min_quality, sim->quality);
+		st->max_quality = SPA_MAX(st->max_quality, sim->quality);
+	}
+}
+
+static void test_converge(void)
+{
+	struct sim sim;
+	struct stats st;
+	int capacity = packet_size(30);
+
+	sim_init(&sim);
+
+	/* from the maximum quality the controller has to back off */
+	run(&sim, 60, capacity, &st);
+	fprintf(stderr, "settle: quality %d..%d dropped %d\n",
+			st.min_quality, st.max_quality, st.dropped);
+	spa_assert(sim.quality < MAX_QUALITY);
+
+	/* and then stay around what the link can carry */
+	run(&sim, 60, capacity, &st);
+	fprintf(stderr, "steady: quality %d..%d dropped %d\n",
+			st.min_quality, st.max_quality, st.dropped);
+	spa_assert(st.max_quality <= 32);
+	spa_assert(st.min_quality >= 20);
+	spa_assert(st.dropped <= 5);
+
+	/* the link gets better, quality should go up again */
+	capacity = packet_size(45);
+	run(&sim, 120, capacity, &st);
+	fprintf(stderr, "recover: quality %d..%d dropped %d now %d\n",
+			st.min_quality, st.max_quality, st.dropped, sim.quality);
+	spa_assert(sim.quality >= 38);
+	spa_assert(sim.quality <= 47);
+}
+
+static void test_queued(void)
+{
+	/* an empty L2CAP socket reports the whole buffer as free */
+	spa_assert(rate_control_queued(QUEUE_SIZE, QUEUE_SIZE) == 0);
+	spa_assert(rate_control_queued(QUEUE_SIZE / 4, QUEUE_SIZE) == QUEUE_SIZE * 3 / 4);
+	spa_assert(rate_control_queued(0, QUEUE_SIZE) == QUEUE_SIZE);
+	spa_assert(rate_control_queued(QUEUE_SIZE + 1, QUEUE_SIZE) == 0);
+	spa_assert(rate_control_queued(-EIO, QUEUE_SIZE) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	test_queued();
+	test_converge();
+	return 0;
+}
@@ -28,6 +28,8 @@
 #include <errno.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include <spa/support/log.h>
 #include <spa/support/loop.h>
@@ -47,6 +49,60 @@
 
 #define TRACE_BUFFER (16*1024)
 
+#define DEFERRED_RINGS		16
+#define DEFERRED_BUFFER		(16*1024)
+#define DEFERRED_RECORD_MAX	2048
+#define DEFERRED_FORMAT_MAX	512u
+#define DEFERRED_STRING_MAX	256u
+
+/** \cond */
+
+/* a log message in binary form. The header is followed by copies of the
+ * format, file and function strings and then the arguments, which are
+ * decoded again with the format string when the message is emitted */
+struct log_record {
+	uint32_t size;
+	uint32_t level;
+	int line;
+	int err;
+	uint32_t n_args;
+	uint32_t truncated;
+	struct timespec time;
+};
+
+/* per thread single producer, single consumer ring of log records */
+struct log_ring {
+	uint32_t in_use;
+	uint32_t dropped;
+	struct spa_ringbuffer rb;
+	uint8_t data[DEFERRED_BUFFER];
+};
+
+enum arg_type {
+	ARG_NONE,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_PTRDIFF,
+	ARG_INTMAX,
+	ARG_DOUBLE,
+	ARG_LDOUBLE,
+	ARG_STRING,
+	ARG_POINTER,
+};
+
+struct spec {
+	const char *start;
+	const char *end;
+	char conv;
+	enum arg_type type;
+	uint32_t n_star;
+	int precision;		/* -1 when not given */
+	bool precision_star;
+};
+/** \endcond */
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_log log;
@@ -58,30 +114,27 @@ struct impl {
 	struct spa_ringbuffer trace_rb;
 	uint8_t trace_data[TRACE_BUFFER];
 
+	pthread_key_t ring_key;
+	struct log_ring *rings;		/* DEFERRED_RINGS, allocated at init */
+	uint32_t dropped;		/* messages of threads without a ring */
+	pthread_t thread;
+	sem_t sem;
+	bool running;
+
 	unsigned int have_source:1;
+	unsigned int deferred:1;
 	unsigned int colors:1;
 	unsigned int timestamp:1;
 	unsigned int line:1;
 };
 
-static SPA_PRINTF_FUNC(6,0) void
-impl_log_logv(void *object,
-	      enum spa_log_level level,
-	      const char *file,
-	      int line,
-	      const char *func,
-	      const char *fmt,
-	      va_list args)
+static int format_prefix(struct impl *impl, char *p, int len, enum spa_log_level level,
+		const char *file, int line, const char *func, const struct timespec *now)
 {
-	struct impl *impl = object;
-	char location[1024], *p, *s;
 	static const char *levels[] = { "-", "E", "W", "I", "D", "T", "*T*" };
-	const char *prefix = "", *suffix = "";
-	int size, len;
-	bool do_trace;
-
-	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
-		level++;
+	const char *prefix = "";
+	char *s;
+	int size;
 
 	if (impl->colors) {
 		if (level <= SPA_LOG_LEVEL_ERROR)
@@ -90,32 +143,420 @@ impl_log_logv(void *object,
 			prefix = "\x1B[1;33m";
 		else if (level <= SPA_LOG_LEVEL_INFO)
 			prefix = "\x1B[1;32m";
-		if (prefix[0])
-			suffix = "\x1B[0m";
 	}
 
-	p = location;
-	len = sizeof(location);
-
 	size = snprintf(p, len, "%s[%s]", prefix, levels[level]);
 
 	if (impl->timestamp) {
-		struct timespec now;
-		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 		size += snprintf(p + size, len - size, "[%09lu.%06lu]",
-			now.tv_sec & 0x1FFFFFFF, now.tv_nsec / 1000);
+			now->tv_sec & 0x1FFFFFFF, now->tv_nsec / 1000);
 
 	}
 	if (impl->line && line != 0) {
 		s = strrchr(file, '/');
 		size += snprintf(p + size, len - size, "[%s:%i %s()]",
 			s ? s + 1 : file, line, func);
+		size = SPA_MIN(size, len - 1);
 	}
 	size += snprintf(p + size, len - size, " ");
-	size += vsnprintf(p + size, len - size, fmt, args);
+	return size;
+}
+
+/* room kept for the suffix, a truncated message still ends the line */
+#define MAX_SUFFIX	8
+
+static int format_suffix(struct impl *impl, char *p, int len, enum spa_log_level level)
+{
+	return snprintf(p, len, "%s\n",
+			impl->colors && level <= SPA_LOG_LEVEL_INFO ? "\x1B[0m" : "");
+}
+
+/* find the next conversion in fmt, returns false when there are no more */
+static bool next_spec(const char *fmt, struct spec *s)
+{
+	const char *p;
+	int lng = 0;
+
+	if ((p = strchr(fmt, '%')) == NULL)
+		return false;
+
+	s->start = p++;
+	s->type = ARG_NONE;
+	s->n_star = 0;
+	s->precision = -1;
+	s->precision_star = false;
+
+	while (*p && strchr("-+ #0'I", *p))
+		p++;
+	if (*p == '*') {
+		s->n_star++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			s->n_star++;
+			s->precision_star = true;
+			p++;
+		} else {
+			s->precision = 0;
+		}
+		while (*p >= '0' && *p <= '9')
+			s->precision = s->precision * 10 + (*p++ - '0');
+	}
+	for (;; p++) {
+		switch (*p) {
+		case 'h':
+			continue;
+		case 'l':
+			lng++;
+			continue;
+		case 'q': case 'L':
+			lng = 2;
+			continue;
+		case 'j':
+			lng = 3;
+			continue;
+		case 'z':
+			lng = 4;
+			continue;
+		case 't':
+			lng = 5;
+			continue;
+		}
+		break;
+	}
+	s->conv = *p;
+	s->end = *p ? p + 1 : p;
+
+	switch (s->conv) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+		switch (lng) {
+		case 0: s->type = ARG_INT; break;
+		case 1: s->type = ARG_LONG; break;
+		case 2: s->type = ARG_LLONG; break;
+		case 3: s->type = ARG_INTMAX; break;
+		case 4: s->type = ARG_SIZE; break;
+		default: s->type = ARG_PTRDIFF; break;
+		}
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		s->type = lng == 2 ? ARG_LDOUBLE : ARG_DOUBLE;
+		break;
+	case 's':
+		s->type = ARG_STRING;
+		break;
+	case 'p': case 'n':
+		s->type = ARG_POINTER;
+		break;
+	}
+	return true;
+}
+
+static inline size_t arg_size(enum arg_type type)
+{
+	return type == ARG_LDOUBLE ? SPA_ROUND_UP_N(sizeof(long double), 8) : 8;
+}
+
+/* copy at most max bytes of str, the length is stored in front of it */
+static uint8_t *encode_string(uint8_t *p, const char *str, size_t max)
+{
+	uint32_t len = strnlen(str, max);
+
+	*(uint32_t*)p = len;
+	memcpy(p + 8, str, len);
+	p[8 + len] = '\0';
+	return p + SPA_ROUND_UP_N(8 + len + 1, 8);
+}
+
+static const uint8_t *decode_string(const uint8_t *p, const char **str)
+{
+	*str = (const char *)(p + 8);
+	return p + SPA_ROUND_UP_N(8 + *(uint32_t*)p + 1, 8);
+}
+
+/* store the arguments for fmt in binary form at p. Only the values are
+ * stored, they are decoded with the format again later. */
+static SPA_PRINTF_FUNC(3,0) void
+encode_args(struct log_record *r, uint8_t *p, const char *fmt, va_list args)
+{
+	uint8_t *end = SPA_MEMBER(r, DEFERRED_RECORD_MAX, uint8_t);
+	struct spec s;
+	uint32_t i;
+
+	for (; next_spec(fmt, &s); fmt = s.end) {
+		int precision = s.precision;
+
+		if (p + (s.n_star + 1) * 8 + arg_size(s.type) > end)
+			goto truncated;
+
+		for (i = 0; i < s.n_star; i++, p += 8) {
+			*(int64_t*)p = va_arg(args, int);
+			if (s.precision_star && i == s.n_star - 1)
+				precision = *(int64_t*)p;
+		}
+
+		switch (s.type) {
+		case ARG_NONE:
+			continue;
+		case ARG_INT:
+			*(int64_t*)p = va_arg(args, int);
+			break;
+		case ARG_LONG:
+			*(int64_t*)p = va_arg(args, long);
+			break;
+		case ARG_LLONG:
+			*(int64_t*)p = va_arg(args, long long);
+			break;
+		case ARG_INTMAX:
+			*(int64_t*)p = va_arg(args, intmax_t);
+			break;
+		case ARG_SIZE:
+			*(int64_t*)p = va_arg(args, size_t);
+			break;
+		case ARG_PTRDIFF:
+			*(int64_t*)p = va_arg(args, ptrdiff_t);
+			break;
+		case ARG_DOUBLE:
+			*(double*)p = va_arg(args, double);
+			break;
+		case ARG_LDOUBLE:
+			*(long double*)p = va_arg(args, long double);
+			break;
+		case ARG_POINTER:
+			*(void**)p = va_arg(args, void*);
+			break;
+		case ARG_STRING:
+		{
+			const char *str = va_arg(args, const char *);
+			size_t max = SPA_MIN((size_t)(end - p - 8), DEFERRED_STRING_MAX) - 1;
+
+			/* the string does not need to be terminated within
+			 * the precision */
+			if (precision >= 0)
+				max = SPA_MIN(max, (size_t)precision);
+			p = encode_string(p, str ? str : "(null)", max);
+			r->n_args++;
+			continue;
+		}
+		}
+		p += arg_size(s.type);
+		r->n_args++;
+	}
+	r->size = p - (uint8_t*)r;
+	return;
+
+truncated:
+	r->truncated = true;
+	r->size = p - (uint8_t*)r;
+}
+
+static int decode_args(const struct log_record *r, const char *fmt, const uint8_t *p,
+		char *out, int len)
+{
+	char spec[64];
+	struct spec s;
+	uint32_t n_args = 0;
+	int size = 0, l;
+
+#define APPEND(...)	do { l = snprintf(out + size, len - size, __VA_ARGS__);	\
+				size = SPA_MIN(size + SPA_MAX(l, 0), len - 1); } while(0)
+
+	for (; next_spec(fmt, &s); fmt = s.end) {
+		APPEND("%.*s", (int)(s.start - fmt), fmt);
+
+		if (s.conv == '%') {
+			APPEND("%%");
+			continue;
+		} else if (s.conv == 'm') {
+			APPEND("%s", strerror(r->err));
+			continue;
+		} else if (s.type == ARG_NONE) {
+			APPEND("%.*s", (int)(s.end - s.start), s.start);
+			continue;
+		}
+		if (n_args++ == r->n_args) {
+			fmt = "...";
+			break;
+		}
+		/* rebuild the conversion with the '*' arguments filled in */
+		{
+			const char *c;
+			int sl = 0;
+			for (c = s.start; c < s.end && sl < (int)sizeof(spec) - 24; c++) {
+				if (*c == '*') {
+					sl += sprintf(spec + sl, "%d", (int)*(int64_t*)p);
+					p += 8;
+				} else
+					spec[sl++] = *c;
+			}
+			spec[sl] = '\0';
+		}
+		switch (s.type) {
+		case ARG_INT:
+			APPEND(spec, (int)*(int64_t*)p);
+			break;
+		case ARG_LONG:
+			APPEND(spec, (long)*(int64_t*)p);
+			break;
+		case ARG_LLONG:
+			APPEND(spec, (long long)*(int64_t*)p);
+			break;
+		case ARG_INTMAX:
+			APPEND(spec, (intmax_t)*(int64_t*)p);
+			break;
+		case ARG_SIZE:
+			APPEND(spec, (size_t)*(int64_t*)p);
+			break;
+		case ARG_PTRDIFF:
+			APPEND(spec, (ptrdiff_t)*(int64_t*)p);
+			break;
+		case ARG_DOUBLE:
+			APPEND(spec, *(double*)p);
+			break;
+		case ARG_LDOUBLE:
+			APPEND(spec, *(long double*)p);
+			break;
+		case ARG_POINTER:
+			if (s.conv != 'n')
+				APPEND(spec, *(void**)p);
+			break;
+		case ARG_STRING:
+		{
+			const char *str;
+			p = decode_string(p, &str);
+			APPEND(spec, str);
+			continue;
+		}
+		case ARG_NONE:
+			break;
+		}
+		p += arg_size(s.type);
+	}
+	APPEND("%s", fmt);
+#undef APPEND
+	return size;
+}
+
+static void ring_destroy(void *data)
+{
+	struct log_ring *ring = data;
+	__atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static struct log_ring *get_ring(struct impl *impl)
+{
+	struct log_ring *ring;
+	uint32_t i;
+
+	if (SPA_LIKELY((ring = pthread_getspecific(impl->ring_key)) != NULL))
+		return ring;
+
+	/* take a free ring, they are released again when the thread exits */
+	for (i = 0; i < DEFERRED_RINGS; i++) {
+		uint32_t expected = 0;
+
+		ring = &impl->rings[i];
+		if (__atomic_compare_exchange_n(&ring->in_use, &expected, 1,
+					false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			pthread_setspecific(impl->ring_key, ring);
+			return ring;
+		}
+	}
+	return NULL;
+}
+
+static SPA_PRINTF_FUNC(6,0) void
+log_deferred(struct impl *impl,
+	      enum spa_log_level level,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const char *fmt,
+	      va_list args)
+{
+	uint64_t buffer[DEFERRED_RECORD_MAX / sizeof(uint64_t)];
+	struct log_record *r = (struct log_record *) buffer;
+	struct log_ring *ring;
+	uint8_t *p;
+	uint32_t index;
+	int32_t filled;
+
+	r->err = errno;
+
+	if ((ring = get_ring(impl)) == NULL) {
+		__atomic_add_fetch(&impl->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	r->level = level;
+	r->line = line;
+	r->n_args = 0;
+	r->truncated = false;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &r->time);
+
+	/* the strings can be gone by the time the record is emitted, copy
+	 * them and decode the arguments with the copy of the format */
+	p = SPA_MEMBER(r, sizeof(*r), uint8_t);
+	p = encode_string(p, fmt, DEFERRED_FORMAT_MAX);
+	p = encode_string(p, file ? file : "", DEFERRED_STRING_MAX);
+	p = encode_string(p, func ? func : "", DEFERRED_STRING_MAX);
+
+	encode_args(r, p, (const char *)SPA_MEMBER(r, sizeof(*r) + 8, char), args);
+
+	filled = spa_ringbuffer_get_write_index(&ring->rb, &index);
+	if (filled < 0 || filled + r->size > DEFERRED_BUFFER) {
+		__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	spa_ringbuffer_write_data(&ring->rb, ring->data, DEFERRED_BUFFER,
+			index & (DEFERRED_BUFFER - 1), r, r->size);
+	spa_ringbuffer_write_update(&ring->rb, index + r->size);
+
+	/* the logger thread empties all rings before it sleeps, only wake it
+	 * up when it could have seen this ring empty. Pairs with the fence in
+	 * flush_deferred() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->rb.readindex, __ATOMIC_RELAXED) == index)
+		sem_post(&impl->sem);
+}
+
+static SPA_PRINTF_FUNC(6,0) void
+impl_log_logv(void *object,
+	      enum spa_log_level level,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const char *fmt,
+	      va_list args)
+{
+	struct impl *impl = object;
+	char location[1024], *p;
+	struct timespec now = { 0, 0 };
+	int size, len, l;
+	bool do_trace;
+
+	if (impl->deferred) {
+		log_deferred(impl, level, file, line, func, fmt, args);
+		return;
+	}
 
-	if (impl->colors)
-		size += snprintf(p + size, len - size, "%s\n", suffix);
+	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
+		level++;
+
+	p = location;
+	len = sizeof(location);
+
+	if (impl->timestamp)
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+	size = format_prefix(impl, p, len, level, file, line, func, &now);
+	size = SPA_MIN(size, len - MAX_SUFFIX);
+	l = vsnprintf(p + size, len - MAX_SUFFIX - size, fmt, args);
+	size = SPA_MIN(size + SPA_MAX(l, 0), len - MAX_SUFFIX - 1);
+	size += format_suffix(impl, p + size, len - size, level);
 
 	if (SPA_UNLIKELY(do_trace)) {
 		uint32_t index;
@@ -132,7 +573,6 @@ impl_log_logv(void *object,
 	fflush(impl->file);
 }
 
-
 static SPA_PRINTF_FUNC(6,7) void
 impl_log_log(void *object,
 	     enum spa_log_level level,
@@ -176,6 +616,89 @@ static void on_trace_event(struct spa_source *source)
         }
 }
 
+static bool ring_peek(struct log_ring *ring, struct log_record *r, uint32_t *index)
+{
+	if (spa_ringbuffer_get_read_index(&ring->rb, index) < (int32_t)sizeof(*r))
+		return false;
+	spa_ringbuffer_read_data(&ring->rb, ring->data, DEFERRED_BUFFER,
+			*index & (DEFERRED_BUFFER - 1), r, sizeof(*r));
+	return true;
+}
+
+/* emit all queued records, ordered by their timestamp */
+static void flush_deferred(struct impl *impl)
+{
+	uint64_t buffer[DEFERRED_RECORD_MAX / sizeof(uint64_t)];
+	struct log_record *r = (struct log_record *) buffer, head;
+	char location[2048];
+	struct log_ring *ring, *best;
+	const char *fmt, *file, *func;
+	const uint8_t *p;
+	uint32_t i, index, dropped;
+	int size, len = sizeof(location);
+
+	if ((dropped = __atomic_exchange_n(&impl->dropped, 0, __ATOMIC_RELAXED)) > 0)
+		fprintf(impl->file, "[W] logger %p: no free ring, %u messages dropped\n",
+				impl, dropped);
+
+	while (true) {
+		/* make our read index updates visible before we look for new
+		 * records. Pairs with the fence in log_deferred() */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		best = NULL;
+		for (i = 0; i < DEFERRED_RINGS; i++) {
+			ring = &impl->rings[i];
+			if ((dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) > 0)
+				fprintf(impl->file, "[W] logger %p: %u messages dropped\n",
+						ring, dropped);
+			if (!ring_peek(ring, &head, &index))
+				continue;
+			if (best == NULL ||
+			    head.time.tv_sec < r->time.tv_sec ||
+			    (head.time.tv_sec == r->time.tv_sec &&
+			     head.time.tv_nsec < r->time.tv_nsec)) {
+				best = ring;
+				*r = head;
+			}
+		}
+		if (best == NULL)
+			break;
+
+		ring_peek(best, r, &index);
+		spa_ringbuffer_read_data(&best->rb, best->data, DEFERRED_BUFFER,
+				index & (DEFERRED_BUFFER - 1), r, r->size);
+		spa_ringbuffer_read_update(&best->rb, index + r->size);
+
+		p = SPA_MEMBER(r, sizeof(*r), const uint8_t);
+		p = decode_string(p, &fmt);
+		p = decode_string(p, &file);
+		p = decode_string(p, &func);
+
+		size = format_prefix(impl, location, len, r->level,
+				file, r->line, func, &r->time);
+		size = SPA_MIN(size, len - MAX_SUFFIX);
+		size += decode_args(r, fmt, p, location + size, len - MAX_SUFFIX - size);
+		size += format_suffix(impl, location + size, len - size, r->level);
+		fputs(location, impl->file);
+	}
+	fflush(impl->file);
+}
+
+static void *deferred_thread(void *data)
+{
+	struct impl *impl = data;
+
+	while (__atomic_load_n(&impl->running, __ATOMIC_ACQUIRE)) {
+		while (sem_wait(&impl->sem) < 0 && errno == EINTR);
+		/* collapse all pending wakeups */
+		while (sem_trywait(&impl->sem) == 0);
+		flush_deferred(impl);
+	}
+	flush_deferred(impl);
+	return NULL;
+}
+
 static const struct spa_log_methods impl_log = {
 	SPA_VERSION_LOG_METHODS,
 	.log = impl_log_log,
@@ -207,6 +730,15 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	if (this->deferred) {
+		__atomic_store_n(&this->running, false, __ATOMIC_RELEASE);
+		sem_post(&this->sem);
+		pthread_join(this->thread, NULL);
+		sem_destroy(&this->sem);
+		pthread_key_delete(this->ring_key);
+		free(this->rings);
+		this->deferred = false;
+	}
 	if (this->have_source) {
 		spa_loop_remove_source(this->source.loop, &this->source);
 		spa_system_close(this->system, this->source.fd);
@@ -273,6 +805,8 @@ impl_init(const struct spa_handle_factory *factory,
 			this->colors = (strcmp(str, "true") == 0 || atoi(str) == 1);
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_LEVEL)) != NULL)
 			this->log.level = atoi(str);
+		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_DEFERRED)) != NULL)
+			this->deferred = (strcmp(str, "true") == 0 || atoi(str) == 1);
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_FILE)) != NULL) {
 			this->file = fopen(str, "w");
 			if (this->file == NULL)
@@ -284,6 +818,30 @@ impl_init(const struct spa_handle_factory *factory,
 
 	spa_ringbuffer_init(&this->trace_rb);
 
+	if (this->deferred &&
+	    (this->rings = calloc(DEFERRED_RINGS, sizeof(struct log_ring))) == NULL) {
+		fprintf(stderr, "Warning: failed to allocate log rings: %m");
+		this->deferred = false;
+	}
+	if (this->deferred) {
+		int res;
+		uint32_t i;
+
+		for (i = 0; i < DEFERRED_RINGS; i++)
+			spa_ringbuffer_init(&this->rings[i].rb);
+
+		this->running = true;
+		sem_init(&this->sem, 0, 0);
+		pthread_key_create(&this->ring_key, ring_destroy);
+		if ((res = pthread_create(&this->thread, NULL, deferred_thread, this)) != 0) {
+			fprintf(stderr, "Warning: failed to create log thread: %s", strerror(res));
+			pthread_key_delete(this->ring_key);
+			sem_destroy(&this->sem);
+			free(this->rings);
+			this->deferred = false;
+		}
+	}
+
 	spa_log_debug(&this->log, NAME " %p: initialized", this);
 
 	return 0;
@@ -29,6 +29,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include <spa/support/loop.h>
 #include <spa/support/system.h>
@@ -38,7 +43,6 @@
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
 #include <spa/utils/type.h>
-#include <spa/utils/ringbuffer.h>
 
 #define NAME "loop"
 
@@ -46,15 +50,22 @@
 
 /** \cond */
 
+/* completion of a blocking invoke, lives on the stack of the caller */
+struct invoke_done {
+	uint32_t done;
+	int res;
+};
+
 struct invoke_item {
-	size_t item_size;
+	uint32_t committed;
+	uint32_t item_size;
 	spa_invoke_func_t func;
 	uint32_t seq;
 	void *data;
 	size_t size;
-	bool block;
 	void *user_data;
-	int res;
+	struct invoke_done *done;
+	struct invoke_item *next;	/* link in the overflow list */
 };
 
 static int loop_signal_event(void *object, struct spa_source *source);
@@ -76,12 +87,22 @@ struct impl {
 	pthread_t thread;
 
 	struct spa_source *wakeup;
-	int ack_fd;
 
-	struct spa_ringbuffer buffer;
+	/* multi producer, single consumer queue. Producers reserve space by
+	 * moving write_index forward, fill the item and then mark it committed.
+	 * The consumer executes committed items in reservation order and
+	 * clears the memory before handing it back by moving read_index. */
+	uint32_t write_index;
+	uint32_t read_index;
 	uint8_t *buffer_data;
 	uint8_t buffer_mem[DATAS_SIZE + 8];
 
+	/* items that did not fit in the ring buffer. Once an item is queued
+	 * here, all new items go here as well until the list is flushed, so
+	 * that the order of invokes from one thread is preserved. */
+	struct invoke_item *overflow;
+	uint32_t n_overflow;
+
 	unsigned int flushing:1;
 };
 
@@ -124,35 +145,184 @@ static int loop_remove_source(void *object, struct spa_source *source)
 	return spa_system_pollfd_del(impl->system, impl->poll_fd, source->fd);
 }
 
-static void flush_items(struct impl *impl)
+static inline void invoke_done_wait(struct invoke_done *done)
+{
+	while (__atomic_load_n(&done->done, __ATOMIC_ACQUIRE) == 0) {
+#ifdef __linux__
+		syscall(SYS_futex, &done->done, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+#else
+		sched_yield();
+#endif
+	}
+}
+
+static inline void invoke_done_signal(struct invoke_done *done, int res)
+{
+	done->res = res;
+	__atomic_store_n(&done->done, 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+	syscall(SYS_futex, &done->done, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+}
+
+/* committed is 0 while the producer fills the item, 2 when the loop thread
+ * waits for it and 1 when it is filled */
+static inline void item_commit(struct invoke_item *item)
+{
+	if (__atomic_exchange_n(&item->committed, 1, __ATOMIC_ACQ_REL) == 2) {
+#ifdef __linux__
+		syscall(SYS_futex, &item->committed, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+	}
+}
+
+static inline void item_wait_committed(struct invoke_item *item)
+{
+	uint32_t val = 0;
+
+	__atomic_compare_exchange_n(&item->committed, &val, 2,
+			false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+
+	while (__atomic_load_n(&item->committed, __ATOMIC_ACQUIRE) != 1) {
+#ifdef __linux__
+		syscall(SYS_futex, &item->committed, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+#else
+		sched_yield();
+#endif
+	}
+}
+
+static void invoke_item(struct impl *impl, struct invoke_item *item)
 {
-	uint32_t index;
 	int res;
 
-	impl->flushing = true;
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
+	spa_log_trace(impl->log, NAME " %p: flush item %p", impl, item);
+	res = item->func ? item->func(&impl->loop,
+			true, item->seq, item->data, item->size,
+		   item->user_data) : 0;
+
+	if (item->done)
+		invoke_done_signal(item->done, res);
+}
+
+static void clear_items(struct impl *impl, uint32_t offset, uint32_t size)
+{
+	uint32_t l0 = SPA_MIN(size, DATAS_SIZE - offset);
+	memset(impl->buffer_data + offset, 0, l0);
+	if (size > l0)
+		memset(impl->buffer_data, 0, size - l0);
+}
+
+static bool flush_ring(struct impl *impl, bool wait)
+{
+	uint32_t index = impl->read_index;
+
+	while (index != __atomic_load_n(&impl->write_index, __ATOMIC_ACQUIRE)) {
+		uint32_t offset = index & (DATAS_SIZE - 1);
 		struct invoke_item *item;
-		bool block;
+		uint32_t item_size;
 
-		item = SPA_MEMBER(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
-		block = item->block;
+		item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
 
-		spa_log_trace(impl->log, NAME " %p: flush item %p", impl, item);
-		item->res = item->func ? item->func(&impl->loop,
-				true, item->seq, item->data, item->size,
-			   item->user_data) : 0;
+		/* reserved but still being filled, the producer will wake
+		 * us up again when it is done unless we need to wait for it */
+		if (__atomic_load_n(&item->committed, __ATOMIC_ACQUIRE) != 1) {
+			if (!wait)
+				return false;
+			item_wait_committed(item);
+		}
 
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
+		item_size = item->item_size;
 
-		if (block) {
-			if ((res = spa_system_eventfd_write(impl->system, impl->ack_fd, 1)) < 0)
-				spa_log_warn(impl->log, NAME " %p: failed to write event fd: %s",
-						impl, spa_strerror(res));
+		invoke_item(impl, item);
+
+		clear_items(impl, offset, item_size);
+		index += item_size;
+		__atomic_store_n(&impl->read_index, index, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+static void flush_items(struct impl *impl, bool wait)
+{
+	struct invoke_item *list, *item, *prev;
+
+	impl->flushing = true;
+	while (flush_ring(impl, wait)) {
+		list = __atomic_exchange_n(&impl->overflow, NULL, __ATOMIC_ACQUIRE);
+		if (list == NULL)
+			break;
+
+		/* the overflow list is a stack, reverse it */
+		for (prev = NULL; list; list = item) {
+			item = list->next;
+			list->next = prev;
+			prev = list;
+		}
+		while ((item = prev) != NULL) {
+			prev = item->next;
+			invoke_item(impl, item);
+			free(item);
+			__atomic_sub_fetch(&impl->n_overflow, 1, __ATOMIC_RELEASE);
 		}
 	}
 	impl->flushing = false;
 }
 
+static struct invoke_item *reserve_ring_item(struct impl *impl, size_t size)
+{
+	struct invoke_item *item;
+	uint32_t idx, offset, l0, item_size, filled;
+
+	idx = __atomic_load_n(&impl->write_index, __ATOMIC_RELAXED);
+	do {
+		filled = idx - __atomic_load_n(&impl->read_index, __ATOMIC_ACQUIRE);
+		if (filled > DATAS_SIZE)
+			return NULL;
+
+		offset = idx & (DATAS_SIZE - 1);
+		l0 = DATAS_SIZE - offset;
+
+		if (l0 > sizeof(struct invoke_item) + size) {
+			item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, 8);
+			if (l0 < sizeof(struct invoke_item) + item_size)
+				item_size = l0;
+		} else {
+			item_size = SPA_ROUND_UP_N(l0 + size, 8);
+		}
+		if (filled + item_size > DATAS_SIZE)
+			return NULL;
+
+	} while (!__atomic_compare_exchange_n(&impl->write_index, &idx, idx + item_size,
+				true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
+	item->item_size = item_size;
+	if (l0 > sizeof(struct invoke_item) + size)
+		item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
+	else
+		item->data = impl->buffer_data;
+
+	spa_log_trace(impl->log, NAME " %p: add item %p filled:%d", impl, item, filled);
+
+	return item;
+}
+
+static struct invoke_item *alloc_overflow_item(struct impl *impl, size_t size)
+{
+	struct invoke_item *item;
+
+	if ((item = calloc(1, sizeof(struct invoke_item) + size)) == NULL)
+		return NULL;
+
+	item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
+
+	spa_log_debug(impl->log, NAME " %p: queue full, add overflow item %p size:%zd",
+			impl, item, size);
+
+	return item;
+}
+
 static int
 loop_invoke(void *object,
 	    spa_invoke_func_t func,
@@ -164,67 +334,66 @@ loop_invoke(void *object,
 {
 	struct impl *impl = object;
 	bool in_thread = pthread_equal(impl->thread, pthread_self());
-	struct invoke_item *item;
+	struct invoke_item *item = NULL;
+	struct invoke_done done = { 0, 0 };
 	int res;
-	int32_t filled;
-	uint32_t avail, idx, offset, l0;
 
-	filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-	if (filled < 0 || filled > DATAS_SIZE) {
-		spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
-		return -EPIPE;
-	}
-	avail = DATAS_SIZE - filled;
-	if (avail < sizeof(struct invoke_item)) {
-		spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
-		return -EPIPE;
+	if (in_thread && block) {
+		/* only we can execute the queued items so we can't wait for
+		 * ourselves. Execute the pending items, waiting for the ones
+		 * that other threads are still filling, and then this one. When
+		 * we are called from an invoked item, the pending items can only
+		 * run after it so we execute this one right away. */
+		if (!impl->flushing)
+			flush_items(impl, true);
+		return func ? func(&impl->loop, true, seq, data, size, user_data) : 0;
 	}
-	offset = idx & (DATAS_SIZE - 1);
 
-	l0 = DATAS_SIZE - offset;
+	if (__atomic_load_n(&impl->n_overflow, __ATOMIC_ACQUIRE) == 0)
+		item = reserve_ring_item(impl, size);
+
+	if (item == NULL) {
+		__atomic_add_fetch(&impl->n_overflow, 1, __ATOMIC_SEQ_CST);
+		if ((item = alloc_overflow_item(impl, size)) == NULL) {
+			res = -errno;
+			__atomic_sub_fetch(&impl->n_overflow, 1, __ATOMIC_RELEASE);
+			spa_log_warn(impl->log, NAME " %p: can't queue item: %m", impl);
+			return res;
+		}
+	}
 
-	item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
 	item->func = func;
 	item->seq = seq;
 	item->size = size;
-	item->block = block;
 	item->user_data = user_data;
+	item->done = block ? &done : NULL;
 
-	spa_log_trace(impl->log, NAME " %p: add item %p filled:%d", impl, item, filled);
-
-	if (l0 > sizeof(struct invoke_item) + size) {
-		item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
-		item->item_size = SPA_ROUND_UP_N(sizeof(struct invoke_item) + size, 8);
-		if (l0 < sizeof(struct invoke_item) + item->item_size)
-			item->item_size = l0;
-	} else {
-		item->data = impl->buffer_data;
-		item->item_size = SPA_ROUND_UP_N(l0 + size, 8);
-	}
 	if (data && size > 0)
 		memcpy(item->data, data, size);
 
-	spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+	if (item->item_size == 0) {
+		item->next = __atomic_load_n(&impl->overflow, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&impl->overflow, &item->next, item,
+					true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	} else {
+		item_commit(item);
+	}
 
 	if (in_thread) {
 		if (!impl->flushing)
-			flush_items(impl);
+			flush_items(impl, false);
 	} else {
 		loop_signal_event(impl, impl->wakeup);
 	}
 
 	if (block) {
-		uint64_t count = 1;
-
 		spa_loop_control_hook_before(&impl->hooks_list);
 
-		if ((res = spa_system_eventfd_read(impl->system, impl->ack_fd, &count)) < 0)
-			spa_log_warn(impl->log, NAME " %p: failed to read event fd: %s",
-					impl, spa_strerror(res));
+		invoke_done_wait(&done);
 
 		spa_loop_control_hook_after(&impl->hooks_list);
 
-		res = item->res;
+		res = done.res;
 	}
 	else {
 		if (seq != SPA_ID_INVALID)
@@ -238,7 +407,7 @@ loop_invoke(void *object,
 static void wakeup_func(void *data, uint64_t count)
 {
 	struct impl *impl = data;
-	flush_items(impl);
+	flush_items(impl, false);
 }
 
 static int loop_get_fd(void *object)
@@ -722,17 +891,22 @@ static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *impl;
 	struct source_impl *source;
+	struct invoke_item *item;
 
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
 
 	impl = (struct impl *) handle;
 
+	while ((item = impl->overflow) != NULL) {
+		impl->overflow = item->next;
+		free(item);
+	}
+
 	spa_list_consume(source, &impl->source_list, link)
 		loop_destroy_source(impl, &source->source);
 
 	process_destroy(impl);
 
-	spa_system_close(impl->system, impl->ack_fd);
 	spa_system_close(impl->system, impl->poll_fd);
 
 	return 0;
@@ -796,7 +970,7 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_hook_list_init(&impl->hooks_list);
 
 	impl->buffer_data = SPA_PTR_ALIGN(impl->buffer_mem, 8, uint8_t);
-	spa_ringbuffer_init(&impl->buffer);
+	memset(impl->buffer_data, 0, DATAS_SIZE);
 
 	impl->wakeup = loop_add_event(impl, wakeup_func, impl);
 	if (impl->wakeup == NULL) {
@@ -804,20 +978,11 @@ impl_init(const struct spa_handle_factory *factory,
 		spa_log_error(impl->log, NAME " %p: can't create wakeup event: %m", impl);
 		goto error_exit_free_poll;
 	}
-	if ((res = spa_system_eventfd_create(impl->system,
-			SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
-		spa_log_error(impl->log, NAME " %p: can't create ack event: %s",
-				impl, spa_strerror(res));
-		goto error_exit_free_wakeup;
-	}
-	impl->ack_fd = res;
 
 	spa_log_debug(impl->log, NAME " %p: initialized", impl);
 
 	return 0;
 
-error_exit_free_wakeup:
-	loop_destroy_source(impl, impl->wakeup);
 error_exit_free_poll:
 	spa_system_close(impl->system, impl->poll_fd);
 error_exit:
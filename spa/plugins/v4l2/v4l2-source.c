@@ -46,9 +46,12 @@
 #include <spa/debug/pod.h>
 
 #include "v4l2.h"
+#include "../alsa/dll.h"
 
 #define NAME "v4l2-source"
 
+#define BW_PERIOD	(3 * SPA_NSEC_PER_SEC)
+
 static const char default_device[] = "/dev/video0";
 
 struct props {
@@ -75,7 +78,10 @@ struct buffer {
 	struct spa_buffer *outbuf;
 	struct spa_meta_header *h;
 	struct v4l2_buffer v4l2_buffer;
+	struct v4l2_plane plane;
 	void *ptr;
+	uint64_t pts;		/* of the frame in the buffer */
+	uint32_t sequence;
 };
 
 #define MAX_CONTROLS	64
@@ -118,6 +124,12 @@ struct port {
 
 	struct spa_source source;
 
+	struct spa_dll dll;
+	uint64_t next_time;
+	uint64_t base_time;
+	uint32_t last_sequence;
+	uint32_t dropped;	/* frames given back to the driver unused */
+
 	uint64_t info_all;
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
@@ -511,8 +523,8 @@ static int impl_node_port_enum_params(void *object, int seq,
 			SPA_TYPE_OBJECT_ParamBuffers, id,
 			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(MAX_BUFFERS, 2, MAX_BUFFERS),
 			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
-			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(port->fmt.fmt.pix.sizeimage),
-			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port->fmt.fmt.pix.bytesperline),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(port_size(port)),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port_stride(port)),
 			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
 		break;
 
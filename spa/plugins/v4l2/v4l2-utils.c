@@ -99,7 +99,19 @@ int spa_v4l2_is_capture(struct spa_v4l2_device *dev)
 	uint32_t caps = dev->cap.capabilities;
 	if ((caps & V4L2_CAP_DEVICE_CAPS))
 		caps = dev->cap.device_caps;
-	return (caps & V4L2_CAP_VIDEO_CAPTURE) == V4L2_CAP_VIDEO_CAPTURE;
+	return (caps & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE)) != 0;
+}
+
+static enum v4l2_buf_type spa_v4l2_buf_type(struct spa_v4l2_device *dev)
+{
+	uint32_t caps = dev->cap.capabilities;
+	if ((caps & V4L2_CAP_DEVICE_CAPS))
+		caps = dev->cap.device_caps;
+	/* prefer the single planar API when the driver can do both */
+	if ((caps & V4L2_CAP_VIDEO_CAPTURE) == 0 &&
+	    (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE) != 0)
+		return V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	return V4L2_BUF_TYPE_VIDEO_CAPTURE;
 }
 
 int spa_v4l2_close(struct spa_v4l2_device *dev)
@@ -119,6 +131,36 @@ int spa_v4l2_close(struct spa_v4l2_device *dev)
 	return 0;
 }
 
+/* with the multi-planar API only formats with one plane are used, see
+ * spa_v4l2_set_format() */
+static uint32_t port_stride(struct port *port)
+{
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type))
+		return port->fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+	return port->fmt.fmt.pix.bytesperline;
+}
+
+static uint32_t port_size(struct port *port)
+{
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type))
+		return port->fmt.fmt.pix_mp.plane_fmt[0].sizeimage;
+	return port->fmt.fmt.pix.sizeimage;
+}
+
+static void buffer_init_v4l2(struct port *port, struct buffer *b, uint32_t index)
+{
+	spa_zero(b->v4l2_buffer);
+	b->v4l2_buffer.type = port->type;
+	b->v4l2_buffer.memory = port->memtype;
+	b->v4l2_buffer.index = index;
+
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		spa_zero(b->plane);
+		b->v4l2_buffer.m.planes = &b->plane;
+		b->v4l2_buffer.length = 1;
+	}
+}
+
 static int spa_v4l2_buffer_recycle(struct impl *this, uint32_t buffer_id)
 {
 	struct port *port = &this->out_ports[0];
@@ -172,7 +214,7 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = 0;
 
@@ -541,8 +583,9 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 
 	if (result.next == 0) {
 		spa_zero(port->fmtdesc);
+		port->type = spa_v4l2_buf_type(dev);
 		port->fmtdesc.index = 0;
-		port->fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		port->fmtdesc.type = port->type;
 		port->next_fmtdesc = true;
 		spa_zero(port->frmsize);
 		port->next_frmsize = true;
@@ -864,8 +907,6 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 
 	spa_zero(fmt);
 	spa_zero(streamparm);
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
 	switch (format->media_subtype) {
 	case SPA_MEDIA_SUBTYPE_raw:
@@ -915,6 +956,13 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	if ((res = spa_v4l2_open(dev, this->props.device)) < 0)
 		return res;
 
+	/* width, height, pixelformat and field are at the same place in
+	 * the single and multi planar format */
+	port->type = spa_v4l2_buf_type(dev);
+	fmt.type = port->type;
+	streamparm.type = port->type;
+	reqfmt.type = port->type;
+
 	cmd = (flags & SPA_NODE_PARAM_FLAG_TEST_ONLY) ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
 	if (xioctl(dev->fd, cmd, &fmt) < 0) {
 		res = -errno;
@@ -923,6 +971,12 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 		return res;
 	}
 
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type) && fmt.fmt.pix_mp.num_planes != 1) {
+		spa_log_error(this->log, "v4l2: '%s' formats with %u planes are not supported",
+				this->props.device, (uint32_t)fmt.fmt.pix_mp.num_planes);
+		return -ENOTSUP;
+	}
+
 	/* some cheap USB cam's won't accept any change */
 	if (xioctl(dev->fd, VIDIOC_S_PARM, &streamparm) < 0)
 		spa_log_warn(this->log, "VIDIOC_S_PARM: %m");
@@ -1196,36 +1250,99 @@ spa_v4l2_enum_controls(struct impl *this, int seq,
 	return res;
 }
 
+static void update_time(struct impl *this, uint64_t pts, uint32_t sequence)
+{
+	struct port *port = &this->out_ports[0];
+	uint32_t num = port->rate.num, denom = port->rate.denom;
+	double err, corr;
+
+	if (SPA_UNLIKELY(num == 0 || denom == 0))
+		return;
+
+	corr = 1.0 - (port->dll.z2 + port->dll.z3);
+
+	if (SPA_LIKELY(port->dll.bw != 0.0)) {
+		/* the driver dropped frames, move our prediction ahead */
+		uint32_t missed = sequence - port->last_sequence - 1;
+		if (missed > 0 && missed < denom)
+			port->next_time += missed * num / corr * 1e9 / denom;
+
+		/* error is in units of 1/denom seconds, one frame is num units.
+		 * Drift moves the timestamps slowly, more than a frame off is a
+		 * discontinuity the DLL should not try to follow */
+		err = ((int64_t)pts - (int64_t)port->next_time) * (double)denom / 1e9;
+		if (fabs(err) > num) {
+			spa_log_debug(this->log, NAME" %p: resync err:%f", this, err);
+			spa_dll_init(&port->dll);
+		}
+	}
+	if (SPA_UNLIKELY(port->dll.bw == 0.0)) {
+		spa_dll_set_bw(&port->dll, SPA_DLL_BW_MAX, num, denom);
+		port->next_time = pts;
+		port->base_time = pts;
+	}
+	err = ((int64_t)pts - (int64_t)port->next_time) * (double)denom / 1e9;
+	corr = spa_dll_update(&port->dll, err);
+
+	if (SPA_UNLIKELY((port->next_time - port->base_time) > BW_PERIOD)) {
+		port->base_time = port->next_time;
+		if (port->dll.bw > SPA_DLL_BW_MIN)
+			spa_dll_set_bw(&port->dll, port->dll.bw / 2.0, num, denom);
+
+		spa_log_debug(this->log, NAME" %p: rate:%f bw:%f err:%f (%f %f %f)",
+				this, corr, port->dll.bw, err,
+				port->dll.z1, port->dll.z2, port->dll.z3);
+	}
+
+	port->next_time += num / corr * 1e9 / denom;
+	port->last_sequence = sequence;
+
+	if (this->clock) {
+		this->clock->nsec = pts;
+		this->clock->rate = port->rate;
+		this->clock->position = sequence;
+		this->clock->duration = 1;
+		this->clock->delay = 0;
+		this->clock->rate_diff = corr;
+		this->clock->next_nsec = port->next_time;
+	}
+}
+
 static int mmap_read(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct spa_v4l2_device *dev = &port->dev;
 	struct v4l2_buffer buf;
+	struct v4l2_plane plane;
 	struct buffer *b;
 	struct spa_data *d;
+	uint32_t offset, size;
 	int64_t pts;
 
 	spa_zero(buf);
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.type = port->type;
 	buf.memory = port->memtype;
 
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		spa_zero(plane);
+		buf.m.planes = &plane;
+		buf.length = 1;
+	}
+
 	if (xioctl(dev->fd, VIDIOC_DQBUF, &buf) < 0)
 		return -errno;
 
+	if (buf.index >= port->n_buffers) {
+		spa_log_warn(this->log, "v4l2 %p: invalid buffer %d", this, buf.index);
+		return -EIO;
+	}
+
 	pts = SPA_TIMEVAL_TO_NSEC(&buf.timestamp);
 	spa_log_trace(this->log, "v4l2 %p: have output %d", this, buf.index);
 
-	if (this->clock) {
-		this->clock->nsec = pts;
-		this->clock->rate = port->rate;
-		this->clock->position = buf.sequence;
-		this->clock->duration = 1;
-		this->clock->delay = 0;
-		this->clock->rate_diff = 1.0;
-		this->clock->next_nsec = pts + 1000000000LL / port->rate.denom;
-	}
-
 	b = &port->buffers[buf.index];
+	b->pts = pts;
+	b->sequence = buf.sequence;
 	if (b->h) {
 		b->h->flags = 0;
 		if (buf.flags & V4L2_BUF_FLAG_ERROR)
@@ -1236,10 +1353,18 @@ static int mmap_read(struct impl *this)
 		b->h->dts_offset = 0;
 	}
 
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		offset = SPA_MIN(plane.data_offset, plane.bytesused);
+		size = plane.bytesused - offset;
+	} else {
+		offset = 0;
+		size = buf.bytesused;
+	}
+
 	d = b->outbuf->datas;
-	d[0].chunk->offset = 0;
-	d[0].chunk->size = buf.bytesused;
-	d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+	d[0].chunk->offset = offset;
+	d[0].chunk->size = size;
+	d[0].chunk->stride = port_stride(port);
 	d[0].chunk->flags = 0;
 	if (buf.flags & V4L2_BUF_FLAG_ERROR)
 		d[0].chunk->flags |= SPA_CHUNK_FLAG_CORRUPTED;
@@ -1254,6 +1379,7 @@ static void v4l2_on_fd_events(struct spa_source *source)
 	struct spa_io_buffers *io;
 	struct port *port = &this->out_ports[0];
 	struct buffer *b;
+	uint32_t n_read = 0;
 
 	if (source->rmask & SPA_IO_ERR) {
 		struct port *port = &this->out_ports[0];
@@ -1268,12 +1394,31 @@ static void v4l2_on_fd_events(struct spa_source *source)
 		return;
 	}
 
-	if (mmap_read(this) < 0)
-		return;
+	/* take all buffers the driver has ready, when we are woken up late
+	 * there can be more than one */
+	while (mmap_read(this) == 0)
+		n_read++;
 
 	if (spa_list_is_empty(&port->queue))
 		return;
 
+	/* only the newest frame is delivered, give the older ones back to
+	 * the driver so that it does not run out of buffers */
+	while (true) {
+		b = spa_list_first(&port->queue, struct buffer, link);
+		if (b == spa_list_last(&port->queue, struct buffer, link))
+			break;
+		spa_list_remove(&b->link);
+		SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUTSTANDING);
+		spa_v4l2_buffer_recycle(this, b->id);
+		port->dropped++;
+		spa_log_debug(this->log, "v4l2 %p: drop old frame %u, %u dropped",
+				this, b->sequence, port->dropped);
+	}
+	/* the clock follows the frame that is delivered */
+	if (n_read > 0)
+		update_time(this, b->pts, b->sequence);
+
 	io = port->io;
 	if (io != NULL && io->status != SPA_STATUS_HAVE_DATA) {
 		if (io->buffer_id < port->n_buffers)
@@ -1313,7 +1458,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1330,6 +1475,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 
 	for (i = 0; i < reqbuf.count; i++) {
 		struct buffer *b;
+		bool mplane = V4L2_TYPE_IS_MULTIPLANAR(port->type);
 
 		b = &port->buffers[i];
 		b->id = i;
@@ -1345,10 +1491,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 		}
 		d = buffers[i]->datas;
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
+		buffer_init_v4l2(port, b, i);
 
 		if (port->memtype == V4L2_MEMORY_USERPTR) {
 			if (d[0].data == NULL) {
@@ -1368,11 +1511,19 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 			else
 				b->ptr = d[0].data;
 
-			b->v4l2_buffer.m.userptr = (unsigned long) b->ptr;
-			b->v4l2_buffer.length = d[0].maxsize;
+			if (mplane) {
+				b->plane.m.userptr = (unsigned long) b->ptr;
+				b->plane.length = d[0].maxsize;
+			} else {
+				b->v4l2_buffer.m.userptr = (unsigned long) b->ptr;
+				b->v4l2_buffer.length = d[0].maxsize;
+			}
 		}
 		else if (port->memtype == V4L2_MEMORY_DMABUF) {
-			b->v4l2_buffer.m.fd = d[0].fd;
+			if (mplane)
+				b->plane.m.fd = d[0].fd;
+			else
+				b->v4l2_buffer.m.fd = d[0].fd;
 		}
 		else
 			return -EIO;
@@ -1397,7 +1548,7 @@ mmap_init(struct impl *this,
 	port->memtype = V4L2_MEMORY_MMAP;
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1418,6 +1569,7 @@ mmap_init(struct impl *this,
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b;
 		struct spa_data *d;
+		uint32_t length, offset;
 
 		if (buffers[i]->n_datas < 1) {
 			spa_log_error(this->log, "v4l2: invalid buffer data");
@@ -1430,10 +1582,7 @@ mmap_init(struct impl *this,
 		b->flags = BUFFER_FLAG_OUTSTANDING;
 		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
+		buffer_init_v4l2(port, b, i);
 
 		if (xioctl(dev->fd, VIDIOC_QUERYBUF, &b->v4l2_buffer) < 0) {
 			spa_log_error(this->log, "v4l2: '%s' VIDIOC_QUERYBUF: %m", this->props.device);
@@ -1447,12 +1596,20 @@ mmap_init(struct impl *this,
 			break;
 		}
 
+		if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+			length = b->plane.length;
+			offset = b->plane.m.mem_offset;
+		} else {
+			length = b->v4l2_buffer.length;
+			offset = b->v4l2_buffer.m.offset;
+		}
+
 		d = buffers[i]->datas;
 		d[0].mapoffset = 0;
-		d[0].maxsize = b->v4l2_buffer.length;
+		d[0].maxsize = length;
 		d[0].chunk->offset = 0;
 		d[0].chunk->size = 0;
-		d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+		d[0].chunk->stride = port_stride(port);
 		d[0].chunk->flags = 0;
 
 		spa_log_debug(this->log, "v4l2: data types %08x", d[0].type);
@@ -1461,7 +1618,7 @@ mmap_init(struct impl *this,
 			struct v4l2_exportbuffer expbuf;
 
 			spa_zero(expbuf);
-			expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			expbuf.type = port->type;
 			expbuf.index = i;
 			expbuf.flags = O_CLOEXEC | O_RDONLY;
 			if (xioctl(dev->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
@@ -1486,12 +1643,12 @@ fallback:
 			d[0].type = SPA_DATA_MemFd;
 			d[0].flags = SPA_DATA_FLAG_READABLE;
 			d[0].fd = dev->fd;
-			d[0].mapoffset = b->v4l2_buffer.m.offset;
+			d[0].mapoffset = offset;
 			d[0].data = mmap(NULL,
-					b->v4l2_buffer.length,
+					length,
 					PROT_READ, MAP_SHARED,
 					dev->fd,
-					b->v4l2_buffer.m.offset);
+					offset);
 			if (d[0].data == MAP_FAILED) {
 				spa_log_error(this->log, "v4l2: '%s' mmap: %m", this->props.device);
 				return -errno;
@@ -1563,7 +1720,10 @@ static int spa_v4l2_stream_on(struct impl *this)
 
 	spa_log_debug(this->log, "starting");
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	spa_dll_init(&port->dll);
+	port->dropped = 0;
+
+	type = port->type;
 	if (xioctl(dev->fd, VIDIOC_STREAMON, &type) < 0) {
 		spa_log_error(this->log, "v4l2: '%s' VIDIOC_STREAMON: %m", this->props.device);
 		return -errno;
@@ -1611,7 +1771,7 @@ static int spa_v4l2_stream_off(struct impl *this)
 
 	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, port);
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = port->type;
 	if (xioctl(dev->fd, VIDIOC_STREAMOFF, &type) < 0) {
 		spa_log_error(this->log, "v4l2: '%s' VIDIOC_STREAMOFF: %m", this->props.device);
 		return -errno;
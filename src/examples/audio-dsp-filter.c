@@ -139,9 +139,10 @@ int main(int argc, char *argv[])
 			NULL, 0);
 
 	/* Now connect this filter. We ask that our process function is
-	 * called in a realtime thread. */
+	 * called in a realtime thread that waits directly for the wakeup
+	 * of the filter. */
 	if (pw_filter_connect(data.filter,
-				PW_FILTER_FLAG_RT_PROCESS,
+				PW_FILTER_FLAG_RT_DIRECT,
 				NULL, 0) < 0) {
 		fprintf(stderr, "can't connect\n");
 		return -1;
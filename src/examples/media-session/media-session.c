@@ -114,6 +114,17 @@ struct sync {
 	void *data;
 };
 
+/** the last saved items of a state file. Changes to the state are appended
+ * to a journal, the state file is only rewritten when the journal becomes
+ * bigger than the state file. */
+struct state {
+	struct spa_list link;
+	char *name;
+	struct pw_array items;		/**< saved spa_dict_item, sorted by key */
+	size_t size;			/**< size of the state file */
+	size_t journal_size;		/**< size of the journal */
+};
+
 struct impl {
 	struct sm_media_session this;
 
@@ -150,6 +161,7 @@ struct impl {
 
 	int state_dir_fd;
 	char state_dir[PATH_MAX];
+	struct spa_list state_list;		/** list of struct state */
 
 	unsigned int scanning:1;
 	unsigned int rescan_pending:1;
@@ -1877,30 +1889,117 @@ static int state_dir(struct sm_media_session *sess)
 	return res;
 }
 
-int sm_media_session_load_state(struct sm_media_session *sess,
-		const char *name, const char *prefix, struct pw_properties *props)
+#define JOURNAL_SUFFIX		".journal"
+#define JOURNAL_MIN_SIZE	(16 * 1024)
+
+static int item_compare(const void *p1, const void *p2)
 {
-	struct impl *impl = SPA_CONTAINER_OF(sess, struct impl, this);
-	int count, sfd, fd;
+	const struct spa_dict_item *i1 = p1, *i2 = p2;
+	return strcmp(i1->key, i2->key);
+}
+
+static void items_clear(struct pw_array *items)
+{
+	struct spa_dict_item *it;
+
+	pw_array_for_each(it, items) {
+		free((char*)it->key);
+		free((char*)it->value);
+	}
+	pw_array_reset(items);
+}
+
+static void state_clear_items(struct state *state)
+{
+	items_clear(&state->items);
+}
+
+static void state_free(struct state *state)
+{
+	spa_list_remove(&state->link);
+	state_clear_items(state);
+	pw_array_clear(&state->items);
+	free(state->name);
+	free(state);
+}
+
+static struct state *ensure_state(struct impl *impl, const char *name)
+{
+	struct state *state;
+
+	spa_list_for_each(state, &impl->state_list, link) {
+		if (strcmp(state->name, name) == 0)
+			return state;
+	}
+	if ((state = calloc(1, sizeof(struct state))) == NULL)
+		return NULL;
+	if ((state->name = strdup(name)) == NULL) {
+		free(state);
+		return NULL;
+	}
+	pw_array_init(&state->items, 4096);
+	spa_list_append(&impl->state_list, &state->link);
+	return state;
+}
+
+static int state_add_item(struct pw_array *items, const char *key, const char *value)
+{
+	struct spa_dict_item *it;
+
+	if ((it = pw_array_add(items, sizeof(*it))) == NULL)
+		return -errno;
+	it->key = key ? strdup(key) : NULL;
+	it->value = value ? strdup(value) : NULL;
+	if (it->key == NULL || it->value == NULL)
+		return -errno;
+	return 0;
+}
+
+/* make a sorted array of the items with prefix */
+static struct spa_dict_item *sorted_items(const struct pw_properties *props,
+		const char *prefix, uint32_t *n_items)
+{
+	const struct spa_dict_item *it;
+	struct spa_dict_item *items;
+	uint32_t n = 0;
+
+	items = malloc(SPA_MAX(props->dict.n_items, 1u) * sizeof(struct spa_dict_item));
+	if (items == NULL)
+		return NULL;
+
+	spa_dict_for_each(it, &props->dict) {
+		if (prefix != NULL && strstr(it->key, prefix) != it->key)
+			continue;
+		items[n++] = *it;
+	}
+	qsort(items, n, sizeof(struct spa_dict_item), item_compare);
+	*n_items = n;
+	return items;
+}
+
+static int load_file(struct impl *impl, int sfd, const char *name,
+		struct pw_properties *props, size_t *size)
+{
+	int count, fd;
 	struct stat sbuf;
 	void *data;
 
-	if ((sfd = state_dir(sess)) < 0)
-		return sfd;
-
 	if ((fd = openat(sfd, name, O_CLOEXEC | O_RDONLY)) < 0) {
 		pw_log_debug("can't open file %s%s: %m", impl->state_dir, name);
 		return -errno;
 	}
-	pw_log_info(NAME" %p: loading state '%s%s'", sess, impl->state_dir, name);
+	pw_log_info(NAME" %p: loading state '%s%s'", impl, impl->state_dir, name);
 	if (fstat(fd, &sbuf) < 0)
 		goto error_close;
-	if ((data = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
-		goto error_close;
+	count = 0;
+	if (sbuf.st_size > 0) {
+		if ((data = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+			goto error_close;
+		count = pw_properties_update_string(props, data, sbuf.st_size);
+		munmap(data, sbuf.st_size);
+	}
 	close(fd);
-
-	count = pw_properties_update_string(props, data, sbuf.st_size);
-	munmap(data, sbuf.st_size);
+	*size = sbuf.st_size;
 
 	return count;
 
@@ -1910,20 +2009,81 @@ error_close:
 	return -errno;
 }
 
-int sm_media_session_save_state(struct sm_media_session *sess,
-		const char *name, const char *prefix, const struct pw_properties *props)
+int sm_media_session_load_state(struct sm_media_session *sess,
+		const char *name, const char *prefix, struct pw_properties *props)
 {
-	const struct spa_dict_item *it;
-	char *tmp_name;
-	int sfd, fd;
-	FILE *f;
+	struct impl *impl = SPA_CONTAINER_OF(sess, struct impl, this);
+	struct spa_dict_item *items;
+	struct state *state;
+	char *journal_name;
+	size_t size = 0, journal_size = 0;
+	uint32_t i, n_items;
+	int res, count, sfd;
 
-	pw_log_info(NAME" %p: saving state '%s'", sess, name);
 	if ((sfd = state_dir(sess)) < 0)
 		return sfd;
 
-	tmp_name = alloca(strlen(name)+5);
-	sprintf(tmp_name, "%s.tmp", name);
+	count = load_file(impl, sfd, name, props, &size);
+	if (count < 0 && count != -ENOENT)
+		return count;
+
+	/* the journal has the changes made after the state file was written */
+	journal_name = alloca(strlen(name) + strlen(JOURNAL_SUFFIX) + 1);
+	sprintf(journal_name, "%s"JOURNAL_SUFFIX, name);
+	if ((res = load_file(impl, sfd, journal_name, props, &journal_size)) >= 0)
+		count = SPA_MAX(count, 0) + res;
+	else if (res != -ENOENT)
+		pw_log_warn("can't load journal '%s': %s", journal_name, spa_strerror(res));
+
+	if (count < 0 || prefix == NULL)
+		return count;
+
+	/* remember what is on disk so that the next save only appends
+	 * the changes */
+	if ((state = ensure_state(impl, name)) == NULL)
+		return -errno;
+	state_clear_items(state);
+	state->size = size;
+	state->journal_size = journal_size;
+
+	if ((items = sorted_items(props, prefix, &n_items)) == NULL)
+		return -errno;
+	for (i = 0; i < n_items; i++) {
+		if ((res = state_add_item(&state->items, items[i].key, items[i].value)) < 0)
+			break;
+	}
+	free(items);
+
+	if (res < 0) {
+		state_free(state);
+		return res;
+	}
+	return count;
+}
+
+static int write_item(FILE *f, const char *key, const char *value)
+{
+	char k[1024];
+
+	if (spa_json_encode_string(k, sizeof(k)-1, key) >= (int)sizeof(k)-1)
+		return 0;
+
+	fprintf(f, " %s: %s\n", k, value ? value : "null");
+	return 1;
+}
+
+/* write all items to a new state file and remove the journal */
+static int compact_state(struct impl *impl, int sfd, struct state *state,
+		const char *journal_name)
+{
+	struct spa_dict_item *it;
+	char *tmp_name;
+	int fd;
+	long size;
+	FILE *f;
+
+	tmp_name = alloca(strlen(state->name)+5);
+	sprintf(tmp_name, "%s.tmp", state->name);
 	if ((fd = openat(sfd, tmp_name,  O_CLOEXEC | O_CREAT | O_WRONLY | O_TRUNC, 0700)) < 0) {
 		pw_log_error("can't open file '%s': %m", tmp_name);
 		return -errno;
@@ -1931,26 +2091,161 @@ int sm_media_session_save_state(struct sm_media_session *sess,
 
 	f = fdopen(fd, "w");
 	fprintf(f, "{ \n");
-	spa_dict_for_each(it, &props->dict) {
-		char key[1024];
-		if (prefix != NULL && strstr(it->key, prefix) != it->key)
-			continue;
-
-		if (spa_json_encode_string(key, sizeof(key)-1, it->key) >= (int)sizeof(key)-1)
-			continue;
-
-		fprintf(f, " %s: %s\n", key, it->value);
-	}
+	pw_array_for_each(it, &state->items)
+		write_item(f, it->key, it->value);
 	fprintf(f, "}\n");
+	size = ftell(f);
 	fclose(f);
 
-	if (renameat(sfd, tmp_name, sfd, name) < 0) {
+	if (renameat(sfd, tmp_name, sfd, state->name) < 0) {
 		pw_log_error("can't rename temp file '%s': %m", tmp_name);
 		return -errno;
 	}
+	/* the journal only repeats what is in the state file now */
+	if (unlinkat(sfd, journal_name, 0) < 0 && errno != ENOENT)
+		pw_log_warn("can't remove journal '%s': %m", journal_name);
+
+	state->size = SPA_MAX(size, 0l);
+	state->journal_size = 0;
 	return 0;
 }
 
+int sm_media_session_save_state(struct sm_media_session *sess,
+		const char *name, const char *prefix, const struct pw_properties *props)
+{
+	struct impl *impl = SPA_CONTAINER_OF(sess, struct impl, this);
+	struct spa_dict_item *items, *old;
+	struct pw_array saved;
+	struct state *state;
+	char *journal_name, *ptr = NULL;
+	uint32_t i, j, n_items, n_old;
+	size_t len = 0;
+	int res = 0, sfd, fd, cmp;
+	FILE *f;
+
+	pw_log_info(NAME" %p: saving state '%s'", sess, name);
+	if ((sfd = state_dir(sess)) < 0)
+		return sfd;
+
+	if ((state = ensure_state(impl, name)) == NULL)
+		return -errno;
+
+	if ((items = sorted_items(props, prefix, &n_items)) == NULL)
+		return -errno;
+
+	if ((f = open_memstream(&ptr, &len)) == NULL) {
+		res = -errno;
+		goto exit_free;
+	}
+
+	/* merge with the saved items and write the differences, the strings
+	 * of the items that did not change are moved to the new array */
+	pw_array_init(&saved, 4096);
+	old = state->items.data;
+	n_old = pw_array_get_len(&state->items, struct spa_dict_item);
+
+	for (i = 0, j = 0; i < n_items || j < n_old;) {
+		struct spa_dict_item *it = NULL;
+
+		if (i == n_items)
+			cmp = 1;
+		else if (j == n_old)
+			cmp = -1;
+		else
+			cmp = strcmp(items[i].key, old[j].key);
+
+		if (cmp > 0) {
+			write_item(f, old[j].key, NULL);
+			j++;
+			continue;
+		}
+		if (res >= 0 && (it = pw_array_add(&saved, sizeof(*it))) == NULL)
+			res = -errno;
+
+		if (cmp < 0) {
+			write_item(f, items[i].key, items[i].value);
+			if (it != NULL) {
+				it->key = strdup(items[i].key);
+				it->value = strdup(items[i].value);
+			}
+		} else {
+			if (strcmp(items[i].value, old[j].value) != 0) {
+				write_item(f, items[i].key, items[i].value);
+				free((char*)old[j].value);
+				old[j].value = strdup(items[i].value);
+			}
+			if (it != NULL) {
+				*it = old[j];
+				old[j].key = old[j].value = NULL;
+			}
+			j++;
+		}
+		if (it != NULL && (it->key == NULL || it->value == NULL))
+			res = -ENOMEM;
+		i++;
+	}
+	fclose(f);
+
+	if (res < 0)
+		goto exit_clear;
+
+	journal_name = alloca(strlen(name) + strlen(JOURNAL_SUFFIX) + 1);
+	sprintf(journal_name, "%s"JOURNAL_SUFFIX, name);
+
+	/* append the changes first, the journal then always has the latest
+	 * values, also when we fail to write the state file below */
+	if (len > 0) {
+		struct stat sbuf;
+		ssize_t written;
+
+		if ((fd = openat(sfd, journal_name,
+				O_CLOEXEC | O_CREAT | O_WRONLY | O_APPEND, 0700)) < 0) {
+			pw_log_error("can't open journal '%s': %m", journal_name);
+			res = -errno;
+			goto exit_clear;
+		}
+		if (fstat(fd, &sbuf) < 0) {
+			pw_log_error("can't stat journal '%s': %m", journal_name);
+			res = -errno;
+			close(fd);
+			goto exit_clear;
+		}
+		if ((written = write(fd, ptr, len)) != (ssize_t)len) {
+			res = written < 0 ? -errno : -EIO;
+			pw_log_error("can't write journal '%s': %s", journal_name,
+					spa_strerror(res));
+			/* don't leave a partial line behind for the next load */
+			if (written > 0 && ftruncate(fd, sbuf.st_size) < 0)
+				pw_log_warn("can't truncate journal '%s': %m", journal_name);
+			close(fd);
+			goto exit_clear;
+		}
+		close(fd);
+		state->journal_size = sbuf.st_size + len;
+	}
+
+	/* the changes are on disk, remember them */
+	state_clear_items(state);
+	pw_array_clear(&state->items);
+	state->items = saved;
+
+	if (res >= 0 && state->journal_size > SPA_MAX(state->size, (size_t)JOURNAL_MIN_SIZE))
+		res = compact_state(impl, sfd, state, journal_name);
+
+exit_free:
+	free(ptr);
+	free(items);
+	return res;
+
+exit_clear:
+	/* the saved items are unknown now, without them the next save
+	 * writes everything again and compacts the journal */
+	items_clear(&saved);
+	pw_array_clear(&saved);
+	state_clear_items(state);
+	goto exit_free;
+}
+
 static void monitor_core_done(void *data, uint32_t id, int seq)
 {
 	struct impl *impl = data;
@@ -2277,10 +2572,12 @@ int main(int argc, char *argv[])
 	};
         size_t i;
 	const struct spa_dict_item *item;
+	struct state *state;
 
 	pw_init(&argc, &argv);
 
 	impl.state_dir_fd = -1;
+	spa_list_init(&impl.state_list);
 	impl.this.props = pw_properties_new(
 			PW_KEY_CONTEXT_PROFILE_MODULES, "default,rtkit",
 			NULL);
@@ -2386,6 +2683,8 @@ exit:
 	pw_properties_free(impl.conf);
 	pw_properties_free(impl.modules);
 
+	spa_list_consume(state, &impl.state_list, link)
+		state_free(state);
 	if (impl.state_dir_fd != -1)
 		close(impl.state_dir_fd);
 
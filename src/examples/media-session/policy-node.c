@@ -59,6 +59,9 @@ struct impl {
 	uint32_t sample_rate;
 
 	struct spa_list node_list;
+	struct spa_list device_list;	/**< device nodes, to find targets by name */
+	struct spa_list media_list;	/**< nodes indexed by media and direction */
+	struct spa_list dirty_list;	/**< nodes to look at in the next rescan */
 	int seq;
 
 	uint32_t default_audio_sink;
@@ -68,6 +71,13 @@ struct impl {
 	bool streams_follow_default;
 };
 
+/** all enabled nodes with the same media, per direction */
+struct media_index {
+	struct spa_list link;
+	char *media;
+	struct spa_list node_list[2];
+};
+
 struct node {
 	struct sm_node *obj;
 
@@ -75,6 +85,10 @@ struct node {
 	struct impl *impl;
 
 	struct spa_list link;		/**< link in impl node_list */
+	struct spa_list device_link;	/**< link in impl device_list */
+	struct spa_list index_link;	/**< link in media_index node_list */
+	struct spa_list dirty_link;	/**< link in impl dirty_list */
+	struct media_index *index;
 	enum pw_direction direction;
 
 	struct spa_hook listener;
@@ -103,8 +117,47 @@ struct node {
 	unsigned int moving:1;
 	unsigned int capture_sink:1;
 	unsigned int virtual:1;
+	unsigned int dirty:1;
 };
 
+static void mark_dirty(struct impl *impl, struct node *node)
+{
+	if (node->dirty)
+		return;
+	spa_list_append(&impl->dirty_list, &node->dirty_link);
+	node->dirty = true;
+}
+
+/* something changed that can make any node pick another peer */
+static void mark_all_dirty(struct impl *impl)
+{
+	struct node *node;
+	spa_list_for_each(node, &impl->node_list, link)
+		mark_dirty(impl, node);
+}
+
+static struct media_index *ensure_media_index(struct impl *impl, const char *media)
+{
+	struct media_index *index;
+
+	spa_list_for_each(index, &impl->media_list, link) {
+		if (strcmp(index->media, media) == 0)
+			return index;
+	}
+	index = calloc(1, sizeof(struct media_index));
+	if (index == NULL)
+		return NULL;
+	index->media = strdup(media);
+	if (index->media == NULL) {
+		free(index);
+		return NULL;
+	}
+	spa_list_init(&index->node_list[PW_DIRECTION_INPUT]);
+	spa_list_init(&index->node_list[PW_DIRECTION_OUTPUT]);
+	spa_list_append(&impl->media_list, &index->link);
+	return index;
+}
+
 static bool find_format(struct node *node)
 {
 	struct impl *impl = node->impl;
@@ -209,6 +262,7 @@ static void object_update(void *data)
 			return;
 		}
 		node->active = true;
+		mark_dirty(impl, node);
 		sm_media_session_schedule_rescan(impl->session);
 	}
 }
@@ -246,6 +300,7 @@ handle_node(struct impl *impl, struct sm_object *object)
 	node->client_id = client_id;
 	node->type = NODE_TYPE_UNKNOWN;
 	spa_list_append(&impl->node_list, &node->link);
+	mark_dirty(impl, node);
 
 	if (role && !strcmp(role, "DSP"))
 		node->active = node->configured = true;
@@ -328,6 +383,16 @@ handle_node(struct impl *impl, struct sm_object *object)
 				object->id, node->media, node->priority);
 	}
 
+	if ((node->index = ensure_media_index(impl, node->media)) == NULL)
+		return -errno;
+	spa_list_append(&node->index->node_list[node->direction], &node->index_link);
+
+	if (node->type == NODE_TYPE_DEVICE) {
+		spa_list_append(&impl->device_list, &node->device_link);
+		/* a new device can be a better peer for any node */
+		mark_all_dirty(impl);
+	}
+
 	node->enabled = true;
 	node->obj->obj.mask |= SM_NODE_CHANGE_MASK_PARAMS;
 	sm_object_add_listener(&node->obj->obj, &node->listener, &object_events, node);
@@ -338,22 +403,32 @@ handle_node(struct impl *impl, struct sm_object *object)
 static void destroy_node(struct impl *impl, struct node *node)
 {
 	spa_list_remove(&node->link);
+	if (node->dirty)
+		spa_list_remove(&node->dirty_link);
+	if (node->index)
+		spa_list_remove(&node->index_link);
+	if (node->type == NODE_TYPE_DEVICE && node->enabled) {
+		spa_list_remove(&node->device_link);
+		mark_all_dirty(impl);
+	}
 	if (node->enabled)
 		spa_hook_remove(&node->listener);
 	free(node->media);
-	if (node->peer && node->peer->peer == node)
+	if (node->peer && node->peer->peer == node) {
 		node->peer->peer = NULL;
+		mark_dirty(impl, node->peer);
+	}
 	sm_object_remove_data((struct sm_object*)node->obj, SESSION_KEY);
 }
 
 static struct node *find_node_by_id(struct impl *impl, uint32_t id)
 {
-	struct node *node;
-	spa_list_for_each(node, &impl->node_list, link) {
-		if (node->id == id)
-			return node;
-	}
-	return NULL;
+	struct sm_object *obj;
+
+	if ((obj = sm_media_session_find_object(impl->session, id)) == NULL ||
+	    strcmp(obj->type, PW_TYPE_INTERFACE_Node) != 0)
+		return NULL;
+	return sm_object_get_data(obj, SESSION_KEY);
 }
 
 static const char *get_device_name(struct node *node)
@@ -370,9 +445,10 @@ static uint32_t find_device_for_name(struct impl *impl, const char *name)
 	const char *str;
 	uint32_t id = atoi(name);
 
-	spa_list_for_each(node, &impl->node_list, link) {
-		if (id == node->obj->obj.id)
-			return id;
+	if (find_node_by_id(impl, id) != NULL)
+		return id;
+
+	spa_list_for_each(node, &impl->device_list, device_link) {
 		if ((str = get_device_name(node)) == NULL)
 			continue;
 		if (strcmp(str, name) == 0)
@@ -411,8 +487,10 @@ static void session_remove(void *data, struct sm_object *object)
 			destroy_node(impl, node);
 
 		spa_list_for_each(n, &impl->node_list, link) {
-			if (n->peer == node)
+			if (n->peer == node) {
 				n->peer = NULL;
+				mark_dirty(impl, n);
+			}
 		}
 		if (impl->default_audio_sink == object->id)
 			impl->default_audio_sink = SPA_ID_INVALID;
@@ -500,11 +578,30 @@ static int find_node(void *data, struct node *node)
 	return 0;
 }
 
+/* only the nodes with the same media and the opposite direction can be a peer */
+static void find_best_node(struct impl *impl, struct find_data *find)
+{
+	struct node *target = find->target, *node;
+	enum pw_direction direction;
+
+	if (target->index == NULL)
+		return;
+
+	if (target->capture_sink)
+		direction = PW_DIRECTION_INPUT;
+	else
+		direction = pw_direction_reverse(target->direction);
+
+	spa_list_for_each(node, &target->index->node_list[direction], index_link)
+		find_node(find, node);
+}
+
 static int link_nodes(struct node *node, struct node *peer)
 {
 	struct impl *impl = node->impl;
 	struct pw_properties *props;
 	struct node *output, *input;
+	int res;
 
 	pw_log_debug(NAME " %p: link nodes %d %d remix:%d", impl,
 			node->id, peer->id, !node->dont_remix);
@@ -527,13 +624,18 @@ static int link_nodes(struct node *node, struct node *peer)
 	pw_properties_setf(props, PW_KEY_LINK_INPUT_NODE, "%d", input->id);
 	pw_log_info("linking node %d to node %d", output->id, input->id);
 
-	if (sm_media_session_create_links(impl->session, &props->dict) > 0) {
+	if ((res = sm_media_session_create_links(impl->session, &props->dict)) > 0) {
 		node->peer = peer;
 		node->connect_count++;
+	} else {
+		/* the ports are not there yet, try again when something changed */
+		pw_log_debug(NAME " %p: no links between %d and %d: %d", impl,
+				output->id, input->id, res);
+		mark_dirty(impl, node);
 	}
 	pw_properties_free(props);
 
-	return 0;
+	return res;
 }
 
 static int unlink_nodes(struct node *node, struct node *peer)
@@ -575,6 +677,7 @@ static int rescan_node(struct impl *impl, struct node *n)
 	struct sm_object *obj;
 	uint32_t path_id;
 	bool follows_default;
+	int res;
 
 	if (!n->active) {
 		pw_log_debug(NAME " %p: node %d is not active", impl, n->id);
@@ -582,6 +685,7 @@ static int rescan_node(struct impl *impl, struct node *n)
 	}
 	if (n->moving) {
 		pw_log_debug(NAME " %p: node %d is moving", impl, n->id);
+		mark_dirty(impl, n);
 		return 0;
 	}
 
@@ -592,6 +696,7 @@ static int rescan_node(struct impl *impl, struct node *n)
 
 	if (n->obj->info == NULL || n->obj->info->props == NULL) {
 		pw_log_debug(NAME " %p: node %d has no properties", impl, n->id);
+		mark_dirty(impl, n);
 		return 0;
 	}
 
@@ -607,6 +712,10 @@ static int rescan_node(struct impl *impl, struct node *n)
 	                   n->obj->target_node == NULL &&
 	                   spa_dict_lookup(props, PW_KEY_NODE_TARGET) == NULL);
 
+	/* the best peer can change with any other node */
+	if (follows_default)
+		mark_dirty(impl, n);
+
 	if (n->peer != NULL && !follows_default) {
 		pw_log_debug(NAME " %p: node %d is already linked", impl, n->id);
 		return 0;
@@ -662,8 +771,7 @@ static int rescan_node(struct impl *impl, struct node *n)
 	            exclusive, reconnect, path_id, follows_default);
 
 	if (n->peer != NULL) {
-		spa_list_for_each(peer, &impl->node_list, link)
-			find_node(&find, peer);
+		find_best_node(impl, &find);
 
 		if (follows_default && find.node != NULL && find.node != n->peer) {
 			pw_log_debug(NAME " %p: node %d follows default, changed (%d -> %d)", impl, n->id,
@@ -696,8 +804,7 @@ static int rescan_node(struct impl *impl, struct node *n)
 	}
 	if (path_id == SPA_ID_INVALID && (reconnect || n->connect_count == 0)) {
 		if (find.node == NULL)
-			spa_list_for_each(peer, &impl->node_list, link)
-				find_node(&find, peer);
+			find_best_node(impl, &find);
 	} else {
 		find.node = NULL;
 	}
@@ -705,6 +812,9 @@ static int rescan_node(struct impl *impl, struct node *n)
 	if (find.node == NULL) {
 		struct sm_object *obj;
 
+		/* try again when something changed */
+		mark_dirty(impl, n);
+
 		if (!reconnect) {
 			pw_log_info("don-reconnect target node destroyed: destroy %d", n->id);
 			sm_media_session_destroy_object(impl->session, n->id);
@@ -726,6 +836,7 @@ static int rescan_node(struct impl *impl, struct node *n)
 
 	if (exclusive && peer->obj->info->state == PW_NODE_STATE_RUNNING) {
 		pw_log_warn("node %d busy, can't get exclusive access", peer->id);
+		mark_dirty(impl, n);
 		return -EBUSY;
 	}
 	n->exclusive = exclusive;
@@ -733,8 +844,9 @@ static int rescan_node(struct impl *impl, struct node *n)
 	pw_log_debug(NAME" %p: linking to node '%d'", impl, peer->id);
 
 do_link:
-	link_nodes(n, peer);
-        return 1;
+	if ((res = link_nodes(n, peer)) <= 0)
+		return res;
+	return 1;
 }
 
 static void session_info(void *data, const struct pw_core_info *info)
@@ -755,16 +867,33 @@ static void session_rescan(void *data, int seq)
 {
 	struct impl *impl = data;
 	struct node *node;
+	struct spa_list todo;
 
 	pw_log_debug(NAME" %p: rescan", impl);
 
-	spa_list_for_each(node, &impl->node_list, link)
+	/* nodes that need another look are marked dirty again and are
+	 * handled in the next rescan */
+	spa_list_init(&todo);
+	spa_list_insert_list(&todo, &impl->dirty_list);
+	spa_list_init(&impl->dirty_list);
+
+	spa_list_consume(node, &todo, dirty_link) {
+		spa_list_remove(&node->dirty_link);
+		node->dirty = false;
 		rescan_node(impl, node);
+	}
 }
 
 static void session_destroy(void *data)
 {
 	struct impl *impl = data;
+	struct media_index *index;
+
+	spa_list_consume(index, &impl->media_list, link) {
+		spa_list_remove(&index->link);
+		free(index->media);
+		free(index);
+	}
 	spa_hook_remove(&impl->listener);
 	if (impl->session->metadata)
 		spa_hook_remove(&impl->meta_listener);
@@ -845,8 +974,10 @@ static int metadata_property(void *object, uint32_t subject,
 			impl->default_video_source = val;
 		}
 
-		if (changed && impl->streams_follow_default)
+		if (changed && impl->streams_follow_default) {
+			mark_all_dirty(impl);
 			sm_media_session_schedule_rescan(impl->session);
+		}
 	} else {
 		if (val != SPA_ID_INVALID && strcmp(key, "target.node") == 0) {
 			struct node *src_node, *dst_node;
@@ -864,6 +995,7 @@ static int metadata_property(void *object, uint32_t subject,
 			if (src_node) {
 				free(src_node->obj->target_node);
 				src_node->obj->target_node = NULL;
+				mark_dirty(impl, src_node);
 				sm_media_session_schedule_rescan(impl->session);
 			}
 		}
@@ -897,6 +1029,9 @@ int sm_policy_node_start(struct sm_media_session *session)
 	impl->streams_follow_default = (flag != NULL && pw_properties_parse_bool(flag));
 
 	spa_list_init(&impl->node_list);
+	spa_list_init(&impl->device_list);
+	spa_list_init(&impl->media_list);
+	spa_list_init(&impl->dirty_list);
 
 	sm_media_session_add_listener(impl->session,
 			&impl->listener,
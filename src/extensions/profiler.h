@@ -29,24 +29,124 @@
 extern "C" {
 #endif
 
+#include <string.h>
+#include <errno.h>
+
 #include <spa/utils/defs.h>
+#include <spa/node/io.h>
 
 #define PW_TYPE_INTERFACE_Profiler		PW_TYPE_INFO_INTERFACE_BASE "Profiler"
 
-#define PW_VERSION_PROFILER			3
+#define PW_VERSION_PROFILER			4
 struct pw_profiler;
 
 #define PW_EXTENSION_MODULE_PROFILER		PIPEWIRE_MODULE_PREFIX "module-profiler"
 
+/** Timing of one node in a cycle */
+struct pw_profiler_block {
+	uint32_t id;			/**< node id */
+	int32_t status;			/**< activation status */
+	int64_t prev_signal_time;	/**< previous signal time for a driver,
+					  *  signal time of the driver for a follower */
+	int64_t signal_time;
+	int64_t awake_time;
+	int64_t finish_time;
+	struct spa_fraction latency;
+};
+
+/** One record per driver cycle, followed by n_followers blocks */
+struct pw_profiler_record {
+	uint32_t size;			/**< size of the record, including the followers */
+	uint32_t n_followers;		/**< number of follower blocks */
+	int64_t count;			/**< cycle counter */
+	float cpu_load[3];
+	int32_t xrun_count;
+	struct spa_io_clock clock;
+	struct pw_profiler_block driver;
+	struct pw_profiler_block followers[];
+};
+
+/** Shared memory ring with profiler records.
+ *
+ * The ring is written by the server on every driver cycle and is never
+ * blocked by readers. Readers keep their own read index and lose
+ * records when they fall behind more than the size of the ring. */
+struct pw_profiler_ring {
+#define PW_PROFILER_RING_MAGIC			0x50575072
+	uint32_t magic;
+	uint32_t size;			/**< size of the record area, power of 2 */
+	uint64_t begin_index;		/**< end of the record that is being written */
+	uint64_t write_index;		/**< end of the last complete record */
+	uint32_t padding[10];
+	uint8_t data[];			/**< record area */
+};
+
+/** Read the record at \a index into \a data.
+ * \a ring_size is the size of the record area that was checked when the
+ * ring was mapped, the size in the shared memory is not used.
+ * Returns the size of the record, 0 when no record is available or
+ * -EPIPE when records were lost or invalid, in which case index is moved
+ * to the next record that can be read. */
+static inline int pw_profiler_ring_read(const struct pw_profiler_ring *ring,
+		uint32_t ring_size, uint64_t *index, void *data, uint32_t max_size)
+{
+	struct pw_profiler_record *r = (struct pw_profiler_record *)data;
+	uint64_t w, idx = *index;
+	uint32_t mask = ring_size - 1, offs, size, l0;
+
+	w = __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE);
+	if (idx == w)
+		return 0;
+	if (w - idx > ring_size)
+		goto overrun;
+
+	offs = idx & mask;
+	size = *(const uint32_t *)&ring->data[offs];
+	if (size < sizeof(struct pw_profiler_record) || size > w - idx ||
+	    size > max_size)
+		goto overrun;
+
+	l0 = SPA_MIN(size, ring_size - offs);
+	memcpy(data, &ring->data[offs], l0);
+	memcpy(SPA_MEMBER(data, l0, void), ring->data, size - l0);
+
+	/* check that the writer did not touch what we copied */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&ring->begin_index, __ATOMIC_RELAXED) - idx > ring_size)
+		goto overrun;
+
+	/* the followers must be inside the record we copied */
+	if (r->n_followers > (size - sizeof(*r)) / sizeof(struct pw_profiler_block))
+		goto overrun;
+	r->clock.name[sizeof(r->clock.name) - 1] = '\0';
+
+	*index = idx + size;
+	return size;
+
+overrun:
+	*index = __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE);
+	return -EPIPE;
+}
+
 #define PW_PROFILER_EVENT_PROFILE		0
-#define PW_PROFILER_EVENT_NUM			1
+#define PW_PROFILER_EVENT_RING			1
+#define PW_PROFILER_EVENT_NUM			2
 
 /** \ref pw_profiler events */
 struct pw_profiler_events {
-#define PW_VERSION_PROFILER_EVENTS		0
+#define PW_VERSION_PROFILER_EVENTS		1
 	uint32_t version;
 
+	/** profiling data, only sent to profilers with version < 4 */
 	void (*profile) (void *object, const struct spa_pod *pod);
+	/**
+	 * The shared memory ring with \ref pw_profiler_record items.
+	 * Since version 4.
+	 *
+	 * \param fd a memfd that can be mapped read-only
+	 * \param size the size of the memory
+	 */
+	void (*ring) (void *object, int fd, uint32_t size);
 };
 
 #define PW_PROFILER_METHOD_ADD_LISTENER		0
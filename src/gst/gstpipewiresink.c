@@ -65,7 +65,8 @@ enum
   PROP_CLIENT_NAME,
   PROP_STREAM_PROPERTIES,
   PROP_MODE,
-  PROP_FD
+  PROP_FD,
+  PROP_BUFFER_STATS
 };
 
 GType
@@ -135,11 +136,36 @@ static gboolean
 gst_pipewire_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 {
   GstPipeWireSink *pwsink = GST_PIPEWIRE_SINK (bsink);
+  GstCaps *caps;
+  GstVideoInfo info;
+  guint size = 0;
+
+  /* let upstream render directly into the PipeWire buffers, frames from
+   * another pool need to be copied in render */
+  gst_query_parse_allocation (query, &caps, NULL);
+  if (caps && gst_video_info_from_caps (&info, caps))
+    size = info.size;
 
-  gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pwsink->pool), 0, 0, 0);
+  gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pwsink->pool),
+      size, MIN_BUFFERS, 0);
   return TRUE;
 }
 
+static GstStructure *
+gst_pipewire_sink_get_buffer_stats (GstPipeWireSink * pwsink)
+{
+  GstStructure *s;
+
+  GST_OBJECT_LOCK (pwsink);
+  s = gst_structure_new ("application/x-pipewire-sink-stats",
+      "zero-copy", G_TYPE_UINT64, pwsink->n_zero_copy,
+      "copied", G_TYPE_UINT64, pwsink->n_copied,
+      NULL);
+  GST_OBJECT_UNLOCK (pwsink);
+
+  return s;
+}
+
 static void
 gst_pipewire_sink_class_init (GstPipeWireSinkClass * klass)
 {
@@ -201,6 +227,16 @@ gst_pipewire_sink_class_init (GstPipeWireSinkClass * klass)
                                                       G_PARAM_READWRITE |
                                                       G_PARAM_STATIC_STRINGS));
 
+   g_object_class_install_property (gobject_class,
+                                    PROP_BUFFER_STATS,
+                                    g_param_spec_boxed ("buffer-stats",
+                                                        "Buffer statistics",
+                                                        "Number of frames sent without copy and "
+                                                        "frames copied into PipeWire buffers",
+                                                        GST_TYPE_STRUCTURE,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state = gst_pipewire_sink_change_state;
 
   gst_element_class_set_static_metadata (gstelement_class,
@@ -392,6 +428,10 @@ gst_pipewire_sink_get_property (GObject * object, guint prop_id,
       g_value_set_int (value, pwsink->fd);
       break;
 
+    case PROP_BUFFER_STATS:
+      g_value_take_boxed (value, gst_pipewire_sink_get_buffer_stats (pwsink));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -617,9 +657,17 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
     buffer = b;
 
+    GST_OBJECT_LOCK (pwsink);
+    pwsink->n_copied++;
+    GST_OBJECT_UNLOCK (pwsink);
+
     pw_thread_loop_lock (pwsink->core->loop);
     if (pw_stream_get_state (pwsink->stream, &error) != PW_STREAM_STATE_STREAMING)
       goto done_unlock;
+  } else {
+    GST_OBJECT_LOCK (pwsink);
+    pwsink->n_zero_copy++;
+    GST_OBJECT_UNLOCK (pwsink);
   }
 
   GST_DEBUG ("push buffer");
@@ -673,6 +721,11 @@ gst_pipewire_sink_start (GstBaseSink * basesink)
 
   pwsink->negotiated = FALSE;
 
+  GST_OBJECT_LOCK (pwsink);
+  pwsink->n_zero_copy = 0;
+  pwsink->n_copied = 0;
+  GST_OBJECT_UNLOCK (pwsink);
+
   props = pw_properties_new (NULL, NULL);
   if (pwsink->client_name) {
     pw_properties_set (props, PW_KEY_NODE_NAME, pwsink->client_name);
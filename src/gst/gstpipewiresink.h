@@ -94,6 +94,10 @@ struct _GstPipeWireSink {
   GstPipeWireSinkMode mode;
 
   GstPipeWirePool *pool;
+
+  /* stats */
+  guint64 n_zero_copy;
+  guint64 n_copied;
 };
 
 struct _GstPipeWireSinkClass {
@@ -80,6 +80,7 @@ struct node_data {
 	unsigned int have_transport:1;
 	unsigned int allow_mlock:1;
 	unsigned int warn_mlock:1;
+	unsigned int rt_direct:1;
 
 	struct pw_client_node *client_node;
 	struct spa_hook client_node_listener;
@@ -169,7 +170,7 @@ do_deactivate_mix(struct spa_loop *loop,
                 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct mix *mix = user_data;
-	spa_list_remove(&mix->mix.rt_link);
+	pw_impl_port_remove_rt_mix(mix->port, &mix->mix);
         return 0;
 }
 
@@ -977,6 +978,13 @@ static void clean_node(struct node_data *d)
 {
 	struct mix *mix, *tmp;
 
+	/* the data loop must not wait on the node anymore, the node is
+	 * destroyed or left behind when the client node goes away */
+	if (d->rt_direct) {
+		pw_data_loop_set_rt_source(d->context->data_loop_impl, NULL);
+		d->rt_direct = false;
+	}
+
 	if (d->have_transport) {
 		spa_list_for_each_safe(mix, tmp, &d->mix[SPA_DIRECTION_INPUT], link)
 			clear_mix(d, mix);
@@ -1222,6 +1230,26 @@ static struct pw_proxy *node_export(struct pw_core *core, void *object, bool do_
 	if ((str = pw_properties_get(node->properties, "mem.warn-mlock")) != NULL)
 		data->warn_mlock = pw_properties_parse_bool(str);
 
+	if ((str = pw_properties_get(node->properties, "node.rt-direct")) != NULL &&
+	    pw_properties_parse_bool(str)) {
+		int res;
+		if ((res = pw_data_loop_set_rt_source(data->context->data_loop_impl,
+						&node->source)) < 0)
+			pw_log_warn("remote-node %p: can't wait directly on activation: %s",
+					client_node, spa_strerror(res));
+		else
+			data->rt_direct = true;
+	}
+	if (data->rt_direct &&
+	    (str = pw_properties_get(node->properties, "node.rt-busy-poll")) != NULL) {
+		int res;
+		uint64_t usec = strtoull(str, NULL, 0);
+		if ((res = pw_data_loop_set_busy_poll(data->context->data_loop_impl,
+						node, usec * SPA_NSEC_PER_USEC)) < 0)
+			pw_log_warn("remote-node %p: can't busy poll: %s",
+					client_node, spa_strerror(res));
+	}
+
 	node->exported = true;
 
 	spa_list_init(&data->free_mix);
@@ -33,7 +33,6 @@
 #include "config.h"
 
 #include <spa/utils/result.h>
-#include <spa/utils/ringbuffer.h>
 #include <spa/param/profiler.h>
 #include <spa/debug/pod.h>
 
@@ -41,10 +40,17 @@
 #include <pipewire/impl.h>
 #include <extensions/profiler.h>
 
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE	0x0010
+#endif
+
 #define NAME "profiler"
 
-#define MAX_BUFFER		(8 * 1024 * 1024)
-#define MIN_FLUSH		(16 * 1024)
+#define RING_SIZE		(8 * 1024 * 1024)
+#define MAX_FOLLOWERS		1024
+#define MAX_RECORD		(sizeof(struct pw_profiler_record) + \
+				 MAX_FOLLOWERS * sizeof(struct pw_profiler_block))
+#define POD_BUFFER		(64 * 1024)
 #define DEFAULT_IDLE		5
 #define DEFAULT_INTERVAL	1
 
@@ -55,6 +61,8 @@ int pw_protocol_native_ext_profiler_init(struct pw_context *context);
 
 #define pw_profiler_resource_profile(r,...)        \
         pw_profiler_resource(r,profile,0,__VA_ARGS__)
+#define pw_profiler_resource_ring(r,...)        \
+        pw_profiler_resource(r,ring,1,__VA_ARGS__)
 
 static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
@@ -78,8 +86,15 @@ struct impl {
 	unsigned int flushing:1;
 	unsigned int listening:1;
 
-	struct spa_ringbuffer buffer;
-	uint8_t data[MAX_BUFFER];
+	struct pw_memblock *mem;
+	struct pw_profiler_ring *ring;
+	int ring_fd;			/* read-only fd for the clients */
+
+	/* profilers older than version 4 receive the records as pods */
+	uint32_t n_legacy;
+	uint64_t read_index;
+	uint8_t record[MAX_RECORD];
+	uint8_t pod_buffer[POD_BUFFER];
 };
 
 struct resource_data {
@@ -87,6 +102,7 @@ struct resource_data {
 
 	struct pw_resource *resource;
 	struct spa_hook resource_listener;
+	unsigned int legacy:1;
 };
 
 static void start_flush(struct impl *impl)
@@ -118,85 +134,209 @@ static void stop_flush(struct impl *impl)
 	impl->flushing = false;
 }
 
+static const char *node_name(struct impl *impl, uint32_t id)
+{
+	struct pw_global *global;
+	struct pw_impl_node *node;
+
+	global = pw_context_find_global(impl->context, id);
+	if (global == NULL || !pw_global_is_type(global, PW_TYPE_INTERFACE_Node))
+		return "";
+	node = pw_global_get_object(global);
+	return node->name;
+}
+
+static void add_record_pod(struct impl *impl, struct spa_pod_builder *b,
+		const struct pw_profiler_record *r)
+{
+	const struct spa_io_clock *clock = &r->clock;
+	const struct pw_profiler_block *block = &r->driver;
+	struct spa_pod_frame f;
+	uint32_t i;
+
+	spa_pod_builder_push_object(b, &f, SPA_TYPE_OBJECT_Profiler, 0);
+
+	spa_pod_builder_prop(b, SPA_PROFILER_info, 0);
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Long(r->count),
+			SPA_POD_Float(r->cpu_load[0]),
+			SPA_POD_Float(r->cpu_load[1]),
+			SPA_POD_Float(r->cpu_load[2]),
+			SPA_POD_Int(r->xrun_count));
+
+	spa_pod_builder_prop(b, SPA_PROFILER_clock, 0);
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(clock->flags),
+			SPA_POD_Int(clock->id),
+			SPA_POD_String(clock->name),
+			SPA_POD_Long(clock->nsec),
+			SPA_POD_Fraction(&clock->rate),
+			SPA_POD_Long(clock->position),
+			SPA_POD_Long(clock->duration),
+			SPA_POD_Long(clock->delay),
+			SPA_POD_Double(clock->rate_diff),
+			SPA_POD_Long(clock->next_nsec));
+
+	for (i = 0; i <= r->n_followers; i++) {
+		if (i > 0) {
+			block = &r->followers[i - 1];
+			spa_pod_builder_prop(b, SPA_PROFILER_followerBlock, 0);
+		} else {
+			spa_pod_builder_prop(b, SPA_PROFILER_driverBlock, 0);
+		}
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(block->id),
+				SPA_POD_String(node_name(impl, block->id)),
+				SPA_POD_Long(block->prev_signal_time),
+				SPA_POD_Long(block->signal_time),
+				SPA_POD_Long(block->awake_time),
+				SPA_POD_Long(block->finish_time),
+				SPA_POD_Int(block->status),
+				SPA_POD_Fraction(&block->latency));
+	}
+	spa_pod_builder_pop(b, &f);
+}
+
+static void send_pods(struct impl *impl, struct spa_pod_builder *b, struct spa_pod_frame *f)
+{
+	struct pw_resource *resource;
+	struct spa_pod *pod;
+
+	pod = spa_pod_builder_pop(b, f);
+	if (pod == NULL)
+		return;
+
+	spa_list_for_each(resource, &impl->global->resource_list, link) {
+		struct resource_data *data = pw_resource_get_user_data(resource);
+		if (data->legacy)
+			pw_profiler_resource_profile(resource, pod);
+	}
+}
+
 static void flush_timeout(void *data, uint64_t expirations)
 {
 	struct impl *impl = data;
-	int32_t avail, size;
-	uint32_t idx;
-	struct spa_pod_struct *p;
-	struct pw_resource *resource;
+	const struct pw_profiler_record *r = (const struct pw_profiler_record *)impl->record;
+	struct spa_pod_builder b;
+	struct spa_pod_frame f;
+	uint32_t n_records = 0;
+	int res;
 
-	avail = spa_ringbuffer_get_read_index(&impl->buffer, &idx);
+	if (impl->n_legacy == 0) {
+		stop_flush(impl);
+		return;
+	}
+
+	spa_pod_builder_init(&b, impl->pod_buffer, sizeof(impl->pod_buffer));
+	spa_pod_builder_push_struct(&b, &f);
+
+	while ((res = pw_profiler_ring_read(impl->ring, RING_SIZE, &impl->read_index,
+					impl->record, sizeof(impl->record))) != 0) {
+		if (res < 0) {
+			pw_log_warn(NAME" %p: lost profiler records", impl);
+			continue;
+		}
+		if (r->n_followers > MAX_FOLLOWERS)
+			continue;
+		if (b.state.offset > POD_BUFFER / 2) {
+			send_pods(impl, &b, &f);
+			spa_pod_builder_init(&b, impl->pod_buffer, sizeof(impl->pod_buffer));
+			spa_pod_builder_push_struct(&b, &f);
+		}
+		add_record_pod(impl, &b, r);
+		n_records++;
+	}
 
-	pw_log_trace(NAME"%p avail %d", impl, avail);
+	pw_log_trace(NAME"%p records %u", impl, n_records);
 
-	if (avail <= 0) {
+	if (n_records == 0) {
 		if (++impl->empty == DEFAULT_IDLE)
 			stop_flush(impl);
 		return;
 	}
 	impl->empty = 0;
 
-	size = avail + sizeof(struct spa_pod_struct);
-	p = alloca(size);
-	*p = SPA_POD_INIT_Struct(avail);
+	send_pods(impl, &b, &f);
+}
 
-	spa_ringbuffer_read_data(&impl->buffer, impl->data, MAX_BUFFER,
-			idx % MAX_BUFFER,
-			SPA_MEMBER(p, sizeof(struct spa_pod_struct), void), avail);
-	spa_ringbuffer_read_update(&impl->buffer, idx + avail);
+static inline void write_ring(struct pw_profiler_ring *ring, uint64_t index,
+		const void *data, uint32_t size)
+{
+	uint32_t offs = index & (RING_SIZE - 1);
+	uint32_t l0 = SPA_MIN(size, RING_SIZE - offs);
 
-	spa_list_for_each(resource, &impl->global->resource_list, link)
-		pw_profiler_resource_profile(resource, &p->pod);
+	memcpy(&ring->data[offs], data, l0);
+	memcpy(ring->data, SPA_MEMBER(data, l0, void), size - l0);
+}
+
+/* clients can only read the ring. Seal the memory against new writable
+ * mappings and give clients a read-only fd. A read-only reopen alone does
+ * not stop a client from opening the memfd again for writing, so clients
+ * only get the ring when it is sealed and receive profile pods otherwise. */
+static int open_ring_fd(struct impl *impl)
+{
+	char path[64];
+	int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+	if (fcntl(impl->mem->fd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK |
+				F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0) {
+		pw_log_warn(NAME" %p: can't seal ring: %m", impl);
+		return -1;
+	}
+#else
+	return -1;
+#endif
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", impl->mem->fd);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0)
+		return fd;
+
+	pw_log_warn(NAME" %p: can't open read-only ring: %m", impl);
+	return impl->mem->fd;
 }
 
 static void context_do_profile(void *data, struct pw_impl_node *node)
 {
 	struct impl *impl = data;
-	char buffer[4096];
-	struct spa_pod_builder b;
-	struct spa_pod_frame f[2];
+	struct pw_profiler_ring *ring = impl->ring;
 	struct pw_node_activation *a = node->rt.activation;
 	struct spa_io_position *pos = &a->position;
 	struct pw_node_target *t;
-	int32_t filled;
-	uint32_t idx, avail;
-
-	spa_pod_builder_init(&b, buffer, sizeof(buffer));
-	spa_pod_builder_push_object(&b, &f[0],
-			SPA_TYPE_OBJECT_Profiler, 0);
-
-	spa_pod_builder_prop(&b, SPA_PROFILER_info, 0);
-	spa_pod_builder_add_struct(&b,
-			SPA_POD_Long(impl->count),
-			SPA_POD_Float(a->cpu_load[0]),
-			SPA_POD_Float(a->cpu_load[1]),
-			SPA_POD_Float(a->cpu_load[2]),
-			SPA_POD_Int(a->xrun_count));
-
-	spa_pod_builder_prop(&b, SPA_PROFILER_clock, 0);
-	spa_pod_builder_add_struct(&b,
-			SPA_POD_Int(pos->clock.flags),
-			SPA_POD_Int(pos->clock.id),
-			SPA_POD_String(pos->clock.name),
-			SPA_POD_Long(pos->clock.nsec),
-			SPA_POD_Fraction(&pos->clock.rate),
-			SPA_POD_Long(pos->clock.position),
-			SPA_POD_Long(pos->clock.duration),
-			SPA_POD_Long(pos->clock.delay),
-			SPA_POD_Double(pos->clock.rate_diff),
-			SPA_POD_Long(pos->clock.next_nsec));
-
-	spa_pod_builder_prop(&b, SPA_PROFILER_driverBlock, 0);
-	spa_pod_builder_add_struct(&b,
-			SPA_POD_Int(node->info.id),
-			SPA_POD_String(node->name),
-			SPA_POD_Long(a->prev_signal_time),
-			SPA_POD_Long(a->signal_time),
-			SPA_POD_Long(a->awake_time),
-			SPA_POD_Long(a->finish_time),
-			SPA_POD_Int(a->status),
-			SPA_POD_Fraction(&node->latency));
+	struct pw_profiler_record r;
+	struct pw_profiler_block f;
+	uint64_t index;
+	uint32_t n_followers = 0;
+
+	spa_list_for_each(t, &node->rt.target_list, link) {
+		if (t->node != NULL && t->node != node)
+			n_followers++;
+	}
+	n_followers = SPA_MIN(n_followers, (uint32_t)MAX_FOLLOWERS);
+
+	r.size = sizeof(r) + n_followers * sizeof(f);
+	r.n_followers = n_followers;
+	r.count = impl->count;
+	r.cpu_load[0] = a->cpu_load[0];
+	r.cpu_load[1] = a->cpu_load[1];
+	r.cpu_load[2] = a->cpu_load[2];
+	r.xrun_count = a->xrun_count;
+	r.clock = pos->clock;
+	r.driver.id = node->info.id;
+	r.driver.status = a->status;
+	r.driver.prev_signal_time = a->prev_signal_time;
+	r.driver.signal_time = a->signal_time;
+	r.driver.awake_time = a->awake_time;
+	r.driver.finish_time = a->finish_time;
+	r.driver.latency = node->latency;
+
+	/* readers don't block us, announce the region we are about to
+	 * overwrite so that they can detect it */
+	index = ring->write_index;
+	__atomic_store_n(&ring->begin_index, index + r.size, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	write_ring(ring, index, &r, sizeof(r));
+	index += sizeof(r);
 
 	spa_list_for_each(t, &node->rt.target_list, link) {
 		struct pw_impl_node *n = t->node;
@@ -204,40 +344,26 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 
 		if (n == NULL || n == node)
 			continue;
+		if (n_followers-- == 0)
+			break;
 
 		na = n->rt.activation;
-		spa_pod_builder_prop(&b, SPA_PROFILER_followerBlock, 0);
-		spa_pod_builder_add_struct(&b,
-			SPA_POD_Int(n->info.id),
-			SPA_POD_String(n->name),
-			SPA_POD_Long(a->signal_time),
-			SPA_POD_Long(na->signal_time),
-			SPA_POD_Long(na->awake_time),
-			SPA_POD_Long(na->finish_time),
-			SPA_POD_Int(na->status),
-			SPA_POD_Fraction(&n->latency));
-	}
-	spa_pod_builder_pop(&b, &f[0]);
-
-	filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-	if (filled < 0 || filled > MAX_BUFFER) {
-		pw_log_warn(NAME " %p: queue xrun %d", impl, filled);
-		goto done;
-	}
-	avail = MAX_BUFFER - filled;
-	if (avail < b.state.offset) {
-		pw_log_warn(NAME " %p: queue full %d < %d", impl, avail, b.state.offset);
-		goto done;
+		f.id = n->info.id;
+		f.status = na->status;
+		f.prev_signal_time = a->signal_time;
+		f.signal_time = na->signal_time;
+		f.awake_time = na->awake_time;
+		f.finish_time = na->finish_time;
+		f.latency = n->latency;
+
+		write_ring(ring, index, &f, sizeof(f));
+		index += sizeof(f);
 	}
-	spa_ringbuffer_write_data(&impl->buffer,
-			impl->data, MAX_BUFFER,
-			idx % MAX_BUFFER,
-			b.data, b.state.offset);
-	spa_ringbuffer_write_update(&impl->buffer, idx + b.state.offset);
+	__atomic_store_n(&ring->write_index, index, __ATOMIC_RELEASE);
 
-	if (!impl->flushing || filled + b.state.offset > MIN_FLUSH)
+	if (impl->n_legacy > 0 && !impl->flushing)
 		start_flush(impl);
-done:
+
 	impl->count++;
 }
 
@@ -264,9 +390,14 @@ static void stop_listener(struct impl *impl)
 	}
 }
 
-static void resource_destroy(void *data)
+static void resource_destroy(void *_data)
 {
-	struct impl *impl = data;
+	struct resource_data *data = _data;
+	struct impl *impl = data->impl;
+
+	if (data->legacy)
+		impl->n_legacy--;
+
 	if (--impl->busy == 0) {
 		pw_log_info(NAME" %p: stopping profiler", impl);
 		stop_listener(impl);
@@ -308,7 +439,16 @@ global_bind(void *_data, struct pw_impl_client *client, uint32_t permissions,
 	pw_global_add_resource(global, resource);
 
 	pw_resource_add_listener(resource, &data->resource_listener,
-			&resource_events, impl);
+			&resource_events, data);
+
+	if (version >= 4 && impl->ring_fd >= 0) {
+		pw_profiler_resource_ring(resource, impl->ring_fd, impl->mem->size);
+	} else {
+		if (impl->n_legacy++ == 0)
+			impl->read_index = __atomic_load_n(&impl->ring->write_index,
+					__ATOMIC_ACQUIRE);
+		data->legacy = true;
+	}
 
 	if (++impl->busy == 1) {
 		pw_log_info(NAME" %p: starting profiler", impl);
@@ -327,6 +467,10 @@ static void module_destroy(void *data)
 
 	spa_hook_remove(&impl->module_listener);
 
+	if (impl->ring_fd >= 0 && impl->ring_fd != impl->mem->fd)
+		close(impl->ring_fd);
+	pw_memblock_unref(impl->mem);
+
 	if (impl->properties)
 		pw_properties_free(impl->properties);
 
@@ -345,6 +489,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	struct pw_properties *props;
 	struct impl *impl;
 	struct pw_loop *main_loop = pw_context_get_main_loop(context);
+	int res;
 
 	impl = calloc(1, sizeof(struct impl));
 	if (impl == NULL)
@@ -361,8 +506,22 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	impl->context = context;
 	impl->properties = props;
-
-	spa_ringbuffer_init(&impl->buffer);
+	impl->ring_fd = -1;
+
+	/* sealed after we mapped it */
+	impl->mem = pw_mempool_alloc(context->pool,
+			PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_MAP,
+			SPA_DATA_MemFd,
+			sizeof(struct pw_profiler_ring) + RING_SIZE);
+	if (impl->mem == NULL) {
+		res = -errno;
+		goto error;
+	}
+	impl->ring = impl->mem->map->ptr;
+	impl->ring->magic = PW_PROFILER_RING_MAGIC;
+	impl->ring->size = RING_SIZE;
+	impl->ring_fd = open_ring_fd(impl);
 
 	impl->global = pw_global_new(context,
 			PW_TYPE_INTERFACE_Profiler,
@@ -370,8 +529,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 			pw_properties_copy(props),
 			global_bind, impl);
 	if (impl->global == NULL) {
-		free(impl);
-		return -errno;
+		res = -errno;
+		goto error;
 	}
 
 	impl->flush_timeout = pw_loop_add_timer(main_loop, flush_timeout, impl);
@@ -383,4 +542,14 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	pw_global_register(impl->global);
 
 	return 0;
+
+error:
+	if (impl->ring_fd >= 0 && impl->ring_fd != impl->mem->fd)
+		close(impl->ring_fd);
+	if (impl->mem)
+		pw_memblock_unref(impl->mem);
+	if (impl->properties)
+		pw_properties_free(impl->properties);
+	free(impl);
+	return res;
 }
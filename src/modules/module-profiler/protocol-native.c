@@ -61,6 +61,20 @@ static void profiler_resource_marshal_profile(void *object, const struct spa_pod
 	pw_protocol_native_end_resource(resource, b);
 }
 
+static void profiler_resource_marshal_ring(void *object, int fd, uint32_t size)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_resource(resource, PW_PROFILER_EVENT_RING, NULL);
+
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Fd(pw_protocol_native_add_resource_fd(resource, fd)),
+			SPA_POD_Int(size));
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
 static int profiler_proxy_demarshal_profile(void *object,
 		const struct pw_protocol_native_message *msg)
 {
@@ -77,6 +91,30 @@ static int profiler_proxy_demarshal_profile(void *object,
 	return 0;
 }
 
+static int profiler_proxy_demarshal_ring(void *object,
+		const struct pw_protocol_native_message *msg)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	int64_t idx;
+	uint32_t size;
+	int fd;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+
+	if (spa_pod_parser_get_struct(&prs,
+				SPA_POD_Fd(&idx),
+				SPA_POD_Int(&size)) < 0)
+		return -EINVAL;
+
+	fd = pw_protocol_native_get_proxy_fd(proxy, idx);
+	if (fd < 0)
+		return -EINVAL;
+
+	pw_proxy_notify(proxy, struct pw_profiler_events, ring, 1, fd, size);
+	return 0;
+}
+
 
 static const struct pw_profiler_methods pw_protocol_native_profiler_client_method_marshal = {
 	PW_VERSION_PROFILER_METHODS,
@@ -92,12 +130,14 @@ pw_protocol_native_profiler_server_method_demarshal[PW_PROFILER_METHOD_NUM] =
 static const struct pw_profiler_events pw_protocol_native_profiler_server_event_marshal = {
 	PW_VERSION_PROFILER_EVENTS,
 	.profile = &profiler_resource_marshal_profile,
+	.ring = &profiler_resource_marshal_ring,
 };
 
 static const struct pw_protocol_native_demarshal
 pw_protocol_native_profiler_client_event_demarshal[PW_PROFILER_EVENT_NUM] =
 {
 	[PW_PROFILER_EVENT_PROFILE] = { &profiler_proxy_demarshal_profile, 0 },
+	[PW_PROFILER_EVENT_RING] = { &profiler_proxy_demarshal_ring, 0 },
 };
 
 static const struct pw_protocol_marshal pw_protocol_native_profiler_marshal = {
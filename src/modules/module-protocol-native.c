@@ -92,6 +92,8 @@ struct protocol_data {
 	struct pw_protocol *protocol;
 
 	struct server *local;
+
+	struct pw_protocol_native_global_cache global_cache;
 };
 
 struct client {
@@ -1224,12 +1226,21 @@ static const struct pw_protocol_native_ext protocol_ext_impl = {
 	.end_resource = impl_ext_end_resource,
 };
 
+struct pw_protocol_native_global_cache *
+pw_protocol_native_get_global_cache(struct pw_protocol *protocol)
+{
+	struct protocol_data *d = pw_protocol_get_user_data(protocol);
+	return &d->global_cache;
+}
+
 static void module_destroy(void *data)
 {
 	struct protocol_data *d = data;
 
 	spa_hook_remove(&d->module_listener);
 
+	free(d->global_cache.data);
+
 	pw_protocol_destroy(d->protocol);
 }
 
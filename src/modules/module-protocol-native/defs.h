@@ -22,6 +22,19 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+/** the last global event that was encoded while broadcasting a new
+ * global to all registries */
+struct pw_protocol_native_global_cache {
+	uint32_t serial;
+	uint32_t id;
+	uint32_t size;
+	uint32_t alloc;
+	void *data;
+};
+
+struct pw_protocol_native_global_cache *
+pw_protocol_native_get_global_cache(struct pw_protocol *protocol);
+
 int pw_protocol_native_connect_local_socket(struct pw_protocol_client *client,
 					    const struct spa_dict *props,
 					    void (*done_callback) (void *data, int res),
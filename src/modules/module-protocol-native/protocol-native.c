@@ -30,9 +30,11 @@
 #include <spa/utils/result.h>
 
 #include <pipewire/impl.h>
+#include <pipewire/private.h>
 #include <extensions/protocol-native.h>
 
 #include "connection.h"
+#include "defs.h"
 
 static int core_method_marshal_add_listener(void *object,
 			struct spa_hook *listener,
@@ -667,10 +669,28 @@ static void registry_marshal_global(void *object, uint32_t id, uint32_t permissi
 				    const char *type, uint32_t version, const struct spa_dict *props)
 {
 	struct pw_resource *resource = object;
+	struct pw_context *context = resource->context;
+	struct pw_protocol_native_global_cache *cache;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
+	struct spa_pod *pod;
+	uint32_t ref;
+
+	cache = pw_protocol_native_get_global_cache(resource->client->protocol);
 
 	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_EVENT_GLOBAL, NULL);
+	ref = b->state.offset;
+
+	if ((context->broadcast_serial & 1) &&
+	    cache->serial == context->broadcast_serial && cache->id == id) {
+		/* copy the event of the previous registry, only the permissions
+		 * in the second field of the struct can be different */
+		spa_pod_builder_raw(b, cache->data, cache->size);
+		if ((pod = spa_pod_builder_deref(b, ref)) != NULL)
+			SPA_MEMBER(SPA_POD_BODY(pod), sizeof(struct spa_pod_int),
+					struct spa_pod_int)->value = permissions;
+		goto done;
+	}
 
 	spa_pod_builder_push_struct(b, &f);
 	spa_pod_builder_add(b,
@@ -682,6 +702,22 @@ static void registry_marshal_global(void *object, uint32_t id, uint32_t permissi
 	push_dict(b, props);
 	spa_pod_builder_pop(b, &f);
 
+	if ((context->broadcast_serial & 1) &&
+	    (pod = spa_pod_builder_deref(b, ref)) != NULL) {
+		uint32_t size = SPA_POD_SIZE(pod);
+		if (size > cache->alloc) {
+			void *data = realloc(cache->data, size);
+			if (data == NULL)
+				goto done;
+			cache->data = data;
+			cache->alloc = size;
+		}
+		memcpy(cache->data, pod, size);
+		cache->size = size;
+		cache->serial = context->broadcast_serial;
+		cache->id = id;
+	}
+done:
 	pw_protocol_native_end_resource(resource, b);
 }
 
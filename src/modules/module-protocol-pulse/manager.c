@@ -50,10 +50,17 @@ struct object_info {
 	const char *type;
 	uint32_t version;
 	const void *events;
+	const uint32_t *params;		/**< the params that are enumerated and kept */
+	uint32_t n_params;
 	void (*init) (struct object *object);
 	void (*destroy) (struct object *object);
 };
 
+struct param_index {
+	uint32_t id;
+	struct spa_list list;		/**< params with id, linked with index_link */
+};
+
 struct object {
 	struct pw_manager_object this;
 
@@ -62,6 +69,7 @@ struct object {
 	const struct object_info *info;
 
 	struct spa_list pending_list;
+	struct param_index *index;	/**< one for each of the params in info */
 
 	struct spa_hook proxy_listener;
 	struct spa_hook object_listener;
@@ -96,18 +104,33 @@ static struct pw_manager_param *add_param(struct spa_list *params, uint32_t id,
 	return p;
 }
 
-static bool has_param(struct spa_list *param_list, struct pw_manager_param *p)
+static struct param_index *find_param_index(struct object *o, uint32_t id)
+{
+	uint32_t i;
+	for (i = 0; i < o->info->n_params; i++) {
+		if (o->index[i].id == id)
+			return &o->index[i];
+	}
+	return NULL;
+}
+
+static bool has_param(struct object *o, struct pw_manager_param *p)
 {
+	struct param_index *index;
 	struct pw_manager_param *t;
-	spa_list_for_each(t, param_list, link) {
-		if (p->id == t->id &&
-		   SPA_POD_SIZE(p->param) == SPA_POD_SIZE(t->param) &&
-		   memcmp(p->param, t->param, SPA_POD_SIZE(p->param)) == 0)
+
+	if ((index = find_param_index(o, p->id)) == NULL)
+		return false;
+
+	spa_list_for_each(t, &index->list, index_link) {
+		if (SPA_POD_SIZE(p->param) == SPA_POD_SIZE(t->param) &&
+		    memcmp(p->param, t->param, SPA_POD_SIZE(p->param)) == 0)
 			return true;
 	}
 	return false;
 }
 
+/* clear the params in the pending list */
 static uint32_t clear_params(struct spa_list *param_list, uint32_t id)
 {
 	struct pw_manager_param *p, *t;
@@ -124,6 +147,32 @@ static uint32_t clear_params(struct spa_list *param_list, uint32_t id)
 }
 
 
+/* clear the kept params of the object */
+static void object_clear_params(struct object *o, uint32_t id)
+{
+	struct param_index *index;
+	struct pw_manager_param *p, *t;
+	uint32_t i;
+
+	if (id == SPA_ID_INVALID) {
+		spa_list_consume(p, &o->this.param_list, link) {
+			spa_list_remove(&p->link);
+			free(p);
+		}
+		for (i = 0; i < o->info->n_params; i++)
+			spa_list_init(&o->index[i].list);
+		return;
+	}
+	if ((index = find_param_index(o, id)) == NULL)
+		return;
+
+	spa_list_for_each_safe(p, t, &index->list, index_link) {
+		spa_list_remove(&p->index_link);
+		spa_list_remove(&p->link);
+		free(p);
+	}
+}
+
 static struct object *find_object(struct manager *m, uint32_t id)
 {
 	struct object *o;
@@ -138,14 +187,20 @@ static struct object *find_object(struct manager *m, uint32_t id)
 
 static void object_update_params(struct object *o)
 {
+	struct param_index *index;
 	struct pw_manager_param *p;
 
 	spa_list_for_each(p, &o->pending_list, link)
-		clear_params(&o->this.param_list, p->id);
+		object_clear_params(o, p->id);
 
 	spa_list_consume(p, &o->pending_list, link) {
 		spa_list_remove(&p->link);
+		if ((index = find_param_index(o, p->id)) == NULL) {
+			free(p);
+			continue;
+		}
 		spa_list_append(&o->this.param_list, &p->link);
+		spa_list_append(&index->list, &p->index_link);
 	}
 }
 
@@ -158,8 +213,9 @@ static void object_destroy(struct object *o)
 		pw_proxy_destroy(o->this.proxy);
 	if (o->this.props)
 		pw_properties_free(o->this.props);
-	clear_params(&o->this.param_list, SPA_ID_INVALID);
+	object_clear_params(o, SPA_ID_INVALID);
 	clear_params(&o->pending_list, SPA_ID_INVALID);
+	free(o->index);
 	free(o);
 }
 
@@ -278,7 +334,8 @@ static void device_event_info(void *object, const struct pw_device_info *info)
 				break;
 			}
 			clear_params(&o->pending_list, id);
-			if (!(info->params[i].flags & SPA_PARAM_INFO_READ))
+			if (!(info->params[i].flags & SPA_PARAM_INFO_READ) ||
+			    find_param_index(o, id) == NULL)
 				continue;
 
 			pw_device_enum_params((struct pw_device*)o->this.proxy,
@@ -321,7 +378,7 @@ static void device_event_param(void *object, int seq,
 
 	p = add_param(&o->pending_list, id, param);
 
-	if (id == SPA_PARAM_Route && !has_param(&o->this.param_list, p)) {
+	if (id == SPA_PARAM_Route && p != NULL && !has_param(o, p)) {
 		uint32_t id, device;
 		if (spa_pod_parse_object(param,
 				SPA_TYPE_OBJECT_ParamRoute, NULL,
@@ -350,10 +407,19 @@ static void device_destroy(struct object *o)
 	}
 }
 
+static const uint32_t device_params[] = {
+	SPA_PARAM_EnumProfile,
+	SPA_PARAM_Profile,
+	SPA_PARAM_EnumRoute,
+	SPA_PARAM_Route,
+};
+
 static const struct object_info device_info = {
 	.type = PW_TYPE_INTERFACE_Device,
 	.version = PW_VERSION_DEVICE,
 	.events = &device_events,
+	.params = device_params,
+	.n_params = SPA_N_ELEMENTS(device_params),
 	.destroy = device_destroy,
 };
 
@@ -383,7 +449,8 @@ static void node_event_info(void *object, const struct pw_node_info *info)
 
 			changed++;
 			clear_params(&o->pending_list, id);
-			if (!(info->params[i].flags & SPA_PARAM_INFO_READ))
+			if (!(info->params[i].flags & SPA_PARAM_INFO_READ) ||
+			    find_param_index(o, id) == NULL)
 				continue;
 
 			pw_node_enum_params((struct pw_node*)o->this.proxy,
@@ -418,10 +485,18 @@ static void node_destroy(struct object *o)
 	}
 }
 
+static const uint32_t node_params[] = {
+	SPA_PARAM_Props,
+	SPA_PARAM_EnumFormat,
+	SPA_PARAM_Format,
+};
+
 static const struct object_info node_info = {
 	.type = PW_TYPE_INTERFACE_Node,
 	.version = PW_VERSION_NODE,
 	.events = &node_events,
+	.params = node_params,
+	.n_params = SPA_N_ELEMENTS(node_params),
 	.destroy = node_destroy,
 };
 
@@ -533,10 +608,19 @@ static void registry_event_global(void *data, uint32_t id,
 		return;
 
 	o = calloc(1, sizeof(*o));
-	if (o == NULL) {
-		pw_log_error("can't alloc object for %u %s/%d: %m", id, type, version);
-		pw_proxy_destroy(proxy);
-		return;
+	if (o == NULL)
+		goto error_alloc;
+
+	if (info->n_params > 0) {
+		uint32_t i;
+
+		o->index = calloc(info->n_params, sizeof(struct param_index));
+		if (o->index == NULL)
+			goto error_alloc;
+		for (i = 0; i < info->n_params; i++) {
+			o->index[i].id = info->params[i];
+			spa_list_init(&o->index[i].list);
+		}
 	}
 	o->this.id = id;
 	o->this.permissions = permissions;
@@ -565,6 +649,12 @@ static void registry_event_global(void *data, uint32_t id,
 		info->init(o);
 
 	core_sync(m);
+	return;
+
+error_alloc:
+	pw_log_error("can't alloc object for %u %s/%d: %m", id, type, version);
+	free(o);
+	pw_proxy_destroy(proxy);
 }
 
 static void registry_event_global_remove(void *object, uint32_t id)
@@ -68,6 +68,7 @@ struct pw_manager {
 struct pw_manager_param {
 	uint32_t id;
 	struct spa_list link;           /**< link in manager_object param_list */
+	struct spa_list index_link;     /**< link in the params with the same id */
 	struct spa_pod *param;
 };
 
@@ -24,6 +24,8 @@
 
 #include <pthread.h>
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 #include <sys/resource.h>
 
 #include "pipewire/log.h"
@@ -65,9 +67,111 @@ static void thread_cleanup(void *arg)
 	pw_loop_leave(this->loop);
 }
 
+/* wakeups further apart than this are not predicted */
+#define BUSY_POLL_MAX_PERIOD	(100 * SPA_NSEC_PER_MSEC)
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* sleep until shortly before the expected wakeup of the rt source and then
+ * spin on the activation status of the node. The status is set to triggered
+ * in shared memory before the eventfd is written, so we see it without a
+ * syscall and the following poll returns without going to sleep. Sources of
+ * the loop itself are handled up to twice the busy poll time later.
+ * Returns the result of poll when it got events while sleeping, 0 otherwise */
+static int busy_poll(struct pw_data_loop *this, struct pollfd *fds)
+{
+	struct pw_node_activation *a = this->busy_node->rt.activation;
+	uint64_t now, start, end;
+	struct timespec ts;
+	int res;
+
+	if (this->period == 0 || a == NULL)
+		return 0;
+
+	now = get_time_ns();
+	start = this->last_wakeup + this->period - this->busy_poll;
+	end = start + 2 * this->busy_poll;
+	if (now >= end)
+		return 0;
+
+	if (now < start) {
+		ts.tv_sec = (start - now) / SPA_NSEC_PER_SEC;
+		ts.tv_nsec = (start - now) % SPA_NSEC_PER_SEC;
+		if ((res = ppoll(fds, 2, &ts, NULL)) != 0)
+			return res < 0 ? -errno : res;
+	}
+	while (ATOMIC_LOAD(a->status) != PW_NODE_ACTIVATION_TRIGGERED &&
+	    get_time_ns() < end);
+
+	return 0;
+}
+
+/* keep an average of the time between wakeups of the rt source */
+static void update_period(struct pw_data_loop *this)
+{
+	uint64_t now = get_time_ns(), diff = now - this->last_wakeup;
+
+	if (this->last_wakeup == 0 || diff > BUSY_POLL_MAX_PERIOD)
+		this->period = 0;
+	else if (this->period == 0)
+		this->period = diff;
+	else
+		this->period = (this->period * 7 + diff) / 8;
+
+	this->last_wakeup = now;
+}
+
+/* wait on the rt source and the loop at the same time. When the rt source
+ * is ready its callback is called directly, the loop is only iterated when
+ * one of its own sources is ready */
+static int iterate_rt(struct pw_data_loop *this, struct spa_source *source)
+{
+	struct pollfd fds[2];
+	int res = 0;
+
+	fds[0].fd = source->fd;
+	fds[0].events = POLLIN;
+	fds[0].revents = 0;
+	fds[1].fd = pw_loop_get_fd(this->loop);
+	fds[1].events = POLLIN;
+	fds[1].revents = 0;
+
+	if (this->busy_node != NULL &&
+	    (res = busy_poll(this, fds)) < 0)
+		return res;
+
+	if (res == 0 && SPA_UNLIKELY(poll(fds, 2, -1) < 0))
+		return -errno;
+
+	res = 0;
+	if (SPA_LIKELY(fds[0].revents)) {
+		if (this->busy_node != NULL)
+			update_period(this);
+
+		source->rmask = 0;
+		if (fds[0].revents & POLLIN)
+			source->rmask |= SPA_IO_IN;
+		if (fds[0].revents & POLLERR)
+			source->rmask |= SPA_IO_ERR;
+		if (fds[0].revents & POLLHUP)
+			source->rmask |= SPA_IO_HUP;
+		source->func(source);
+	}
+	if (fds[1].revents)
+		res = pw_loop_iterate(this->loop, 0);
+
+	return res;
+}
+
 static void *do_loop(void *user_data)
 {
 	struct pw_data_loop *this = user_data;
+	struct spa_source *rt;
 	int res;
 
 	pw_log_debug(NAME" %p: enter thread", this);
@@ -76,7 +180,13 @@ static void *do_loop(void *user_data)
 	pthread_cleanup_push(thread_cleanup, this);
 
 	while (this->running) {
-		if ((res = pw_loop_iterate(this->loop, -1)) < 0) {
+		/* the rt source is only waited on while it is added to the loop */
+		if ((rt = this->rt_source) != NULL && rt->loop != NULL)
+			res = iterate_rt(this, rt);
+		else
+			res = pw_loop_iterate(this->loop, -1);
+
+		if (res < 0) {
 			if (res == -EINTR)
 				continue;
 			pw_log_error(NAME" %p: iterate error %d (%s)",
@@ -188,6 +298,7 @@ void pw_data_loop_add_listener(struct pw_data_loop *loop,
 	spa_hook_list_append(&loop->listener_list, listener, events, data);
 }
 
+SPA_EXPORT
 struct pw_loop *
 pw_data_loop_get_loop(struct pw_data_loop *loop)
 {
@@ -218,6 +329,82 @@ int pw_data_loop_start(struct pw_data_loop *loop)
 	return 0;
 }
 
+static int do_set_rt_source(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_data_loop *this = user_data;
+	struct spa_source *source = *(struct spa_source **)data;
+	struct spa_source *old = this->rt_source;
+
+	/* the loop itself should not wake up for input on the rt source
+	 * anymore, we still want it to report errors */
+	if (old != NULL) {
+		old->mask |= SPA_IO_IN;
+		if (old->loop != NULL)
+			spa_loop_update_source(loop, old);
+	}
+	if (source != NULL) {
+		source->mask &= ~SPA_IO_IN;
+		if (source->loop != NULL)
+			spa_loop_update_source(loop, source);
+	}
+	this->rt_source = source;
+	if (source == NULL)
+		this->busy_node = NULL;
+	return 0;
+}
+
+SPA_EXPORT
+int pw_data_loop_set_rt_source(struct pw_data_loop *loop, struct spa_source *source)
+{
+	if (source != NULL && loop->rt_source != NULL && loop->rt_source != source)
+		return -EBUSY;
+
+	pw_log_debug(NAME" %p: rt source %p", loop, source);
+	return pw_loop_invoke(loop->loop, do_set_rt_source, 0,
+			&source, sizeof(source), true, loop);
+}
+
+struct busy_poll_update {
+	struct pw_impl_node *node;
+	uint64_t busy_poll;
+};
+
+static int do_set_busy_poll(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_data_loop *this = user_data;
+	const struct busy_poll_update *update = data;
+
+	this->busy_node = update->node;
+	this->busy_poll = update->busy_poll;
+	this->last_wakeup = 0;
+	this->period = 0;
+	return 0;
+}
+
+SPA_EXPORT
+int pw_data_loop_set_busy_poll(struct pw_data_loop *loop, struct pw_impl_node *node,
+		uint64_t busy_poll)
+{
+	struct busy_poll_update update;
+
+	if (node != NULL && busy_poll > 0) {
+		if (loop->rt_source == NULL)
+			return -EINVAL;
+		/* with one CPU the spinning only keeps the peer from running */
+		if (sysconf(_SC_NPROCESSORS_ONLN) < 2)
+			return -ENOTSUP;
+	}
+
+	update.node = busy_poll > 0 ? node : NULL;
+	update.busy_poll = busy_poll;
+
+	pw_log_debug(NAME" %p: busy poll node %p %"PRIu64" nsec", loop, node, busy_poll);
+	return pw_loop_invoke(loop->loop, do_set_busy_poll, 0,
+			&update, sizeof(update), true, loop);
+}
+
 /** Stop a data loop
  * \param loop the data loop to Stop
  * \return 0
@@ -1239,11 +1239,15 @@ pw_filter_connect(struct pw_filter *filter,
 	uint32_t i;
 
 	pw_log_debug(NAME" %p: connect", filter);
+	if (SPA_FLAG_IS_SET(flags, PW_FILTER_FLAG_RT_DIRECT))
+		flags |= PW_FILTER_FLAG_RT_PROCESS;
 	impl->flags = flags;
 
 	impl->warn_mlock = SPA_FLAG_IS_SET(flags, PW_FILTER_FLAG_RT_PROCESS);
 	pw_properties_set(filter->properties, "mem.warn-mlock",
 			impl->warn_mlock ? "true" : "false");
+	pw_properties_set(filter->properties, "node.rt-direct",
+			SPA_FLAG_IS_SET(flags, PW_FILTER_FLAG_RT_DIRECT) ? "true" : "false");
 
 	impl->impl_node.iface = SPA_INTERFACE_INIT(
 			SPA_TYPE_INTERFACE_Node,
@@ -112,6 +112,15 @@ enum pw_filter_flags {
 	PW_FILTER_FLAG_DRIVER		= (1 << 1),	/**< be a driver */
 	PW_FILTER_FLAG_RT_PROCESS	= (1 << 2),	/**< call process from the realtime
 							  *  thread */
+	PW_FILTER_FLAG_RT_DIRECT	= (1 << 3),	/**< the realtime thread waits directly
+							  *  on the activation of the filter and
+							  *  calls process without dispatching
+							  *  through the loop. Only one filter
+							  *  per context can do this. Implies
+							  *  PW_FILTER_FLAG_RT_PROCESS. The
+							  *  node.rt-busy-poll property sets the
+							  *  usec to spin around the expected
+							  *  wakeup */
 };
 
 enum pw_filter_port_flags {
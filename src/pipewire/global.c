@@ -135,6 +135,9 @@ int pw_global_register(struct pw_global *global)
 	spa_list_append(&context->global_list, &global->link);
 	global->registered = true;
 
+	/* all registries get the same event except for the permissions, this
+	 * lets the protocol encode it only once */
+	context->broadcast_serial++;
 	spa_list_for_each(registry, &context->registry_resource_list, link) {
 		uint32_t permissions = pw_global_get_permissions(global, registry->client);
 		pw_log_debug("registry %p: global %d %08x", registry, global->id, permissions);
@@ -146,6 +149,7 @@ int pw_global_register(struct pw_global *global)
 						    global->version,
 						    &global->properties->dict);
 	}
+	context->broadcast_serial++;
 
 	pw_log_debug(NAME" %p: registered %u", global, global->id);
 	pw_context_emit_global_added(context, global);
@@ -329,6 +333,11 @@ int pw_global_update_permissions(struct pw_global *global, struct pw_impl_client
 
 	pw_global_emit_permissions_changed(global, client, old_permissions, new_permissions);
 
+	/* the registries only need to know when the global becomes
+	 * visible or invisible */
+	if (!do_hide && !do_show)
+		goto update_resources;
+
 	spa_list_for_each(resource, &context->registry_resource_list, link) {
 		if (resource->client != client)
 			continue;
@@ -350,6 +359,7 @@ int pw_global_update_permissions(struct pw_global *global, struct pw_impl_client
 		}
 	}
 
+update_resources:
 	spa_list_for_each_safe(resource, t, &global->resource_list, link) {
 		if (resource->client != client)
 			continue;
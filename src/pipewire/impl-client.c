@@ -650,6 +650,9 @@ int pw_impl_client_update_permissions(struct pw_impl_client *client,
 			pw_log_debug(NAME" %p: set default permissions %08x -> %08x",
 					client, old_perm, new_perm);
 
+			if (old_perm == new_perm)
+				continue;
+
 			def->permissions = new_perm;
 
 			spa_list_for_each(global, &context->global_list, link) {
@@ -683,8 +686,11 @@ int pw_impl_client_update_permissions(struct pw_impl_client *client,
 			pw_log_debug(NAME" %p: set global %d permissions %08x -> %08x",
 					client, global->id, old_perm, new_perm);
 
+			/* an explicit entry is also kept when it is equal to
+			 * the default so that it survives default changes */
 			p->permissions = new_perm;
-			pw_global_update_permissions(global, client, old_perm, new_perm);
+			if (old_perm != new_perm)
+				pw_global_update_permissions(global, client, old_perm, new_perm);
 		}
 	}
 	update_busy(client);
@@ -685,8 +685,8 @@ do_deactivate_link(struct spa_loop *loop,
 
 	pw_log_trace(NAME" %p: disable %p and %p", this, &this->rt.in_mix, &this->rt.out_mix);
 
-	spa_list_remove(&this->rt.out_mix.rt_link);
-	spa_list_remove(&this->rt.in_mix.rt_link);
+	pw_impl_port_remove_rt_mix(this->output, &this->rt.out_mix);
+	pw_impl_port_remove_rt_mix(this->input, &this->rt.in_mix);
 
 	if (this->input->node != this->output->node) {
 		struct pw_node_activation_state *state;
@@ -1110,6 +1110,8 @@ struct pw_impl_link *pw_context_create_link(struct pw_context *context,
 
 	pw_impl_port_init_mix(output, &this->rt.out_mix);
 	pw_impl_port_init_mix(input, &this->rt.in_mix);
+	this->rt.out_mix.peer = &this->rt.in_mix;
+	this->rt.in_mix.peer = &this->rt.out_mix;
 
 	if ((res = select_io(this)) < 0)
 		goto error_no_io;
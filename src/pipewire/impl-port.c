@@ -38,11 +38,16 @@
 
 #define NAME "port"
 
+#define MAX_TEE_BUFFERS	64u
+
 /** \cond */
 struct impl {
 	struct pw_impl_port this;
 	struct spa_node mix_node;	/**< mix node implementation */
 
+	uint32_t n_tee_buffers;		/**< number of buffers tracked in tee_refs */
+	int32_t tee_refs[MAX_TEE_BUFFERS];	/**< outstanding outputs per buffer */
+
 	struct spa_list param_list;
 	struct spa_list pending_list;
 
@@ -126,19 +131,61 @@ void pw_impl_port_update_state(struct pw_impl_port *port, enum pw_impl_port_stat
 	}
 }
 
+/* drop the reference of the mix on its tee buffer, the buffer is given back
+ * to the node when the last output released it */
+static void tee_release_buffer(struct impl *impl, struct pw_impl_port_mix *mix)
+{
+	struct pw_impl_port *this = &impl->this;
+	uint32_t buffer_id = mix->tee_buffer_id;
+
+	mix->tee_buffer_id = SPA_ID_INVALID;
+
+	if (buffer_id >= impl->n_tee_buffers ||
+	    ATOMIC_LOAD(impl->tee_refs[buffer_id]) <= 0)
+		return;
+
+	if (ATOMIC_DEC(impl->tee_refs[buffer_id]) == 0) {
+		pw_log_trace_fp(NAME" %p: tee recycle buffer %d", this, buffer_id);
+		spa_node_port_reuse_buffer(this->node->node, this->port_id, buffer_id);
+	}
+}
+
 static int tee_process(void *object)
 {
 	struct impl *impl = object;
 	struct pw_impl_port *this = &impl->this;
 	struct pw_impl_port_mix *mix;
 	struct spa_io_buffers *io = &this->rt.io;
+	uint32_t n_outputs = 0, buffer_id = SPA_ID_INVALID;
 
 	pw_log_trace_fp(NAME" %p: tee input %d %d", this, io->status, io->buffer_id);
+
+	/* with more than one output, the node can only recycle the buffer when
+	 * all of them are done with it. A node with one buffer needs it back
+	 * before it produces the next one, the outputs release it too late,
+	 * leave it to the node then */
+	spa_list_for_each(mix, &this->rt.mix_list, rt_link)
+		n_outputs++;
+	if (n_outputs > 1 && impl->n_tee_buffers > 1 &&
+	    io->status == SPA_STATUS_HAVE_DATA &&
+	    io->buffer_id < impl->n_tee_buffers) {
+		buffer_id = io->buffer_id;
+		ATOMIC_ADD(impl->tee_refs[buffer_id], n_outputs);
+	}
+
 	spa_list_for_each(mix, &this->rt.mix_list, rt_link) {
 		pw_log_trace_fp(NAME" %p: port %d %p->%p %d", this,
 				mix->port.port_id, io, mix->io, mix->io->buffer_id);
+		/* the old buffer of the output is replaced */
+		if (mix->tee_buffer_id != SPA_ID_INVALID)
+			tee_release_buffer(impl, mix);
 		*mix->io = *io;
+		mix->tee_buffer_id = buffer_id;
 	}
+
+	/* the outputs own the buffer now, keep the node from recycling it */
+	if (buffer_id != SPA_ID_INVALID)
+		io->buffer_id = SPA_ID_INVALID;
 	io->status = SPA_STATUS_NEED_DATA;
 
         return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
@@ -148,10 +195,19 @@ static int tee_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
 {
 	struct impl *impl = object;
 	struct pw_impl_port *this = &impl->this;
+	struct pw_impl_port_mix *mix;
 
 	pw_log_trace_fp(NAME" %p: tee reuse buffer %d %d", this, port_id, buffer_id);
-	spa_node_port_reuse_buffer(this->node->node, this->port_id, buffer_id);
 
+	/* only buffers that the tee holds are recycled here, the others
+	 * are recycled by the node when the io area is processed */
+	spa_list_for_each(mix, &this->rt.mix_list, rt_link) {
+		if (mix->port.port_id != port_id)
+			continue;
+		if (mix->tee_buffer_id == buffer_id)
+			tee_release_buffer(impl, mix);
+		break;
+	}
 	return 0;
 }
 
@@ -185,12 +241,16 @@ static int schedule_mix_reuse_buffer(void *object, uint32_t port_id, uint32_t bu
 {
 	struct impl *impl = object;
 	struct pw_impl_port *this = &impl->this;
-	struct pw_impl_port_mix *mix;
+	struct pw_impl_port_mix *mix, *peer;
 
 	spa_list_for_each(mix, &this->rt.mix_list, rt_link) {
 		pw_log_trace_fp(NAME" %p: reuse buffer %d %d", this, port_id, buffer_id);
-		/* FIXME send reuse buffer to peer */
-		break;
+		/* we only take the buffer of the first mix input, hand it back
+		 * to the output mix it came from */
+		if ((peer = mix->peer) == NULL)
+			break;
+		return spa_node_port_reuse_buffer(peer->p->mix,
+				peer->port.port_id, buffer_id);
 	}
 	return 0;
 }
@@ -213,6 +273,7 @@ int pw_impl_port_init_mix(struct pw_impl_port *port, struct pw_impl_port_mix *mi
 
 	mix->port.direction = port->direction;
 	mix->port.port_id = port_id;
+	mix->tee_buffer_id = SPA_ID_INVALID;
 
 	spa_list_append(&port->mix_list, &mix->link);
 	port->n_mix++;
@@ -246,6 +307,16 @@ int pw_impl_port_init_mix(struct pw_impl_port *port, struct pw_impl_port_mix *mi
 	return res;
 }
 
+SPA_EXPORT
+void pw_impl_port_remove_rt_mix(struct pw_impl_port *port, struct pw_impl_port_mix *mix)
+{
+	struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
+
+	spa_list_remove(&mix->rt_link);
+	if (mix->tee_buffer_id != SPA_ID_INVALID)
+		tee_release_buffer(impl, mix);
+}
+
 SPA_EXPORT
 int pw_impl_port_release_mix(struct pw_impl_port *port, struct pw_impl_port_mix *mix)
 {
@@ -1384,6 +1455,17 @@ int pw_impl_port_use_buffers(struct pw_impl_port *port, struct pw_impl_port_mix
 		}
 	}
 
+	/* buffers are changing, forget about the outstanding tee references */
+	if (port->direction == PW_DIRECTION_OUTPUT) {
+		struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
+		struct pw_impl_port_mix *m;
+
+		impl->n_tee_buffers = SPA_MIN(n_buffers, MAX_TEE_BUFFERS);
+		memset(impl->tee_refs, 0, sizeof(impl->tee_refs));
+		spa_list_for_each(m, &port->mix_list, link)
+			m->tee_buffer_id = SPA_ID_INVALID;
+	}
+
 	/* then use the buffers on the mixer */
 	if (!SPA_FLAG_IS_SET(port->mix_flags, PW_IMPL_PORT_MIX_FLAG_MIX_ONLY))
 		flags &= ~SPA_NODE_BUFFERS_FLAG_ALLOC;
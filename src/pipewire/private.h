@@ -376,6 +376,8 @@ struct pw_context {
 	struct spa_list protocol_list;		/**< list of protocols */
 	struct spa_list core_list;		/**< list of core connections */
 	struct spa_list registry_resource_list;	/**< list of registry resources */
+	uint32_t broadcast_serial;		/**< odd while a global event is sent to
+						  *  all registry resources */
 	struct spa_list module_list;		/**< list of modules */
 	struct spa_list device_list;		/**< list of devices */
 	struct spa_list global_list;		/**< list of globals */
@@ -416,6 +418,11 @@ struct pw_data_loop {
 
 	struct spa_hook_list listener_list;
 	struct spa_source *event;
+	struct spa_source *rt_source;	/**< source that is waited on directly */
+	struct pw_impl_node *busy_node;	/**< node of the rt source to busy poll */
+	uint64_t busy_poll;		/**< time to spin around the expected wakeup */
+	uint64_t last_wakeup;		/**< time of the last wakeup of the rt source */
+	uint64_t period;		/**< average time between wakeups, 0 unknown */
 
 	pthread_t thread;
 	unsigned int created:1;
@@ -566,6 +573,7 @@ struct pw_node_activation {
 
 #define ATOMIC_DEC(s)			__atomic_sub_fetch(&(s), 1, __ATOMIC_SEQ_CST)
 #define ATOMIC_INC(s)			__atomic_add_fetch(&(s), 1, __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(s,v)			__atomic_add_fetch(&(s), (v), __ATOMIC_SEQ_CST)
 #define ATOMIC_LOAD(s)			__atomic_load_n(&(s), __ATOMIC_SEQ_CST)
 #define ATOMIC_STORE(s,v)		__atomic_store_n(&(s), (v), __ATOMIC_SEQ_CST)
 #define ATOMIC_XCHG(s,v)		__atomic_exchange_n(&(s), (v), __ATOMIC_SEQ_CST)
@@ -679,6 +687,8 @@ struct pw_impl_port_mix {
 		uint32_t port_id;
 	} port;
 	struct spa_io_buffers *io;
+	struct pw_impl_port_mix *peer;	/**< mix on the other side of the link or NULL */
+	uint32_t tee_buffer_id;		/**< buffer of the output tee held by this mix */
 	uint32_t id;
 	unsigned int have_buffers:1;
 };
@@ -1086,6 +1096,8 @@ int pw_impl_port_set_mix(struct pw_impl_port *port, struct spa_node *node, uint3
 
 int pw_impl_port_init_mix(struct pw_impl_port *port, struct pw_impl_port_mix *mix);
 int pw_impl_port_release_mix(struct pw_impl_port *port, struct pw_impl_port_mix *mix);
+/** Remove a mix from the realtime mix list, call from the data loop */
+void pw_impl_port_remove_rt_mix(struct pw_impl_port *port, struct pw_impl_port_mix *mix);
 
 void pw_impl_port_update_state(struct pw_impl_port *port, enum pw_impl_port_state state, int res, char *error);
 
@@ -1145,6 +1157,20 @@ int pw_impl_node_update_ports(struct pw_impl_node *node);
 
 int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driver);
 
+/** Wait on \a source directly in the thread of \a loop \memberof pw_data_loop
+ * The fd of the source is polled next to the loop and its callback is called
+ * without going through the loop dispatch. Only one source can be set, use
+ * NULL to remove it. */
+int pw_data_loop_set_rt_source(struct pw_data_loop *loop, struct spa_source *source);
+
+/** Busy poll the rt source of \a loop \memberof pw_data_loop
+ * The activation status of \a node is watched for \a busy_poll nanoseconds
+ * before and after the expected wakeup of the rt source, before going to
+ * sleep in poll. \a node should own the rt source, the busy poll is stopped
+ * when the rt source is removed. 0 disables busy polling. */
+int pw_data_loop_set_busy_poll(struct pw_data_loop *loop, struct pw_impl_node *node,
+		uint64_t busy_poll);
+
 /** Prepare a link \memberof pw_impl_link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_impl_link_prepare(struct pw_impl_link *link);
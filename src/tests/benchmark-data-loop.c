@@ -0,0 +1,157 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Wakes up a node waited on directly by the data loop, like a filter with
+ * PW_FILTER_FLAG_RT_DIRECT, once per period and measures the time from the
+ * wakeup to the start of process, with and without busy polling. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/data-loop.h>
+#include <pipewire/private.h>
+
+#define N_CYCLES	4000
+#define PERIOD_NSEC	(1 * SPA_NSEC_PER_MSEC)
+
+struct data {
+	struct pw_data_loop *data_loop;
+	struct pw_loop *loop;
+	struct spa_source *source;
+	int fd;
+
+	struct pw_impl_node node;
+	struct pw_node_activation activation;
+
+	uint64_t signal_time;
+	uint32_t count;
+	uint64_t latency[N_CYCLES];
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* what the node does when it is woken up */
+static void on_process(void *user_data, int fd, uint32_t mask)
+{
+	struct data *d = user_data;
+	uint64_t now = get_time_ns(), count;
+
+	spa_assert(read(fd, &count, sizeof(count)) == sizeof(count));
+	ATOMIC_STORE(d->activation.status, PW_NODE_ACTIVATION_AWAKE);
+
+	d->latency[d->count] = now - ATOMIC_LOAD(d->signal_time);
+	ATOMIC_INC(d->count);
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	uint64_t la = *(const uint64_t *)a, lb = *(const uint64_t *)b;
+	return la < lb ? -1 : la > lb;
+}
+
+static void run(uint32_t busy_poll_usec)
+{
+	struct data *d;
+	struct timespec ts;
+	uint64_t next, total = 0, one = 1;
+	uint32_t i;
+	int res;
+
+	d = calloc(1, sizeof(*d));
+	spa_assert(d != NULL);
+
+	d->data_loop = pw_data_loop_new(NULL);
+	spa_assert(d->data_loop != NULL);
+	d->loop = pw_data_loop_get_loop(d->data_loop);
+
+	d->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	spa_assert(d->fd >= 0);
+	d->source = pw_loop_add_io(d->loop, d->fd, SPA_IO_IN, false, on_process, d);
+	spa_assert(d->source != NULL);
+	d->node.rt.activation = &d->activation;
+
+	spa_assert(pw_data_loop_start(d->data_loop) == 0);
+	spa_assert(pw_data_loop_set_rt_source(d->data_loop, d->source) == 0);
+	if ((res = pw_data_loop_set_busy_poll(d->data_loop, &d->node,
+				busy_poll_usec * SPA_NSEC_PER_USEC)) < 0) {
+		fprintf(stderr, "busy-poll %3u usec: %s\n", busy_poll_usec,
+				spa_strerror(res));
+		goto done;
+	}
+
+	next = get_time_ns();
+	for (i = 0; i < N_CYCLES; i++) {
+		next += PERIOD_NSEC;
+		ts.tv_sec = next / SPA_NSEC_PER_SEC;
+		ts.tv_nsec = next % SPA_NSEC_PER_SEC;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+
+		/* the previous cycle was handled long ago */
+		while (ATOMIC_LOAD(d->count) != i)
+			usleep(10);
+
+		/* the peer sets the status before it writes the eventfd */
+		ATOMIC_STORE(d->signal_time, get_time_ns());
+		ATOMIC_STORE(d->activation.status, PW_NODE_ACTIVATION_TRIGGERED);
+		spa_assert(write(d->fd, &one, sizeof(one)) == sizeof(one));
+	}
+	while (ATOMIC_LOAD(d->count) != N_CYCLES)
+		usleep(10);
+
+	for (i = 0; i < N_CYCLES; i++)
+		total += d->latency[i];
+	qsort(d->latency, N_CYCLES, sizeof(uint64_t), compare_latency);
+
+	fprintf(stderr, "busy-poll %3u usec: wakeup to process avg %"PRIu64" "
+			"median %"PRIu64" 99%% %"PRIu64" max %"PRIu64" nsec\n",
+			busy_poll_usec, total / N_CYCLES, d->latency[N_CYCLES / 2],
+			d->latency[N_CYCLES * 99 / 100], d->latency[N_CYCLES - 1]);
+done:
+	pw_data_loop_set_rt_source(d->data_loop, NULL);
+	pw_data_loop_stop(d->data_loop);
+	pw_loop_destroy_source(d->loop, d->source);
+	pw_data_loop_destroy(d->data_loop);
+	close(d->fd);
+	free(d);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	run(0);
+	run(20);
+	run(100);
+
+	return 0;
+}
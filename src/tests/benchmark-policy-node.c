@@ -0,0 +1,287 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Runs the media-session node policy against a fake session and measures
+ * the time it takes to handle streams joining and leaving. */
+
+#include <time.h>
+
+#include "../examples/media-session/policy-node.c"
+
+#define N_SINKS		4
+#define N_STREAMS	1000
+#define N_REPORT	250
+
+struct test_object {
+	struct sm_node node;
+	struct pw_properties *props;
+	struct pw_node_info info;
+	struct sm_param param;
+};
+
+struct data {
+	struct sm_media_session session;
+	struct spa_hook_list hooks;
+	struct pw_map objects;
+	struct spa_pod *format;
+	bool rescan_pending;
+	uint32_t n_links;
+};
+
+struct object_data {
+	struct spa_list link;
+	const char *id;
+	size_t size;
+};
+
+static struct data data;
+
+static int node_set_param(void *object, uint32_t id, uint32_t flags,
+		const struct spa_pod *param)
+{
+	return 0;
+}
+
+static const struct pw_node_methods node_methods = {
+	PW_VERSION_NODE_METHODS,
+	.set_param = node_set_param,
+};
+
+static struct spa_interface node_iface;
+
+/* the parts of the media session that the policy uses */
+void *sm_object_add_data(struct sm_object *obj, const char *id, size_t size)
+{
+	struct object_data *d;
+
+	d = calloc(1, sizeof(struct object_data) + size);
+	spa_assert(d != NULL);
+	d->id = id;
+	d->size = size;
+	spa_list_append(&obj->data, &d->link);
+	return SPA_MEMBER(d, sizeof(struct object_data), void);
+}
+
+void *sm_object_get_data(struct sm_object *obj, const char *id)
+{
+	struct object_data *d;
+	spa_list_for_each(d, &obj->data, link) {
+		if (strcmp(d->id, id) == 0)
+			return SPA_MEMBER(d, sizeof(struct object_data), void);
+	}
+	return NULL;
+}
+
+int sm_object_remove_data(struct sm_object *obj, const char *id)
+{
+	struct object_data *d;
+	spa_list_for_each(d, &obj->data, link) {
+		if (strcmp(d->id, id) == 0) {
+			spa_list_remove(&d->link);
+			free(d);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+int sm_object_add_listener(struct sm_object *obj, struct spa_hook *listener,
+		const struct sm_object_events *events, void *data)
+{
+	spa_hook_list_append(&obj->hooks, listener, events, data);
+	return 0;
+}
+
+int sm_media_session_add_listener(struct sm_media_session *sess, struct spa_hook *listener,
+		const struct sm_media_session_events *events, void *data)
+{
+	spa_hook_list_append(&((struct data*)sess)->hooks, listener, events, data);
+	return 0;
+}
+
+struct sm_object *sm_media_session_find_object(struct sm_media_session *sess, uint32_t id)
+{
+	return pw_map_lookup(&((struct data*)sess)->objects, id);
+}
+
+int sm_media_session_destroy_object(struct sm_media_session *sess, uint32_t id)
+{
+	return 0;
+}
+
+int sm_media_session_schedule_rescan(struct sm_media_session *sess)
+{
+	((struct data*)sess)->rescan_pending = true;
+	return 0;
+}
+
+int sm_media_session_create_links(struct sm_media_session *sess,
+		const struct spa_dict *dict)
+{
+	((struct data*)sess)->n_links++;
+	return 1;
+}
+
+int sm_media_session_remove_links(struct sm_media_session *sess,
+		const struct spa_dict *dict)
+{
+	return 0;
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void do_rescan(struct data *d)
+{
+	if (!d->rescan_pending)
+		return;
+	d->rescan_pending = false;
+	spa_hook_list_call(&d->hooks, struct sm_media_session_events, rescan, 0, 0);
+}
+
+static struct test_object *add_node(struct data *d, const char *media_class,
+		const char *name)
+{
+	struct test_object *o;
+	struct sm_object *obj;
+
+	o = calloc(1, sizeof(struct test_object));
+	spa_assert(o != NULL);
+	obj = &o->node.obj;
+
+	o->props = pw_properties_new(
+			PW_KEY_MEDIA_CLASS, media_class,
+			PW_KEY_NODE_NAME, name,
+			PW_KEY_NODE_AUTOCONNECT, "true",
+			NULL);
+	o->info.props = &o->props->dict;
+	o->info.state = PW_NODE_STATE_IDLE;
+
+	obj->id = pw_map_insert_new(&d->objects, obj);
+	obj->type = PW_TYPE_INTERFACE_Node;
+	obj->props = o->props;
+	obj->proxy = (struct pw_proxy*)&node_iface;
+	spa_list_init(&obj->data);
+	spa_hook_list_init(&obj->hooks);
+
+	o->node.info = &o->info;
+	spa_list_init(&o->node.param_list);
+	o->param.id = SPA_PARAM_EnumFormat;
+	o->param.param = d->format;
+	spa_list_append(&o->node.param_list, &o->param.link);
+
+	spa_hook_list_call(&d->hooks, struct sm_media_session_events, create, 0, obj);
+	do_rescan(d);
+
+	/* the params arrive after the node was created */
+	obj->avail |= SM_NODE_CHANGE_MASK_PARAMS;
+	spa_hook_list_call(&obj->hooks, struct sm_object_events, update, 0);
+	do_rescan(d);
+
+	return o;
+}
+
+static void remove_node(struct data *d, struct test_object *o)
+{
+	struct sm_object *obj = &o->node.obj;
+
+	pw_map_remove(&d->objects, obj->id);
+	spa_hook_list_call(&d->hooks, struct sm_media_session_events, remove, 0, obj);
+	do_rescan(d);
+
+	pw_properties_free(o->props);
+	free(o);
+}
+
+int main(int argc, char *argv[])
+{
+	struct test_object *sinks[N_SINKS], *streams[N_STREAMS];
+	struct spa_audio_info_raw info;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	char name[64];
+	uint64_t t1, t2, total;
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	node_iface = SPA_INTERFACE_INIT(PW_TYPE_INTERFACE_Node, PW_VERSION_NODE,
+			&node_methods, NULL);
+
+	spa_zero(data);
+	spa_hook_list_init(&data.hooks);
+	pw_map_init(&data.objects, 64, 64);
+	/* skip the id of the core */
+	pw_map_insert_new(&data.objects, NULL);
+	data.session.props = pw_properties_new(NULL, NULL);
+
+	info = SPA_AUDIO_INFO_RAW_INIT(
+			.format = SPA_AUDIO_FORMAT_F32,
+			.rate = 48000,
+			.channels = 2);
+	data.format = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info);
+
+	spa_assert(sm_policy_node_start(&data.session) == 0);
+
+	for (i = 0; i < N_SINKS; i++) {
+		snprintf(name, sizeof(name), "sink-%d", i);
+		sinks[i] = add_node(&data, "Audio/Sink", name);
+	}
+
+	total = 0;
+	for (i = 0; i < N_STREAMS; i++) {
+		snprintf(name, sizeof(name), "stream-%d", i);
+		t1 = get_time_ns();
+		streams[i] = add_node(&data, "Stream/Output/Audio", name);
+		t2 = get_time_ns();
+		total += t2 - t1;
+
+		if ((i + 1) % N_REPORT == 0) {
+			fprintf(stderr, "streams %4d: join %8"PRIu64" nsec\n",
+					i + 1, total / N_REPORT);
+			total = 0;
+		}
+	}
+	spa_assert(data.n_links == N_STREAMS);
+
+	t1 = get_time_ns();
+	for (i = 0; i < N_STREAMS; i++)
+		remove_node(&data, streams[N_STREAMS - 1 - i]);
+	t2 = get_time_ns();
+	fprintf(stderr, "streams %4d: leave %7"PRIu64" nsec\n",
+			N_STREAMS, (t2 - t1) / N_STREAMS);
+
+	for (i = 0; i < N_SINKS; i++)
+		remove_node(&data, sinks[i]);
+
+	spa_hook_list_call(&data.hooks, struct sm_media_session_events, destroy, 0);
+	pw_properties_free(data.session.props);
+	pw_map_clear(&data.objects);
+
+	return 0;
+}
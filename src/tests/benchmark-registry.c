@@ -0,0 +1,185 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#define MAX_CLIENTS	300
+#define N_GLOBALS	100
+#define N_PROPS		40
+
+struct client {
+	struct data *data;
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+	int pending;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct client clients[MAX_CLIENTS];
+	uint32_t n_clients;
+	uint32_t pending;
+	uint32_t n_globals;
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void on_core_done(void *data, uint32_t id, int seq)
+{
+	struct client *c = data;
+	if (id == PW_ID_CORE && seq == c->pending)
+		c->data->pending--;
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = on_core_done,
+};
+
+static void registry_event_global(void *data, uint32_t id,
+		uint32_t permissions, const char *type, uint32_t version,
+		const struct spa_dict *props)
+{
+	struct client *c = data;
+
+	if (strcmp(type, PW_TYPE_INTERFACE_Device) != 0)
+		return;
+
+	spa_assert(permissions == PW_PERM_ALL);
+	spa_assert(props != NULL && props->n_items == N_PROPS);
+	c->data->n_globals++;
+}
+
+static const struct pw_registry_events registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = registry_event_global,
+};
+
+/* wait until all clients received all events */
+static void roundtrip(struct data *d)
+{
+	struct pw_loop *loop = pw_main_loop_get_loop(d->loop);
+	uint32_t i;
+
+	d->pending = d->n_clients;
+	for (i = 0; i < d->n_clients; i++)
+		d->clients[i].pending = pw_core_sync(d->clients[i].core, PW_ID_CORE, 0);
+	while (d->pending > 0)
+		pw_loop_iterate(loop, -1);
+}
+
+static void test_register(uint32_t n_clients)
+{
+	struct data d;
+	struct pw_global *globals[N_GLOBALS];
+	char key[64], value[64];
+	uint64_t t1, t2, add = 0, remove = 0;
+	uint32_t i, j;
+
+	spa_zero(d);
+	d.loop = pw_main_loop_new(NULL);
+	spa_assert(d.loop != NULL);
+	d.context = pw_context_new(pw_main_loop_get_loop(d.loop), NULL, 0);
+	spa_assert(d.context != NULL);
+
+	for (i = 0; i < n_clients; i++) {
+		struct client *c = &d.clients[i];
+		c->data = &d;
+		c->core = pw_context_connect_self(d.context, NULL, 0);
+		spa_assert(c->core != NULL);
+		pw_core_add_listener(c->core, &c->core_listener, &core_events, c);
+		c->registry = pw_core_get_registry(c->core, PW_VERSION_REGISTRY, 0);
+		spa_assert(c->registry != NULL);
+		pw_registry_add_listener(c->registry, &c->registry_listener,
+				&registry_events, c);
+	}
+	d.n_clients = n_clients;
+	roundtrip(&d);
+
+	for (i = 0; i < N_GLOBALS; i++) {
+		struct pw_properties *props = pw_properties_new(NULL, NULL);
+		for (j = 0; j < N_PROPS; j++) {
+			snprintf(key, sizeof(key), "benchmark.property.%u", j);
+			snprintf(value, sizeof(value), "value of property %u of global %u", j, i);
+			pw_properties_set(props, key, value);
+		}
+		globals[i] = pw_global_new(d.context, PW_TYPE_INTERFACE_Device,
+				PW_VERSION_DEVICE, props, NULL, NULL);
+		spa_assert(globals[i] != NULL);
+
+		t1 = get_time_ns();
+		pw_global_register(globals[i]);
+		t2 = get_time_ns();
+		add += t2 - t1;
+
+		roundtrip(&d);
+	}
+	spa_assert(d.n_globals == N_GLOBALS * n_clients);
+
+	for (i = 0; i < N_GLOBALS; i++) {
+		t1 = get_time_ns();
+		pw_global_destroy(globals[i]);
+		t2 = get_time_ns();
+		remove += t2 - t1;
+
+		roundtrip(&d);
+	}
+
+	fprintf(stderr, "clients %3u: global add %8"PRIu64" nsec (%"PRIu64" per client) "
+			"remove %8"PRIu64" nsec\n", n_clients,
+			add / N_GLOBALS, add / N_GLOBALS / n_clients,
+			remove / N_GLOBALS);
+
+	for (i = 0; i < n_clients; i++) {
+		pw_proxy_destroy((struct pw_proxy*)d.clients[i].registry);
+		pw_core_disconnect(d.clients[i].core);
+	}
+	pw_context_destroy(d.context);
+	pw_main_loop_destroy(d.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	test_register(1);
+	test_register(10);
+	test_register(100);
+	test_register(MAX_CLIENTS);
+
+	return 0;
+}
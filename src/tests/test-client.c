@@ -24,6 +24,8 @@
 
 #include <pipewire/pipewire.h>
 #include <pipewire/impl-client.h>
+#include <pipewire/impl-core.h>
+#include <pipewire/global.h>
 
 #define TEST_FUNC(a,b,func)	\
 do {				\
@@ -57,11 +59,96 @@ static void test_abi(void)
 	spa_assert(sizeof(ev) == sizeof(test));
 }
 
+static int permissions_changed_count = 0;
+static void global_permissions_changed(void *data, struct pw_impl_client *client,
+		uint32_t old_permissions, uint32_t new_permissions)
+{
+	spa_assert(old_permissions != new_permissions);
+	permissions_changed_count++;
+}
+
+static const struct pw_global_events global_events = {
+	PW_VERSION_GLOBAL_EVENTS,
+	.permissions_changed = global_permissions_changed,
+};
+
+static void test_permissions(void)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_impl_client *client;
+	struct pw_global *g1, *g2;
+	struct spa_hook listener = { NULL, };
+	struct pw_permission perms[2];
+
+	loop = pw_main_loop_new(NULL);
+	spa_assert(loop != NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONTEXT_PROFILE_MODULES, "none",
+				NULL), 0);
+	spa_assert(context != NULL);
+
+	client = pw_context_create_client(pw_context_get_default_core(context),
+			NULL, NULL, 0);
+	spa_assert(client != NULL);
+
+	g1 = pw_global_new(context, PW_TYPE_INTERFACE_Device, 0, NULL, NULL, NULL);
+	g2 = pw_global_new(context, PW_TYPE_INTERFACE_Device, 0, NULL, NULL, NULL);
+	spa_assert(g1 != NULL && g2 != NULL);
+	spa_assert(pw_global_register(g1) == 0);
+	spa_assert(pw_global_register(g2) == 0);
+	pw_global_add_listener(g1, &listener, &global_events, NULL);
+
+	/* no permissions by default */
+	spa_assert(pw_global_get_permissions(g1, client) == 0);
+	spa_assert(pw_global_get_permissions(g2, client) == 0);
+
+	/* the default applies to all globals without an explicit entry */
+	perms[0] = PW_PERMISSION_INIT(PW_ID_ANY, PW_PERM_R);
+	spa_assert(pw_impl_client_update_permissions(client, 1, perms) == 0);
+	spa_assert(pw_global_get_permissions(g1, client) == PW_PERM_R);
+	spa_assert(pw_global_get_permissions(g2, client) == PW_PERM_R);
+	spa_assert(permissions_changed_count == 1);
+
+	/* setting the same permissions again does not emit anything */
+	spa_assert(pw_impl_client_update_permissions(client, 1, perms) == 0);
+	spa_assert(permissions_changed_count == 1);
+
+	/* an explicit entry equal to the default survives default changes */
+	perms[0] = PW_PERMISSION_INIT(pw_global_get_id(g1), PW_PERM_R);
+	perms[1] = PW_PERMISSION_INIT(pw_global_get_id(g2), PW_PERM_ALL);
+	spa_assert(pw_impl_client_update_permissions(client, 2, perms) == 0);
+	spa_assert(permissions_changed_count == 1);
+	spa_assert(pw_global_get_permissions(g2, client) == PW_PERM_ALL);
+
+	perms[0] = PW_PERMISSION_INIT(PW_ID_ANY, 0);
+	spa_assert(pw_impl_client_update_permissions(client, 1, perms) == 0);
+	spa_assert(pw_global_get_permissions(g1, client) == PW_PERM_R);
+	spa_assert(pw_global_get_permissions(g2, client) == PW_PERM_ALL);
+	spa_assert(permissions_changed_count == 1);
+
+	/* a removed global falls back to the default when its id is reused */
+	spa_hook_remove(&listener);
+	pw_global_destroy(g1);
+	g1 = pw_global_new(context, PW_TYPE_INTERFACE_Device, 0, NULL, NULL, NULL);
+	spa_assert(g1 != NULL);
+	spa_assert(pw_global_register(g1) == 0);
+	spa_assert(pw_global_get_permissions(g1, client) == 0);
+
+	pw_global_destroy(g1);
+	pw_global_destroy(g2);
+	pw_impl_client_destroy(client);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+}
+
 int main(int argc, char *argv[])
 {
 	pw_init(&argc, &argv);
 
 	test_abi();
+	test_permissions();
 
 	return 0;
 }
@@ -0,0 +1,192 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <spa/support/log.h>
+#include <spa/utils/names.h>
+
+#include <pipewire/pipewire.h>
+
+#define N_THREADS	8
+#define N_MESSAGES	50
+
+struct data {
+	struct spa_handle *handle;
+	struct spa_log *log;
+	char path[64];
+	pthread_barrier_t barrier;
+};
+
+static void logger_open(struct data *d, bool deferred)
+{
+	struct spa_dict_item items[3];
+	void *iface;
+	int fd;
+
+	strcpy(d->path, "/tmp/pw-test-logger-XXXXXX");
+	fd = mkstemp(d->path);
+	spa_assert(fd >= 0);
+	close(fd);
+
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_DEFERRED, deferred ? "true" : "false");
+	items[1] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LINE, "true");
+	items[2] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, d->path);
+
+	d->handle = pw_load_spa_handle("support/libspa-support", SPA_NAME_SUPPORT_LOG,
+			&SPA_DICT_INIT_ARRAY(items), 0, NULL);
+	spa_assert(d->handle != NULL);
+	spa_assert(spa_handle_get_interface(d->handle, SPA_TYPE_INTERFACE_Log, &iface) == 0);
+	d->log = iface;
+	d->log->level = SPA_LOG_LEVEL_INFO;
+}
+
+/* flushes all messages and returns the contents of the log file */
+static char *logger_close(struct data *d)
+{
+	char *contents;
+	FILE *f;
+	long size;
+
+	pw_unload_spa_handle(d->handle);
+
+	f = fopen(d->path, "r");
+	spa_assert(f != NULL);
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	contents = calloc(1, size + 1);
+	spa_assert(contents != NULL);
+	spa_assert(fread(contents, 1, size, f) == (size_t)size);
+	fclose(f);
+	unlink(d->path);
+
+	return contents;
+}
+
+static void test_strings(void)
+{
+	struct data d;
+	char *fmt, *file, *func, *contents;
+	char *str;
+
+	logger_open(&d, true);
+
+	/* the strings can be freed before the message is written */
+	fmt = strdup("format %d %s");
+	file = strdup("/some/path/file.c");
+	func = strdup("function");
+	spa_log_log(d.log, SPA_LOG_LEVEL_INFO, file, 12, func, fmt, 42, "arg");
+	memset(fmt, 'x', strlen(fmt));
+	memset(file, 'x', strlen(file));
+	memset(func, 'x', strlen(func));
+	free(fmt);
+	free(file);
+	free(func);
+
+	/* not terminated within the precision */
+	str = malloc(4);
+	memcpy(str, "abcd", 4);
+	spa_log_info(d.log, "precision %.*s %.2s", 4, str, str);
+	free(str);
+
+	contents = logger_close(&d);
+	spa_assert(strstr(contents, "[file.c:12 function()] format 42 arg\n") != NULL);
+	spa_assert(strstr(contents, "precision abcd ab\n") != NULL);
+	free(contents);
+}
+
+static void test_long(bool deferred)
+{
+	struct data d;
+	char *msg, *contents, *end;
+
+	logger_open(&d, deferred);
+
+	/* longer than the line, it is truncated and the line still ends */
+	msg = malloc(4096);
+	memset(msg, 'x', 4095);
+	msg[4095] = '\0';
+	spa_log_info(d.log, "long %s", msg);
+	spa_log_info(d.log, "after");
+	free(msg);
+
+	contents = logger_close(&d);
+	spa_assert((end = strchr(contents, '\n')) != NULL);
+	spa_assert(end - contents < 2048);
+	spa_assert(strstr(end + 1, "after\n") != NULL);
+	free(contents);
+}
+
+static void *log_thread(void *user_data)
+{
+	struct data *d = user_data;
+	int i;
+
+	for (i = 0; i < N_MESSAGES; i++)
+		spa_log_info(d->log, "thread %p message %d", (void*)pthread_self(), i);
+
+	/* keep the ring of this thread until all threads logged */
+	pthread_barrier_wait(&d->barrier);
+	return NULL;
+}
+
+static void test_threads(void)
+{
+	struct data d;
+	pthread_t threads[N_THREADS];
+	char *contents, *p;
+	int i, lines = 0;
+
+	logger_open(&d, true);
+	pthread_barrier_init(&d.barrier, NULL, N_THREADS);
+
+	for (i = 0; i < N_THREADS; i++)
+		spa_assert(pthread_create(&threads[i], NULL, log_thread, &d) == 0);
+	for (i = 0; i < N_THREADS; i++)
+		pthread_join(threads[i], NULL);
+	pthread_barrier_destroy(&d.barrier);
+
+	contents = logger_close(&d);
+	for (p = contents; (p = strstr(p, " message ")) != NULL; p++)
+		lines++;
+	spa_assert(lines == N_THREADS * N_MESSAGES);
+	spa_assert(strstr(contents, "dropped") == NULL);
+	free(contents);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	test_strings();
+	test_long(false);
+	test_long(true);
+	test_threads();
+
+	return 0;
+}
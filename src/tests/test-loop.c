@@ -0,0 +1,164 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/data-loop.h>
+
+#define N_PRODUCERS	4
+#define N_INVOKES	20000
+
+struct data {
+	struct pw_data_loop *data_loop;
+	struct pw_loop *loop;
+	struct spa_source *event;
+
+	uint32_t last[N_PRODUCERS];
+	uint32_t n_invoked;
+	uint32_t n_in_thread;
+	uint32_t n_nested;
+};
+
+struct msg {
+	uint32_t producer;
+	uint32_t count;
+	/* make some of the items wrap around the ring */
+	uint8_t pad[200];
+};
+
+static int do_count(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	return seq;
+}
+
+static int do_msg(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	const struct msg *m = data;
+
+	spa_assert(size == sizeof(struct msg));
+	spa_assert(m->producer < N_PRODUCERS);
+	/* items from one thread are executed in order */
+	spa_assert(m->count == d->last[m->producer] + 1);
+	d->last[m->producer] = m->count;
+	d->n_invoked++;
+
+	/* a blocking invoke from an invoked item */
+	if (m->count % 64 == 0) {
+		spa_assert(pw_loop_invoke(d->loop, do_count, m->count,
+					NULL, 0, true, d) == (int)m->count);
+		d->n_nested++;
+	}
+	return 0;
+}
+
+static void on_event(void *user_data, uint64_t count)
+{
+	struct data *d = user_data;
+
+	/* a blocking invoke from the loop thread while the other threads
+	 * are queueing items */
+	spa_assert(pw_loop_invoke(d->loop, do_count, d->n_in_thread,
+				NULL, 0, true, d) == (int)d->n_in_thread);
+	d->n_in_thread++;
+}
+
+struct producer_data {
+	struct data *d;
+	uint32_t id;
+};
+
+static void *producer_thread(void *user_data)
+{
+	struct producer_data *pd = user_data;
+	struct data *d = pd->d;
+	struct msg m;
+	uint32_t i;
+	int res;
+
+	spa_zero(m);
+	m.producer = pd->id;
+
+	for (i = 1; i <= N_INVOKES; i++) {
+		m.count = i;
+		res = pw_loop_invoke(d->loop, do_msg, SPA_ID_INVALID,
+				&m, sizeof(m), i % 1000 == 0, d);
+		spa_assert(res >= 0);
+		if (i % 16 == 0)
+			pw_loop_signal_event(d->loop, d->event);
+	}
+	return NULL;
+}
+
+static void test_multi_producer(void)
+{
+	struct data d;
+	struct producer_data pd[N_PRODUCERS];
+	pthread_t threads[N_PRODUCERS];
+	uint32_t i;
+
+	spa_zero(d);
+	d.data_loop = pw_data_loop_new(NULL);
+	spa_assert(d.data_loop != NULL);
+	d.loop = pw_data_loop_get_loop(d.data_loop);
+
+	d.event = pw_loop_add_event(d.loop, on_event, &d);
+	spa_assert(d.event != NULL);
+
+	spa_assert(pw_data_loop_start(d.data_loop) == 0);
+
+	for (i = 0; i < N_PRODUCERS; i++) {
+		pd[i].d = &d;
+		pd[i].id = i;
+		spa_assert(pthread_create(&threads[i], NULL, producer_thread, &pd[i]) == 0);
+	}
+	for (i = 0; i < N_PRODUCERS; i++)
+		pthread_join(threads[i], NULL);
+
+	/* flush everything that is still queued */
+	spa_assert(pw_loop_invoke(d.loop, do_count, 1, NULL, 0, true, &d) == 1);
+
+	pw_data_loop_stop(d.data_loop);
+
+	for (i = 0; i < N_PRODUCERS; i++)
+		spa_assert(d.last[i] == N_INVOKES);
+	spa_assert(d.n_invoked == N_PRODUCERS * N_INVOKES);
+	spa_assert(d.n_nested == N_PRODUCERS * (N_INVOKES / 64));
+	spa_assert(d.n_in_thread > 0);
+
+	pw_loop_destroy_source(d.loop, d.event);
+	pw_data_loop_destroy(d.data_loop);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	test_multi_producer();
+
+	return 0;
+}
@@ -0,0 +1,229 @@
+/* PipeWire
+ *
+ * Copyright © 2021 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Runs the output tee of a port with a fake node and checks that a buffer
+ * is only given back to the node when all outputs released it. */
+
+#include "../pipewire/impl-port.c"
+
+#define N_OUTPUTS	3
+#define N_BUFFERS	4
+
+/* not exported by the library, the tee does not use them */
+struct pw_control *
+pw_control_new(struct pw_context *context, struct pw_impl_port *owner,
+	       uint32_t id, uint32_t size, size_t user_data_size)
+{
+	return NULL;
+}
+
+void pw_control_destroy(struct pw_control *control)
+{
+}
+
+struct data {
+	struct impl impl;
+	struct pw_impl_node node;
+	struct spa_node spa_node;
+	struct pw_impl_port_mix mix[N_OUTPUTS];
+	struct spa_io_buffers io[N_OUTPUTS];
+
+	uint32_t recycled[N_BUFFERS];
+	uint32_t n_recycled;
+};
+
+static int node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	struct data *d = object;
+
+	spa_assert(port_id == d->impl.this.port_id);
+	spa_assert(buffer_id < N_BUFFERS);
+	d->recycled[buffer_id]++;
+	d->n_recycled++;
+	return 0;
+}
+
+static const struct spa_node_methods node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.port_reuse_buffer = node_port_reuse_buffer,
+};
+
+static void data_init(struct data *d, uint32_t n_outputs)
+{
+	struct pw_impl_port *port = &d->impl.this;
+	uint32_t i;
+
+	spa_zero(*d);
+	d->spa_node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &node_methods, d);
+	d->node.node = &d->spa_node;
+
+	port->node = &d->node;
+	port->port_id = 7;
+	port->direction = PW_DIRECTION_OUTPUT;
+	spa_list_init(&port->rt.mix_list);
+	d->impl.n_tee_buffers = N_BUFFERS;
+
+	for (i = 0; i < n_outputs; i++) {
+		d->mix[i].port.port_id = i;
+		d->mix[i].io = &d->io[i];
+		d->mix[i].tee_buffer_id = SPA_ID_INVALID;
+		spa_list_append(&port->rt.mix_list, &d->mix[i].rt_link);
+	}
+}
+
+static void produce(struct data *d, uint32_t buffer_id)
+{
+	struct spa_io_buffers *io = &d->impl.this.rt.io;
+	uint32_t i;
+
+	io->status = SPA_STATUS_HAVE_DATA;
+	io->buffer_id = buffer_id;
+	tee_process(&d->impl);
+
+	spa_assert(io->status == SPA_STATUS_NEED_DATA);
+	for (i = 0; i < N_OUTPUTS; i++) {
+		if (d->mix[i].io == NULL)
+			continue;
+		spa_assert(d->io[i].status == SPA_STATUS_HAVE_DATA);
+		spa_assert(d->io[i].buffer_id == buffer_id);
+	}
+}
+
+static void test_out_of_order(void)
+{
+	struct data d;
+
+	data_init(&d, N_OUTPUTS);
+
+	/* the node must not see the buffer id again, it would recycle it */
+	produce(&d, 0);
+	spa_assert(d.impl.this.rt.io.buffer_id == SPA_ID_INVALID);
+	spa_assert(d.n_recycled == 0);
+
+	tee_reuse_buffer(&d.impl, 2, 0);
+	spa_assert(d.n_recycled == 0);
+	tee_reuse_buffer(&d.impl, 0, 0);
+	spa_assert(d.n_recycled == 0);
+	tee_reuse_buffer(&d.impl, 1, 0);
+	spa_assert(d.n_recycled == 1);
+	spa_assert(d.recycled[0] == 1);
+
+	/* a second reuse of the same buffer is ignored */
+	tee_reuse_buffer(&d.impl, 1, 0);
+	spa_assert(d.n_recycled == 1);
+}
+
+static void test_overlap(void)
+{
+	struct data d;
+
+	data_init(&d, N_OUTPUTS);
+
+	/* output 1 releases buffers before the others */
+	produce(&d, 0);
+	tee_reuse_buffer(&d.impl, 0, 0);
+	tee_reuse_buffer(&d.impl, 1, 0);
+	produce(&d, 1);
+	/* output 2 never gave buffer 0 back, it is released when the
+	 * output got the next buffer */
+	spa_assert(d.recycled[0] == 1);
+
+	tee_reuse_buffer(&d.impl, 1, 1);
+	produce(&d, 2);
+	spa_assert(d.recycled[1] == 1);
+	spa_assert(d.n_recycled == 2);
+
+	/* removing an output drops its reference */
+	tee_reuse_buffer(&d.impl, 2, 2);
+	tee_reuse_buffer(&d.impl, 0, 2);
+	spa_assert(d.recycled[2] == 0);
+	pw_impl_port_remove_rt_mix(&d.impl.this, &d.mix[1]);
+	d.mix[1].io = NULL;
+	spa_assert(d.recycled[2] == 1);
+	spa_assert(d.n_recycled == 3);
+
+	produce(&d, 3);
+	tee_reuse_buffer(&d.impl, 2, 3);
+	spa_assert(d.recycled[3] == 0);
+	tee_reuse_buffer(&d.impl, 0, 3);
+	spa_assert(d.recycled[3] == 1);
+	spa_assert(d.n_recycled == 4);
+}
+
+static void test_single_buffer(void)
+{
+	struct data d;
+	struct spa_io_buffers *io = &d.impl.this.rt.io;
+	bool busy = false;
+	uint32_t i, j;
+
+	data_init(&d, N_OUTPUTS);
+	d.impl.n_tee_buffers = 1;
+
+	/* a node with one buffer, like the splitter, recycles the buffer of
+	 * the io area before it dequeues the next one, it must always be
+	 * there */
+	for (i = 0; i < 8; i++) {
+		if (io->buffer_id != SPA_ID_INVALID) {
+			spa_assert(io->buffer_id == 0);
+			busy = false;
+		}
+		spa_assert(!busy);
+		busy = true;
+
+		produce(&d, 0);
+		spa_assert(io->buffer_id == 0);
+
+		for (j = 0; j < N_OUTPUTS; j++)
+			tee_reuse_buffer(&d.impl, j, 0);
+	}
+	spa_assert(d.n_recycled == 0);
+}
+
+static void test_single_output(void)
+{
+	struct data d;
+
+	data_init(&d, 1);
+
+	/* with one output the node recycles the buffer from the io area */
+	produce(&d, 0);
+	spa_assert(d.impl.this.rt.io.buffer_id == 0);
+	tee_reuse_buffer(&d.impl, 0, 0);
+	produce(&d, 1);
+	spa_assert(d.n_recycled == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	test_out_of_order();
+	test_overlap();
+	test_single_buffer();
+	test_single_output();
+
+	return 0;
+}
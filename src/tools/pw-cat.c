@@ -34,6 +34,8 @@
 #include <unistd.h>
 #include <assert.h>
 #include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <sndfile.h>
 
@@ -42,6 +44,7 @@
 #include <spa/param/audio/type-info.h>
 #include <spa/param/props.h>
 #include <spa/utils/result.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/debug/types.h>
 
 #include <pipewire/pipewire.h>
@@ -63,6 +66,7 @@
 #define DEFAULT_FORMAT		"s16"
 #define DEFAULT_VOLUME		1.0
 #define DEFAULT_QUALITY		4
+#define DEFAULT_PREFETCH	500
 
 enum mode {
 	mode_none,
@@ -157,6 +161,28 @@ struct data {
 		struct midi_file *file;
 		struct midi_file_info info;
 	} midi;
+
+	/* file data is read and written in a separate thread and exchanged
+	 * with the process function through a ringbuffer */
+	unsigned int prefetch;
+	struct {
+		struct pw_thread_loop *loop;
+		struct spa_source *event;
+		struct spa_ringbuffer ring;
+		uint8_t *buffer;
+		uint32_t size;		/* power of 2 */
+		uint8_t *chunk;
+		uint32_t chunk_size;	/* bytes per file read or write */
+		int eof;
+		uint32_t xruns;
+	} io;
+
+	struct {
+		void *data;
+		size_t size;
+		size_t pos;		/* position of the next sample */
+		size_t end;		/* end of the sample data */
+	} map;
 };
 
 static inline int
@@ -430,6 +456,222 @@ sf_fmt_record_fill_fn(int format)
 	return NULL;
 }
 
+static int map_playback_fill(struct data *d, void *dest, unsigned int n_frames)
+{
+	size_t len, ahead;
+
+	len = SPA_MIN((size_t)n_frames * d->stride, d->map.end - d->map.pos);
+	len -= len % d->stride;
+	memcpy(dest, SPA_MEMBER(d->map.data, d->map.pos, void), len);
+	d->map.pos += len;
+
+	/* start reading the next block of the file in the kernel */
+	ahead = d->map.pos & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+	if (ahead < d->map.end)
+		madvise(SPA_MEMBER(d->map.data, ahead, void),
+				SPA_MIN(d->io.size, d->map.end - ahead), MADV_WILLNEED);
+
+	return len / d->stride;
+}
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* WAV files with samples in the stream format are played straight from
+ * a mapping of the file, without going through libsndfile */
+static int setup_map(struct data *data, const SF_INFO *info)
+{
+	struct stat st;
+	uint8_t *p;
+	size_t pos, len;
+	int fd, res;
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+	return -ENOTSUP;
+#endif
+	if ((info->format & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAV)
+		return -ENOTSUP;
+
+	switch (info->format & SF_FORMAT_SUBMASK) {
+	case SF_FORMAT_PCM_16:
+	case SF_FORMAT_PCM_32:
+	case SF_FORMAT_FLOAT:
+	case SF_FORMAT_DOUBLE:
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	if ((fd = open(data->filename, O_RDONLY | O_CLOEXEC)) < 0)
+		return -errno;
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		goto error_close;
+	}
+	if (st.st_size < 12) {
+		res = -EINVAL;
+		goto error_close;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		res = -errno;
+		goto error_close;
+	}
+	close(fd);
+
+	data->map.data = p;
+	data->map.size = st.st_size;
+
+	if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0)
+		return -EINVAL;
+
+	/* find the data chunk */
+	for (pos = 12; pos + 8 <= data->map.size; pos += 8 + len + (len & 1)) {
+		len = read_le32(p + pos + 4);
+		if (memcmp(p + pos, "data", 4) == 0)
+			break;
+	}
+	if (pos + 8 > data->map.size)
+		return -EINVAL;
+
+	pos += 8;
+	len = (size_t)info->frames * data->stride;
+	if (len > data->map.size - pos)
+		return -EINVAL;
+
+	data->map.pos = pos;
+	data->map.end = pos + len;
+	madvise(p, data->map.size, MADV_SEQUENTIAL);
+
+	data->fill = map_playback_fill;
+
+	if (data->verbose)
+		printf("playing samples from mapping of file at offset %zd\n", pos);
+
+	return 0;
+
+error_close:
+	close(fd);
+	return res;
+}
+
+static void io_playback(struct data *d)
+{
+	uint32_t index, avail;
+	int32_t filled;
+	int n_frames;
+
+	while (!d->io.eof) {
+		filled = spa_ringbuffer_get_write_index(&d->io.ring, &index);
+		avail = d->io.size - filled;
+		avail = SPA_MIN(avail, d->io.chunk_size) / d->stride;
+		if (avail == 0)
+			break;
+
+		n_frames = d->fill(d, d->io.chunk, avail);
+		if (n_frames <= 0) {
+			if (n_frames < 0)
+				fprintf(stderr, "fill error %d\n", n_frames);
+			__atomic_store_n(&d->io.eof, 1, __ATOMIC_RELEASE);
+			break;
+		}
+		spa_ringbuffer_write_data(&d->io.ring, d->io.buffer, d->io.size,
+				index & (d->io.size - 1), d->io.chunk,
+				n_frames * d->stride);
+		spa_ringbuffer_write_update(&d->io.ring, index + n_frames * d->stride);
+	}
+}
+
+static void io_record(struct data *d, bool flush)
+{
+	uint32_t index, avail;
+	int32_t filled;
+
+	while (true) {
+		filled = spa_ringbuffer_get_read_index(&d->io.ring, &index);
+		if (filled <= 0 || (!flush && filled < (int32_t)d->io.chunk_size))
+			break;
+
+		avail = SPA_MIN((uint32_t)filled, d->io.chunk_size);
+		spa_ringbuffer_read_data(&d->io.ring, d->io.buffer, d->io.size,
+				index & (d->io.size - 1), d->io.chunk, avail);
+		spa_ringbuffer_read_update(&d->io.ring, index + avail);
+
+		d->fill(d, d->io.chunk, avail / d->stride);
+	}
+}
+
+static void on_io_event(void *userdata, uint64_t count)
+{
+	struct data *d = userdata;
+
+	if (d->mode == mode_playback)
+		io_playback(d);
+	else
+		io_record(d, false);
+}
+
+static int setup_io(struct data *data)
+{
+	uint32_t size;
+	int res;
+
+	size = (uint64_t)data->prefetch * data->rate / 1000 * data->stride;
+	data->io.size = 4096;
+	while (data->io.size < size)
+		data->io.size <<= 1;
+
+	/* read and write in large blocks */
+	data->io.chunk_size = data->io.size / 4;
+	data->io.chunk_size -= data->io.chunk_size % data->stride;
+
+	data->io.buffer = malloc(data->io.size);
+	data->io.chunk = malloc(data->io.chunk_size);
+	if (data->io.buffer == NULL || data->io.chunk == NULL)
+		return -errno;
+
+	spa_ringbuffer_init(&data->io.ring);
+
+	data->io.loop = pw_thread_loop_new("pw-cat-io", NULL);
+	if (data->io.loop == NULL)
+		return -errno;
+
+	data->io.event = pw_loop_add_event(pw_thread_loop_get_loop(data->io.loop),
+			on_io_event, data);
+	if (data->io.event == NULL)
+		return -errno;
+
+	if (data->mode == mode_playback)
+		io_playback(data);
+
+	if ((res = pw_thread_loop_start(data->io.loop)) < 0)
+		return res;
+
+	if (data->verbose)
+		printf("prefetch %u bytes in chunks of %u bytes\n",
+				data->io.size, data->io.chunk_size);
+	return 0;
+}
+
+static void cleanup_io(struct data *data)
+{
+	if (data->io.loop) {
+		pw_thread_loop_stop(data->io.loop);
+		if (data->mode == mode_record && data->io.buffer)
+			io_record(data, true);
+		pw_thread_loop_destroy(data->io.loop);
+	}
+	if (data->io.xruns > 0)
+		fprintf(stderr, "warning: %u %s\n", data->io.xruns,
+				data->mode == mode_playback ? "underruns" : "overruns");
+	free(data->io.buffer);
+	free(data->io.chunk);
+	if (data->map.data)
+		munmap(data->map.data, data->map.size);
+}
+
 static int channelmap_from_sf(struct channelmap *map)
 {
 	static const enum spa_audio_channel table[] = {
@@ -812,6 +1054,63 @@ on_param_changed(void *userdata, uint32_t id, const struct spa_pod *format)
 				id);
 }
 
+static void on_process_ring(struct data *data, struct pw_buffer *b)
+{
+	struct spa_data *d = &b->buffer->datas[0];
+	uint32_t index, offset, size;
+	int32_t filled;
+
+	if (data->mode == mode_playback) {
+		filled = spa_ringbuffer_get_read_index(&data->io.ring, &index);
+		size = d->maxsize - d->maxsize % data->stride;
+		size = SPA_MIN(size, (uint32_t)SPA_MAX(filled, 0));
+
+		if (size == 0) {
+			if (__atomic_load_n(&data->io.eof, __ATOMIC_ACQUIRE)) {
+				pw_stream_flush(data->stream, true);
+				return;
+			}
+			/* the I/O thread is late, play silence */
+			size = data->position ?
+				data->position->clock.duration * data->stride : d->maxsize;
+			size = SPA_MIN(size, d->maxsize - d->maxsize % data->stride);
+			memset(d->data, 0, size);
+			data->io.xruns++;
+		} else {
+			spa_ringbuffer_read_data(&data->io.ring, data->io.buffer,
+					data->io.size, index & (data->io.size - 1),
+					d->data, size);
+			spa_ringbuffer_read_update(&data->io.ring, index + size);
+		}
+		d->chunk->offset = 0;
+		d->chunk->stride = data->stride;
+		d->chunk->size = size;
+	} else {
+		offset = SPA_MIN(d->chunk->offset, d->maxsize);
+		size = SPA_MIN(d->chunk->size, d->maxsize - offset);
+
+		filled = spa_ringbuffer_get_write_index(&data->io.ring, &index);
+		if (size > data->io.size - filled) {
+			/* the I/O thread is late, drop the samples */
+			size = data->io.size - filled;
+			data->io.xruns++;
+		}
+		size -= size % data->stride;
+
+		spa_ringbuffer_write_data(&data->io.ring, data->io.buffer,
+				data->io.size, index & (data->io.size - 1),
+				SPA_MEMBER(d->data, offset, void), size);
+		spa_ringbuffer_write_update(&data->io.ring, index + size);
+		filled += size;
+	}
+	pw_stream_queue_buffer(data->stream, b);
+
+	if (data->mode == mode_playback ||
+	    filled >= (int32_t)data->io.chunk_size)
+		pw_loop_signal_event(pw_thread_loop_get_loop(data->io.loop),
+				data->io.event);
+}
+
 static void on_process(void *userdata)
 {
 	struct data *data = userdata;
@@ -834,6 +1133,11 @@ static void on_process(void *userdata)
 	if ((p = d->data) == NULL)
 		return;
 
+	if (data->io.loop) {
+		on_process_ring(data, b);
+		return;
+	}
+
 	if (data->mode == mode_playback) {
 
 		n_frames = d->maxsize / data->stride;
@@ -919,6 +1223,7 @@ enum {
 	OPT_FORMAT,
 	OPT_VOLUME,
 	OPT_LIST_TARGETS,
+	OPT_PREFETCH,
 };
 
 static const struct option long_options[] = {
@@ -946,6 +1251,7 @@ static const struct option long_options[] = {
 	{ "quality",		required_argument, NULL, 'q' },
 
 	{ "list-targets",	no_argument, NULL, OPT_LIST_TARGETS },
+	{ "prefetch",		required_argument, NULL, OPT_PREFETCH },
 
 	{ NULL, 0, NULL, 0 }
 };
@@ -991,12 +1297,15 @@ static void show_usage(const char *name, bool is_error)
              "      --format                          Sample format %s (req. for rec) (default %s)\n"
 	     "      --volume                          Stream volume 0-1.0 (default %.3f)\n"
 	     "  -q  --quality                         Resampler quality (0 - 15) (default %d)\n"
+	     "      --prefetch                        Read ahead or write behind in msec\n"
+	     "                                          in a separate thread, 0 disables (default %d)\n"
 	     "\n",
 	     DEFAULT_RATE,
 	     DEFAULT_CHANNELS,
 	     STR_FMTS, DEFAULT_FORMAT,
 	     DEFAULT_VOLUME,
-	     DEFAULT_QUALITY);
+	     DEFAULT_QUALITY,
+	     DEFAULT_PREFETCH);
 
 	if (!strcmp(name, "pw-cat")) {
 		fprintf(fp,
@@ -1254,6 +1563,9 @@ static int setup_sndfile(struct data *data)
 			sf_fmt_playback_fill_fn(info.format) :
 			sf_fmt_record_fill_fn(info.format);
 
+	if (data->mode == mode_playback && data->prefetch > 0)
+		setup_map(data, &info);
+
 	data->latency_unit = unit_none;
 
 	s = data->latency;
@@ -1359,6 +1671,7 @@ int main(int argc, char *argv[])
 	/* negative means no volume adjustment */
 	data.volume = -1.0;
 	data.quality = -1;
+	data.prefetch = DEFAULT_PREFETCH;
 
 	/* initialize list every time */
 	spa_list_init(&data.targets);
@@ -1471,6 +1784,10 @@ int main(int argc, char *argv[])
 			data.list_targets = true;
 			break;
 
+		case OPT_PREFETCH:
+			data.prefetch = atoi(optarg);
+			break;
+
 		default:
 			fprintf(stderr, "error: unknown option '%c'\n", c);
 			goto error_usage;
@@ -1620,6 +1937,16 @@ int main(int argc, char *argv[])
 			pw_properties_set(data.props, PW_KEY_FORMAT_DSP, "8 bit raw midi");
 		}
 
+		if (!data.is_midi && data.prefetch > 0) {
+			if ((ret = setup_io(&data)) < 0) {
+				fprintf(stderr, "error: failed to start I/O thread: %s\n",
+						spa_strerror(ret));
+				goto error_no_stream;
+			}
+			/* process only copies from and to the ringbuffer */
+			flags |= PW_STREAM_FLAG_RT_PROCESS;
+		}
+
 		data.stream = pw_stream_new(data.core, prog, data.props);
 		data.props = NULL;
 
@@ -1712,6 +2039,7 @@ error_connect_fail:
 	if (data.stream)
 		pw_stream_destroy(data.stream);
 error_no_stream:
+	cleanup_io(&data);
 	if (data.metadata)
 		pw_proxy_destroy((struct pw_proxy*)data.metadata);
 	if (data.registry)
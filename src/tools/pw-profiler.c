@@ -25,6 +25,8 @@
 #include <stdio.h>
 #include <signal.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <spa/utils/result.h>
 #include <spa/pod/parser.h>
@@ -36,12 +38,20 @@
 #define MAX_NAME		128
 #define MAX_FOLLOWERS		64
 #define DEFAULT_FILENAME	"profiler.log"
+#define MAX_RECORD		(sizeof(struct pw_profiler_record) + \
+				 1024 * sizeof(struct pw_profiler_block))
 
 struct follower {
 	uint32_t id;
 	char name[MAX_NAME];
 };
 
+struct node {
+	struct spa_list link;
+	uint32_t id;
+	char name[MAX_NAME];
+};
+
 struct data {
 	struct pw_main_loop *loop;
 	struct pw_context *context;
@@ -67,6 +77,16 @@ struct data {
 
 	int n_followers;
 	struct follower followers[MAX_FOLLOWERS];
+
+	struct spa_list node_list;
+
+	struct pw_profiler_ring *ring;
+	size_t ring_size;
+	uint32_t ring_data_size;
+	uint64_t read_index;
+	uint64_t lost;
+	struct spa_source *timer;
+	uint8_t record[MAX_RECORD];
 };
 
 struct measurement {
@@ -461,9 +481,118 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 	}
 }
 
+static const char *node_name(struct data *d, uint32_t id)
+{
+	struct node *n;
+	spa_list_for_each(n, &d->node_list, link) {
+		if (n->id == id)
+			return n->name;
+	}
+	return "";
+}
+
+static int process_record(struct data *d, const struct pw_profiler_record *r)
+{
+	struct point point;
+	uint32_t i;
+	int idx;
+
+	if (d->driver_id == 0) {
+		d->driver_id = r->driver.id;
+		fprintf(stderr, "logging driver %u\n", d->driver_id);
+	}
+	else if (d->driver_id != r->driver.id)
+		return 0;
+
+	spa_zero(point);
+	point.count = r->count;
+	point.cpu_load[0] = r->cpu_load[0];
+	point.cpu_load[1] = r->cpu_load[1];
+	point.cpu_load[2] = r->cpu_load[2];
+	point.clock = r->clock;
+	point.driver.prev_signal = r->driver.prev_signal_time;
+	point.driver.signal = r->driver.signal_time;
+	point.driver.awake = r->driver.awake_time;
+	point.driver.finish = r->driver.finish_time;
+	point.driver.status = r->driver.status;
+
+	for (i = 0; i < r->n_followers; i++) {
+		const struct pw_profiler_block *b = &r->followers[i];
+		const char *name = node_name(d, b->id);
+
+		if ((idx = find_follower(d, b->id, name)) < 0) {
+			if ((idx = add_follower(d, b->id, name)) < 0) {
+				pw_log_warn("too many followers");
+				continue;
+			}
+		}
+		point.follower[idx].prev_signal = b->prev_signal_time;
+		point.follower[idx].signal = b->signal_time;
+		point.follower[idx].awake = b->awake_time;
+		point.follower[idx].finish = b->finish_time;
+		point.follower[idx].status = b->status;
+	}
+	dump_point(d, &point);
+	return 0;
+}
+
+static void do_read_ring(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	int res;
+
+	while ((res = pw_profiler_ring_read(d->ring, d->ring_data_size, &d->read_index,
+					d->record, sizeof(d->record))) != 0) {
+		if (res < 0) {
+			if (d->lost++ == 0)
+				fprintf(stderr, "\nlost records, can't keep up\n");
+			continue;
+		}
+		process_record(d, (const struct pw_profiler_record *)d->record);
+	}
+}
+
+static void profiler_ring(void *data, int fd, uint32_t size)
+{
+	struct data *d = data;
+	struct pw_loop *l = pw_main_loop_get_loop(d->loop);
+	struct timespec value, interval;
+	void *ptr;
+
+	ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		pw_log_error("can't map profiler ring: %m");
+		return;
+	}
+	if (d->ring)
+		munmap(d->ring, d->ring_size);
+
+	d->ring = ptr;
+	d->ring_size = size;
+	d->ring_data_size = d->ring->size;
+	if (d->ring->magic != PW_PROFILER_RING_MAGIC ||
+	    d->ring_data_size == 0 || (d->ring_data_size & (d->ring_data_size - 1)) ||
+	    sizeof(struct pw_profiler_ring) + d->ring_data_size > size) {
+		pw_log_error("invalid profiler ring");
+		munmap(d->ring, d->ring_size);
+		d->ring = NULL;
+		return;
+	}
+	d->read_index = __atomic_load_n(&d->ring->write_index, __ATOMIC_ACQUIRE);
+
+	if (d->timer == NULL)
+		d->timer = pw_loop_add_timer(l, do_read_ring, d);
+	value.tv_sec = 0;
+	value.tv_nsec = 100 * SPA_NSEC_PER_MSEC;
+	interval = value;
+	pw_loop_update_timer(l, d->timer, &value, &interval, false);
+}
+
 static const struct pw_profiler_events profiler_events = {
 	PW_VERSION_PROFILER_EVENTS,
         .profile = profiler_profile,
+        .ring = profiler_ring,
 };
 
 static void registry_event_global(void *data, uint32_t id,
@@ -473,6 +602,22 @@ static void registry_event_global(void *data, uint32_t id,
 	struct data *d = data;
 	struct pw_proxy *proxy;
 
+	if (strcmp(type, PW_TYPE_INTERFACE_Node) == 0) {
+		struct node *n;
+		const char *str;
+
+		if ((str = spa_dict_lookup(props, PW_KEY_NODE_NAME)) == NULL &&
+		    (str = spa_dict_lookup(props, PW_KEY_NODE_DESCRIPTION)) == NULL &&
+		    (str = spa_dict_lookup(props, PW_KEY_APP_NAME)) == NULL)
+			return;
+
+		if ((n = calloc(1, sizeof(*n))) == NULL)
+			return;
+		n->id = id;
+		snprintf(n->name, sizeof(n->name), "%s", str);
+		spa_list_append(&d->node_list, &n->link);
+		return;
+	}
 	if (strcmp(type, PW_TYPE_INTERFACE_Profiler) != 0)
 		return;
 
@@ -496,9 +641,24 @@ error_proxy:
 	return;
 }
 
+static void registry_event_global_remove(void *data, uint32_t id)
+{
+	struct data *d = data;
+	struct node *n;
+
+	spa_list_for_each(n, &d->node_list, link) {
+		if (n->id == id) {
+			spa_list_remove(&n->link);
+			free(n);
+			break;
+		}
+	}
+}
+
 static const struct pw_registry_events registry_events = {
 	PW_VERSION_REGISTRY_EVENTS,
 	.global = registry_event_global,
+	.global_remove = registry_event_global_remove,
 };
 
 static void on_core_error(void *_data, uint32_t id, int seq, int res, const char *message)
@@ -552,6 +712,7 @@ int main(int argc, char *argv[])
 {
 	struct data data = { 0 };
 	struct pw_loop *l;
+	struct node *n;
 	const char *opt_remote = NULL;
 	const char *opt_output = DEFAULT_FILENAME;
 	static const struct option long_options[] = {
@@ -565,6 +726,8 @@ int main(int argc, char *argv[])
 
 	pw_init(&argc, &argv);
 
+	spa_list_init(&data.node_list);
+
 	while ((c = getopt_long(argc, argv, "hVr:o:", long_options, NULL)) != -1) {
 		switch (c) {
 		case 'h':
@@ -641,11 +804,21 @@ int main(int argc, char *argv[])
 
 	pw_main_loop_run(data.loop);
 
+	if (data.ring)
+		do_read_ring(&data, 0);
+
 	pw_proxy_destroy((struct pw_proxy*)data.profiler);
 	pw_proxy_destroy((struct pw_proxy*)data.registry);
 	pw_context_destroy(data.context);
 	pw_main_loop_destroy(data.loop);
 
+	if (data.ring)
+		munmap(data.ring, data.ring_size);
+	spa_list_consume(n, &data.node_list, link) {
+		spa_list_remove(&n->link);
+		free(n);
+	}
+
 	fclose(data.output);
 
 	dump_scripts(&data);
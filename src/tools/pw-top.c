@@ -25,6 +25,8 @@
 #include <stdio.h>
 #include <signal.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <ncurses.h>
 
 #include <spa/utils/result.h>
@@ -35,6 +37,8 @@
 #include <extensions/profiler.h>
 
 #define MAX_NAME		128
+#define MAX_RECORD		(sizeof(struct pw_profiler_record) + \
+				 1024 * sizeof(struct pw_profiler_block))
 
 struct driver {
 	int64_t count;
@@ -84,6 +88,12 @@ struct data {
 	int n_nodes;
 	struct spa_list node_list;
 
+	struct pw_profiler_ring *ring;
+	size_t ring_size;
+	uint32_t ring_data_size;
+	uint64_t read_index;
+	uint8_t record[MAX_RECORD];
+
 	WINDOW *win;
 };
 
@@ -155,6 +165,69 @@ static void remove_node(struct data *d, struct node *n)
 	free(n);
 }
 
+static void update_node(struct node *n, struct node *driver, const struct measurement *m)
+{
+	n->measurement = *m;
+	n->driver = driver;
+	if (m->status != 3) {
+		n->errors++;
+		if (n->last_error_status == -1)
+			n->last_error_status = m->status;
+	}
+}
+
+static void block_to_measurement(const struct pw_profiler_block *b, struct measurement *m)
+{
+	spa_zero(*m);
+	m->status = b->status;
+	m->prev_signal = b->prev_signal_time;
+	m->signal = b->signal_time;
+	m->awake = b->awake_time;
+	m->finish = b->finish_time;
+	m->latency = b->latency;
+}
+
+static void process_record(struct data *d, const struct pw_profiler_record *r)
+{
+	struct measurement m;
+	struct node *driver, *n;
+	uint32_t i;
+
+	if ((driver = find_node(d, r->driver.id)) == NULL)
+		return;
+
+	driver->info.count = r->count;
+	driver->info.cpu_load[0] = r->cpu_load[0];
+	driver->info.cpu_load[1] = r->cpu_load[1];
+	driver->info.cpu_load[2] = r->cpu_load[2];
+	driver->info.xrun_count = r->xrun_count;
+	driver->info.clock = r->clock;
+
+	block_to_measurement(&r->driver, &m);
+	update_node(driver, driver, &m);
+
+	for (i = 0; i < r->n_followers; i++) {
+		if ((n = find_node(d, r->followers[i].id)) == NULL)
+			continue;
+		block_to_measurement(&r->followers[i], &m);
+		update_node(n, driver, &m);
+	}
+}
+
+static void read_ring(struct data *d)
+{
+	int res;
+
+	if (d->ring == NULL)
+		return;
+
+	while ((res = pw_profiler_ring_read(d->ring, d->ring_data_size, &d->read_index,
+					d->record, sizeof(d->record))) != 0) {
+		if (res > 0)
+			process_record(d, (const struct pw_profiler_record *)d->record);
+	}
+}
+
 static int process_driver_block(struct data *d, const struct spa_pod *pod, struct point *point)
 {
 	char *name = NULL;
@@ -176,16 +249,9 @@ static int process_driver_block(struct data *d, const struct spa_pod *pod, struc
 	if ((n = find_node(d, id)) == NULL)
 		return -ENOENT;
 
-	n->driver = n;
-	n->measurement = m;
 	n->info = point->info;
 	point->driver = n;
-
-	if (m.status != 3) {
-		n->errors++;
-		if (n->last_error_status == -1)
-			n->last_error_status = m.status;
-	}
+	update_node(n, n, &m);
 	return 0;
 }
 
@@ -210,13 +276,7 @@ static int process_follower_block(struct data *d, const struct spa_pod *pod, str
 	if ((n = find_node(d, id)) == NULL)
 		return -ENOENT;
 
-	n->measurement = m;
-	n->driver = point->driver;
-	if (m.status != 3) {
-		n->errors++;
-		if (n->last_error_status == -1)
-			n->last_error_status = m.status;
-	}
+	update_node(n, point->driver, &m);
 	return 0;
 }
 
@@ -304,6 +364,7 @@ static void do_refresh(struct data *d)
 static void do_timeout(void *data, uint64_t expirations)
 {
 	struct data *d = data;
+	read_ring(d);
 	do_refresh(d);
 }
 
@@ -345,9 +406,38 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 	}
 }
 
+static void profiler_ring(void *data, int fd, uint32_t size)
+{
+	struct data *d = data;
+	void *ptr;
+
+	ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		pw_log_error("can't map profiler ring: %m");
+		return;
+	}
+	if (d->ring)
+		munmap(d->ring, d->ring_size);
+
+	d->ring = ptr;
+	d->ring_size = size;
+	d->ring_data_size = d->ring->size;
+	if (d->ring->magic != PW_PROFILER_RING_MAGIC ||
+	    d->ring_data_size == 0 || (d->ring_data_size & (d->ring_data_size - 1)) ||
+	    sizeof(struct pw_profiler_ring) + d->ring_data_size > size) {
+		pw_log_error("invalid profiler ring");
+		munmap(d->ring, d->ring_size);
+		d->ring = NULL;
+		return;
+	}
+	d->read_index = __atomic_load_n(&d->ring->write_index, __ATOMIC_ACQUIRE);
+}
+
 static const struct pw_profiler_events profiler_events = {
 	PW_VERSION_PROFILER_EVENTS,
         .profile = profiler_profile,
+        .ring = profiler_ring,
 };
 
 static void registry_event_global(void *data, uint32_t id,
@@ -585,6 +675,9 @@ int main(int argc, char *argv[])
 	pw_context_destroy(data.context);
 	pw_main_loop_destroy(data.loop);
 
+	if (data.ring)
+		munmap(data.ring, data.ring_size);
+
 	pw_deinit();
 
 	return 0;